@@ -29,6 +29,15 @@
 
 #include <stdio.h>
 
+struct sink;
+struct styles;
+struct defs;
+struct occlusion;
+struct stroke_space;
+struct markers;
+struct glyphs;
+struct group_share;
+
 #ifndef false
 #define false 0
 #endif
@@ -37,8 +46,6 @@
 #define true 1
 #endif
 
-#define RELCOORDS
-
 #define LINE_WIDTH 76
 
 enum { SCALE_FACTOR, SCALE_WIDTH, SCALE_HEIGHT, SCALE_FIT };
@@ -47,7 +54,7 @@ enum { PAR_NONE, PAR_MEET, PAR_SLICE };
 enum { SIZE_NONE, SIZE_PERCENT, SIZE_ABS };
 
 struct context {
-  const char *iname, *oname, *bgcol;
+  const char *iname, *oname, *bgcol, *tiles, *font_dir, *glyph_cache;
   const struct unit *u;
   double thin;
   union {
@@ -61,26 +68,144 @@ struct context {
   struct {
     double width, height;
   } margin;
+  struct {
+    double x0, y0, x1, y1;
+  } region;
   unsigned topxy : 1, groups : 1, itype : 1, otype : 1, scaletype : 2,
-    abssized : 2;
+    abssized : 2, compact : 1, stats : 1, async : 1, rebase : 1,
+    stylesheet : 1, dedup : 1, merge : 1, shapes : 1, flatten : 1,
+    crop : 1, occlude : 1, tight : 1, stroke_fill : 1, cap_markers : 1,
+    share_glyphs : 1;
   unsigned parx, pary, partype;
   unsigned text_to_path;
+  int gzip, gzip_level;
+  int precision;
+  unsigned dedup_min;
+  double lod;
+  unsigned levels[8];
+  int nlevels;
+  int tile_zoom;
+  unsigned max_path;
+};
+
+enum { GZIP_NO, GZIP_YES, GZIP_AUTO };
+
+struct span {
+  size_t end;
+  int indent, pretty;
 };
 
 struct ws {
   struct context *ct;
-  FILE *out;
+  struct sink *out;
   int cpos;
   void *buf;
   int indent;
   int *bbox;
   const char *font[256];
+
+  /* Drawfile coordinates are multiplied by 'uscale', rounded if
+     'grid' is set, and then offset by (ox, oy) to give user
+     coordinates. */
+  double uscale;
+  int grid, ox, oy;
+
+  /* Path data written, and what it would have been unoptimized */
+  unsigned long long path_bytes, path_legacy;
+
+  /* Styles given classes in the stylesheet, if there is one */
+  struct styles *styles;
+
+  /* Paths and groups written once and used many times, if enabled */
+  struct defs *defs;
+
+  /* Paths written merged with their neighbours, and the elements
+     they were merged into */
+  unsigned long merged, merges;
+
+  /* Paths written as simpler elements */
+  unsigned long shapes;
+
+  /* Paths written in pieces, and the pieces */
+  unsigned long split, pieces;
+
+  /* Properties set by the enclosing <g>, which its children inherit
+     instead of setting themselves */
+  unsigned hoist;
+
+  /* Groups left out, and properties moved onto groups */
+  unsigned long flattened, hoisted;
+
+  /* What the groups within the outermost group being written share,
+     in order of position, found in one pass over it */
+  struct group_share *shares;
+  size_t nshares, shcap;
+  int sharing;
+
+  /* Objects wholly outside this box, in draw units, are skipped, if
+     cropping */
+  int cropping, crop[4];
+  unsigned long culled;
+
+  /* Objects smaller than this, in draw units, are skipped, and
+     outlines thinner than it are left off filled paths, if positive */
+  double lod;
+  unsigned long small;
+
+  /* Objects painted over by later opaque rectangles, if looked for,
+     and their size in the drawfile */
+  struct occlusion *occlusion;
+  unsigned long hidden, hidden_bytes;
+
+  /* Space for outlines written as areas, if they are */
+  struct stroke_space *stroke;
+
+  /* Caps drawn as markers, if they can be, and the paths using them */
+  struct markers *markers;
+  unsigned long marked;
+
+  /* Fonts found for text written as paths, and the outlines of their
+     characters, with the number of copies written */
+  struct glyphs *glyphs;
+  unsigned long glyph_uses;
+
+  /* Output is accumulated here, and written to 'out' a block at a
+     time. */
+  char *obuf;
+  size_t olen, ocap;
+  int oerr;
+
+  /* Layout stage, either pretty-printing or compact */
+  int (*put)(struct ws *, int pretty, const char *, size_t);
+
+  /* Pretty output waiting to be laid out */
+  char *tbuf;
+  size_t tlen, tcap;
+  struct span *spans;
+  size_t nspans, scap;
+
+  /* Compact output state: the last character written, and whether
+     whitespace has been skipped since. */
+  int lastc, gap;
+
+  /* Scratch space for formatting */
+  char *fbuf;
+  size_t fcap;
 };
 
 int process(struct context *);
 void indent(struct ws *ws);
 void cindent(struct ws *ws, int *spp, int req);
 int output(struct ws *ws, int pretty, const char *fmt, ...);
+int output_str(struct ws *ws, int pretty, const char *s, size_t n);
+void out_init(struct ws *ws, struct sink *out, int compact);
+int out_flush(struct ws *ws);
+void out_free(struct ws *ws);
+void output_nums(struct ws *ws, const char *pre, int n, const double *v,
+                 const char *sep, const char *post);
+void output_colour(struct ws *ws, const char *pre, unsigned long c,
+                   const char *post);
+double map_size(const struct ws *ws, double l);
 
 #define OUT_PRETTY   1u
 #define OUT_ESCAMP   2u
@@ -101,5 +226,6 @@ int output(struct ws *ws, int pretty, const char *fmt, ...);
   (OUT_ESCAPOS | OUT_ESCQUOT | OUT_ESCGT | OUT_ESCLT | OUT_ESCAMP)
 
 int output_esc(struct ws *ws, unsigned flags, const char *fmt, ...);
+int output_esc_str(struct ws *ws, unsigned flags, const char *s, size_t n);
 
 #endif
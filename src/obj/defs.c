@@ -0,0 +1,265 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "defs.h"
+#include "nomem.h"
+
+void defs_init(struct defs *ds, size_t min)
+{
+  ds->ents = NULL;
+  ds->n = ds->cap = 0;
+  ds->slots = NULL;
+  ds->nslots = 0;
+  ds->min = min;
+  for (int i = 0; i < 2; i++) {
+    ds->buf[i] = NULL;
+    ds->len[i] = ds->bcap[i] = 0;
+  }
+  ds->ids = 0;
+}
+
+void defs_free(struct defs *ds)
+{
+  free(ds->ents);
+  free(ds->slots);
+  free(ds->buf[0]);
+  free(ds->buf[1]);
+}
+
+const int *def_path_elements(const int *d)
+{
+  return d + 10 + ((d[9] >> 7 & 1) ? 2 + d[11] : 0);
+}
+
+static void push(struct defs *ds, int b, int v)
+{
+  if (ds->len[b] == ds->bcap[b]) {
+    size_t nc = ds->bcap[b] ? ds->bcap[b] * 2 : 256;
+    void *nb = realloc(ds->buf[b], nc * sizeof *ds->buf[b]);
+    if (!nb) nomem();
+    ds->buf[b] = nb;
+    ds->bcap[b] = nc;
+  }
+  ds->buf[b][ds->len[b]++] = v;
+}
+
+/* Copy path elements, translating coordinates. */
+static void norm_path(struct defs *ds, int b, const int *p, const int *e,
+                      int ax, int ay)
+{
+  while (p < e) {
+    int n;
+    switch (p[0]) {
+    case 2:
+    case 8:
+      n = 1;
+      break;
+    case 6:
+      n = 3;
+      break;
+    case 5:
+      n = 0;
+      break;
+    default:
+      /* The end, or something we can't translate */
+      while (p < e)
+        push(ds, b, *p++);
+      return;
+    }
+    push(ds, b, *p++);
+    while (n-- > 0) {
+      push(ds, b, *p++ - ax);
+      push(ds, b, *p++ - ay);
+    }
+  }
+}
+
+static void push_plain(struct defs *ds, int b, const int *p, const int *e)
+{
+  while (p < e)
+    push(ds, b, *p++);
+}
+
+/* Copy an object, translating coordinates, and leaving out what
+   doesn't affect the output. */
+static void norm_obj(struct defs *ds, int b, const int *d, int ax, int ay)
+{
+  const int *e = d + (d[1] >> 2);
+
+  push(ds, b, d[0]);
+  push(ds, b, d[1]);
+  if (d[0] == 0 || d[0] == 11) {
+    push_plain(ds, b, d + 2, e);
+    return;
+  }
+  push(ds, b, d[2] - ax);
+  push(ds, b, d[3] - ay);
+  push(ds, b, d[4] - ax);
+  push(ds, b, d[5] - ay);
+
+  switch (d[0]) {
+  case 1:
+  case 12: {
+    int off = d[0] == 12 ? 7 : 0;
+    push_plain(ds, b, d + 6, d + 11 + off);
+    push(ds, b, d[11 + off] - ax);
+    push(ds, b, d[12 + off] - ay);
+    push_plain(ds, b, d + 13 + off, e);
+  } break;
+  case 2: {
+    const int *p = def_path_elements(d);
+    push_plain(ds, b, d + 6, p);
+    norm_path(ds, b, p, e, ax, ay);
+  } break;
+  case 6:
+    /* The name is irrelevant. */
+    for (const int *p = d + 9; p < e; p += p[1] >> 2)
+      norm_obj(ds, b, p, ax, ay);
+    break;
+  default:
+    push_plain(ds, b, d + 6, e);
+    break;
+  }
+}
+
+/* Normalize an object into a scratch buffer.  Return false if it
+   can't be a definition. */
+static int normalize(struct defs *ds, int b, int kind, const int *d,
+                     int *ax, int *ay)
+{
+  ds->len[b] = 0;
+  if (kind == DEF_PATH) {
+    const int *p = def_path_elements(d), *e = d + (d[1] >> 2);
+    if ((size_t) (e - p) * 4 < ds->min || p[0] != 2)
+      return false;
+    *ax = p[1];
+    *ay = p[2];
+    norm_path(ds, b, p, e, *ax, *ay);
+  } else {
+    if ((size_t) d[1] < ds->min)
+      return false;
+    *ax = d[2];
+    *ay = d[3];
+    norm_obj(ds, b, d, *ax, *ay);
+  }
+  return true;
+}
+
+static unsigned long hash_buf(int kind, const int *p, size_t n)
+{
+  unsigned long h = 0x811c9dc5ul ^ kind;
+
+  for (size_t i = 0; i < n; i++)
+    h = (h ^ (unsigned) p[i]) * 0x01000193ul;
+  return h;
+}
+
+/* Find the slot for the object in scratch buffer 0.  Slots hold entry
+   numbers plus one. */
+static size_t *def_slot(struct defs *ds, int kind, unsigned long h)
+{
+  size_t mask = ds->nslots - 1;
+  size_t i = h & mask;
+
+  for (; ds->slots[i]; i = (i + 1) & mask) {
+    struct def *df = &ds->ents[ds->slots[i] - 1];
+    int ax, ay;
+    if (df->hash != h || df->kind != kind)
+      continue;
+    normalize(ds, 1, kind, df->obj, &ax, &ay);
+    if (ds->len[0] == ds->len[1] &&
+        !memcmp(ds->buf[0], ds->buf[1], ds->len[0] * sizeof *ds->buf[0]))
+      break;
+  }
+  return &ds->slots[i];
+}
+
+static void def_grow(struct defs *ds)
+{
+  size_t ns = ds->nslots ? ds->nslots * 2 : 64;
+
+  free(ds->slots);
+  ds->slots = calloc(ns, sizeof *ds->slots);
+  if (!ds->slots) nomem();
+  ds->nslots = ns;
+  for (size_t i = 0; i < ds->n; i++) {
+    size_t j = ds->ents[i].hash & (ns - 1);
+    while (ds->slots[j])
+      j = (j + 1) & (ns - 1);
+    ds->slots[j] = i + 1;
+  }
+}
+
+int def_intern(struct defs *ds, int kind, const int *obj)
+{
+  unsigned long h;
+  size_t *slot;
+  int ax, ay;
+
+  if (!normalize(ds, 0, kind, obj, &ax, &ay))
+    return false;
+  h = hash_buf(kind, ds->buf[0], ds->len[0]);
+
+  if ((ds->n + 1) * 2 > ds->nslots)
+    def_grow(ds);
+  slot = def_slot(ds, kind, h);
+  if (*slot) {
+    ds->ents[*slot - 1].uses++;
+    return true;
+  }
+
+  if (ds->n == ds->cap) {
+    size_t nc = ds->cap ? ds->cap * 2 : 32;
+    void *ne = realloc(ds->ents, nc * sizeof *ds->ents);
+    if (!ne) nomem();
+    ds->ents = ne;
+    ds->cap = nc;
+  }
+  ds->ents[ds->n].obj = obj;
+  ds->ents[ds->n].kind = kind;
+  ds->ents[ds->n].ax = ax;
+  ds->ents[ds->n].ay = ay;
+  ds->ents[ds->n].hash = h;
+  ds->ents[ds->n].uses = 1;
+  ds->ents[ds->n].id = 0;
+  *slot = ++ds->n;
+  return false;
+}
+
+struct def *def_find(struct defs *ds, int kind, const int *obj)
+{
+  unsigned long h;
+  size_t *slot;
+  int ax, ay;
+
+  if (ds->nslots == 0 || !normalize(ds, 0, kind, obj, &ax, &ay))
+    return NULL;
+  h = hash_buf(kind, ds->buf[0], ds->len[0]);
+  slot = def_slot(ds, kind, h);
+  return *slot ? &ds->ents[*slot - 1] : NULL;
+}
@@ -0,0 +1,73 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef DEFS_H
+#define DEFS_H
+
+#include <stddef.h>
+
+enum { DEF_PATH, DEF_GROUP };
+
+/* An object that may be written once in <defs>, and referenced with
+   <use> wherever it (or a translated copy) appears.  A path is
+   anchored at its first move, and matched on its elements only, so
+   copies may differ in style.  A group is anchored at the minimum
+   corner of its box, and matched on everything it contains. */
+struct def {
+  const int *obj;
+  int kind, ax, ay;
+  unsigned long hash, uses;
+  unsigned id;
+};
+
+struct defs {
+  struct def *ents;
+  size_t n, cap;
+  size_t *slots;
+  size_t nslots;
+
+  /* Objects smaller than this many bytes are not considered */
+  size_t min;
+
+  /* Scratch space for comparing objects */
+  int *buf[2];
+  size_t len[2], bcap[2];
+
+  unsigned ids;
+};
+
+void defs_init(struct defs *ds, size_t min);
+void defs_free(struct defs *ds);
+
+/* Get the elements of a path object. */
+const int *def_path_elements(const int *d);
+
+/* Count an occurrence of an object, unless it is too small.  Return
+   true if a copy has been seen before. */
+int def_intern(struct defs *ds, int kind, const int *obj);
+
+/* Find the entry an object would be counted under, or NULL. */
+struct def *def_find(struct defs *ds, int kind, const int *obj);
+
+#endif
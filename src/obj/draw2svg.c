@@ -50,7 +50,8 @@ int main(int argc, const char *const *argv)
   int arg;
   int dashargs = false;
 
-  ct.iname = ct.oname = ct.bgcol = NULL;
+  ct.iname = ct.oname = ct.bgcol = ct.tiles = ct.font_dir = NULL;
+  ct.glyph_cache = NULL;
   ct.u = choose_units("in");
   ct.thin = 1;
   ct.topxy = false;
@@ -66,6 +67,29 @@ int main(int argc, const char *const *argv)
   ct.margin.width = ct.margin.height = 0.0;
 
   ct.text_to_path = false;
+  ct.compact = false;
+  ct.stats = false;
+  ct.async = false;
+  ct.precision = -1;
+  ct.rebase = false;
+  ct.stylesheet = false;
+  ct.dedup = false;
+  ct.dedup_min = 96;
+  ct.merge = false;
+  ct.shapes = true;
+  ct.flatten = false;
+  ct.crop = false;
+  ct.lod = 0.0;
+  ct.nlevels = 0;
+  ct.occlude = false;
+  ct.tight = false;
+  ct.tile_zoom = 3;
+  ct.max_path = 0;
+  ct.stroke_fill = false;
+  ct.cap_markers = false;
+  ct.share_glyphs = false;
+  ct.gzip = GZIP_AUTO;
+  ct.gzip_level = 9;
 
   for (arg = 1; arg < argc; arg++) {
     if (dashargs || (argv[arg][0] != '-' && argv[arg][0] != '+')) {
@@ -194,6 +218,24 @@ int main(int argc, const char *const *argv)
         break;
       }
       ++arg;
+    } else if (!strcmp(argv[arg], "--crop")) {
+      char str[4][20];
+
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs x0,y0,x1,y1\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%19[^,],%19[^,],%19[^,],%19s",
+                 str[0], str[1], str[2], str[3]) != 4 ||
+          measure(str[0], &ct.region.x0) || measure(str[1], &ct.region.y0) ||
+          measure(str[2], &ct.region.x1) || measure(str[3], &ct.region.y1)) {
+        fprintf(stderr, "%s: crop not parsed\n", argv[arg + 1]);
+        break;
+      }
+      ct.crop = true;
+      ++arg;
+    } else if (!strcmp(argv[arg], "--no-crop")) {
+      ct.crop = false;
     } else if (!strcmp(argv[arg], "--fit")) {
       char wstr[20], hstr[20];
 
@@ -251,16 +293,189 @@ int main(int argc, const char *const *argv)
       ct.groups = false;
     } else if (!strcmp(argv[arg], "--text-to-path")) {
       ct.text_to_path = true;
+    } else if (!strcmp(argv[arg], "--share-glyphs")) {
+      ct.share_glyphs = true;
+    } else if (!strcmp(argv[arg], "--no-share-glyphs")) {
+      ct.share_glyphs = false;
+    } else if (!strcmp(argv[arg], "--font-dir")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs directory argument\n", argv[arg]);
+        break;
+      }
+      ct.font_dir = argv[++arg];
+    } else if (!strcmp(argv[arg], "--no-font-dir")) {
+      ct.font_dir = NULL;
+    } else if (!strcmp(argv[arg], "--glyph-cache")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs file argument\n", argv[arg]);
+        break;
+      }
+      ct.glyph_cache = argv[++arg];
+    } else if (!strcmp(argv[arg], "--no-glyph-cache")) {
+      ct.glyph_cache = NULL;
+    } else if (!strcmp(argv[arg], "--compact")) {
+      ct.compact = true;
+    } else if (!strcmp(argv[arg], "--pretty")) {
+      ct.compact = false;
+    } else if (!strcmp(argv[arg], "--gzip")) {
+      ct.gzip = GZIP_YES;
+    } else if (!strcmp(argv[arg], "--no-gzip")) {
+      ct.gzip = GZIP_NO;
+    } else if (!strcmp(argv[arg], "--gzip-level")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%d", &ct.gzip_level) != 1 ||
+          ct.gzip_level < 0 || ct.gzip_level > 9) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--async-output")) {
+      ct.async = true;
+    } else if (!strcmp(argv[arg], "--sync-output")) {
+      ct.async = false;
+    } else if (!strcmp(argv[arg], "--precision")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%d", &ct.precision) != 1 ||
+          ct.precision < 0 || ct.precision > 6) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--no-precision")) {
+      ct.precision = -1;
+    } else if (!strcmp(argv[arg], "--rebase")) {
+      ct.rebase = true;
+    } else if (!strcmp(argv[arg], "--no-rebase")) {
+      ct.rebase = false;
+    } else if (!strcmp(argv[arg], "--stylesheet")) {
+      ct.stylesheet = true;
+    } else if (!strcmp(argv[arg], "--inline-styles")) {
+      ct.stylesheet = false;
+    } else if (!strcmp(argv[arg], "--dedup")) {
+      ct.dedup = true;
+    } else if (!strcmp(argv[arg], "--no-dedup")) {
+      ct.dedup = false;
+    } else if (!strcmp(argv[arg], "--dedup-min")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%u", &ct.dedup_min) != 1) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--max-path-elements")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%u", &ct.max_path) != 1) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--no-max-path-elements")) {
+      ct.max_path = 0;
+    } else if (!strcmp(argv[arg], "--merge-paths")) {
+      ct.merge = true;
+    } else if (!strcmp(argv[arg], "--no-merge-paths")) {
+      ct.merge = false;
+    } else if (!strcmp(argv[arg], "--shapes")) {
+      ct.shapes = true;
+    } else if (!strcmp(argv[arg], "--no-shapes")) {
+      ct.shapes = false;
+    } else if (!strcmp(argv[arg], "--stroke-to-fill")) {
+      ct.stroke_fill = true;
+    } else if (!strcmp(argv[arg], "--no-stroke-to-fill")) {
+      ct.stroke_fill = false;
+    } else if (!strcmp(argv[arg], "--cap-markers")) {
+      ct.cap_markers = true;
+    } else if (!strcmp(argv[arg], "--no-cap-markers")) {
+      ct.cap_markers = false;
+    } else if (!strcmp(argv[arg], "--flatten-groups")) {
+      ct.flatten = true;
+    } else if (!strcmp(argv[arg], "--no-flatten-groups")) {
+      ct.flatten = false;
+    } else if (!strcmp(argv[arg], "--lod")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%lf", &ct.lod) != 1 || !(ct.lod > 0.0)) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--no-lod")) {
+      ct.lod = 0.0;
+      ct.nlevels = 0;
+    } else if (!strcmp(argv[arg], "--lod-levels")) {
+      const char *p;
+      int n, ok = true;
+
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      ct.nlevels = 0;
+      for (p = argv[arg + 1]; ok && *p; p += n) {
+        ok = ct.nlevels < (int) (sizeof ct.levels / sizeof ct.levels[0]) &&
+          sscanf(p, "%u%n", &ct.levels[ct.nlevels], &n) == 1 &&
+          ct.levels[ct.nlevels] > 0 &&
+          (p[n] == '\0' || (p[n] == ',' && p[++n] != '\0'));
+        ct.nlevels++;
+      }
+      if (!ok || ct.nlevels == 0) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--tiles")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs directory argument\n", argv[arg]);
+        break;
+      }
+      ct.tiles = argv[++arg];
+    } else if (!strcmp(argv[arg], "--tile-zoom")) {
+      if (arg + 2 > argc) {
+        fprintf(stderr, "%s: needs argument\n", argv[arg]);
+        break;
+      }
+      if (sscanf(argv[arg + 1], "%d", &ct.tile_zoom) != 1 ||
+          ct.tile_zoom < 0 || ct.tile_zoom > 16) {
+        fprintf(stderr, "%s: invalid\n", argv[arg + 1]);
+        break;
+      }
+      arg++;
+    } else if (!strcmp(argv[arg], "--tight-bbox")) {
+      ct.tight = true;
+    } else if (!strcmp(argv[arg], "--no-tight-bbox")) {
+      ct.tight = false;
+    } else if (!strcmp(argv[arg], "--cull-hidden")) {
+      ct.occlude = true;
+    } else if (!strcmp(argv[arg], "--no-cull-hidden")) {
+      ct.occlude = false;
+    } else if (!strcmp(argv[arg], "--stats")) {
+      ct.stats = true;
     } else {
       fprintf(stderr, "%s: unrecognised option\n", argv[arg]);
       break;
     }
   }
 
-  if (arg < argc || !ct.iname || !ct.oname) {
+  if (arg < argc || !ct.iname || (!ct.oname && !ct.tiles)) {
     fprintf(stderr, "Draw-to-SVG converter (back end) %s (%s)\n",
             linkversion, linkdate);
     fprintf(stderr, "usage: %s [options] [--] infile outfile\n", argv[0]);
+    fprintf(stderr, "       %s --tiles dir [options] [--] infile\n",
+            argv[0]);
     fprintf(stderr, "\t--help  display this text\n");
     fprintf(stderr, "\t--thin number[unit]\n\t\twidth of thin lines\n");
     fprintf(stderr, "\t--units/-u unit\n\t\tselect units\n");
@@ -275,10 +490,64 @@ int main(int argc, const char *const *argv)
     fprintf(stderr, "\t+bg      clear background colour\n");
     fprintf(stderr, "\t--text-to-path\n"
             "\t\tconvert text to paths (else assume Latin-1)\n");
+    fprintf(stderr, "\t--share-glyphs\n\t--no-share-glyphs\n"
+            "\t\tdefine each character's path once (default: no)\n");
+    fprintf(stderr, "\t--font-dir dir\n\t--no-font-dir\n"
+            "\t\tread outline fonts from dir, not the font manager"
+            " (default: none)\n");
+    fprintf(stderr, "\t--glyph-cache file\n\t--no-glyph-cache\n"
+            "\t\tkeep shared characters' paths in file for later runs"
+            " (default: none)\n");
+    fprintf(stderr, "\t--compact\n"
+            "\t\tminimize output (no indentation or DOCTYPE)\n");
+    fprintf(stderr, "\t--pretty\n\t\tindent and wrap output (default)\n");
+    fprintf(stderr, "\t--gzip\n\t--no-gzip\n"
+            "\t\tcompress output (default: if named .svgz)\n");
+    fprintf(stderr, "\t--gzip-level 0-9\n"
+            "\t\tset compression level (default: 9)\n");
+    fprintf(stderr, "\t--async-output\n\t--sync-output\n"
+            "\t\twrite output on a background thread (default: sync)\n");
+    fprintf(stderr, "\t--precision 0-6\n\t--no-precision\n"
+            "\t\tround coordinates to 10^-n units (default: none)\n");
+    fprintf(stderr, "\t--rebase\n\t--no-rebase\n"
+            "\t\tmove viewbox origin to 0,0 (default: no)\n");
+    fprintf(stderr, "\t--stylesheet\n\t--inline-styles\n"
+            "\t\tput repeated styles in a stylesheet (default: inline)\n");
+    fprintf(stderr, "\t--dedup\n\t--no-dedup\n"
+            "\t\tdefine repeated paths and groups once (default: no)\n");
+    fprintf(stderr, "\t--dedup-min bytes\n"
+            "\t\tignore smaller drawfile objects (default: 96)\n");
+    fprintf(stderr, "\t--max-path-elements n\n\t--no-max-path-elements\n"
+            "\t\tsplit longer paths between subpaths (default: none)\n");
+    fprintf(stderr, "\t--merge-paths\n\t--no-merge-paths\n"
+            "\t\tmerge neighbouring paths of the same style (default: no)\n");
+    fprintf(stderr, "\t--shapes\n\t--no-shapes\n"
+            "\t\twrite simple paths as rect, circle, etc (default: yes)\n");
+    fprintf(stderr, "\t--stroke-to-fill\n\t--no-stroke-to-fill\n"
+            "\t\twrite outlines as filled areas (default: no)\n");
+    fprintf(stderr, "\t--cap-markers\n\t--no-cap-markers\n"
+            "\t\tdraw separate caps as markers where they fit (default: no)\n");
+    fprintf(stderr, "\t--flatten-groups\n\t--no-flatten-groups\n"
+            "\t\tleave out trivial groups, and share styles (default: no)\n");
+    fprintf(stderr, "\t--lod pixels\n\t--no-lod\n"
+            "\t\tskip detail below a pixel per unit (default: none)\n");
+    fprintf(stderr, "\t--lod-levels n[,n...]\n"
+            "\t\twrite a variant per level, at 1/n of the resolution\n");
+    fprintf(stderr, "\t--cull-hidden\n\t--no-cull-hidden\n"
+            "\t\tskip objects under later opaque rectangles (default: no)\n");
+    fprintf(stderr, "\t--stats  report statistics\n");
     fprintf(stderr, "\t--scale x[,y]\n\t\tset scale factors\n");
     fprintf(stderr, "\t--no-scale\n\t--no-fit\n\t\tremove scale/fit\n");
     fprintf(stderr, "\t--margin width[,height]\n\t\tset margin\n");
     fprintf(stderr, "\t--no-margin\n\t\tremove margin\n");
+    fprintf(stderr, "\t--crop x0,y0,x1,y1\n\t--no-crop\n"
+            "\t\tconvert only a region (default: whole drawing)\n");
+    fprintf(stderr, "\t--tiles dir\n"
+            "\t\twrite a pyramid of tiles, as dir.z.x.y (default: none)\n");
+    fprintf(stderr, "\t--tile-zoom 0-16\n"
+            "\t\tset the deepest level of tiles (default: 3)\n");
+    fprintf(stderr, "\t--tight-bbox\n\t--no-tight-bbox\n"
+            "\t\tmeasure the drawing, not its header (default: header)\n");
     fprintf(stderr, "Aspect-ratio options:\n");
     fprintf(stderr, "\t--meet   show all of image and preserve AR (default)\n");
     fprintf(stderr, "\t--slice  fill viewbox and preserve AR\n");
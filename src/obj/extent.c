@@ -0,0 +1,319 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <math.h>
+
+#include "context.h"
+#include "extent.h"
+
+/* The default stroke-miterlimit, beyond which SVG bevels a join */
+#define MITRE_LIMIT 4.0
+
+void extent_init(struct extent *x)
+{
+  x->x0 = x->y0 = x->x1 = x->y1 = 0.0;
+  x->empty = true;
+  x->n = 0;
+}
+
+void extent_box(struct extent *x, double x0, double y0,
+                double x1, double y1)
+{
+  if (x->empty) {
+    x->x0 = x0, x->y0 = y0, x->x1 = x1, x->y1 = y1;
+    x->empty = false;
+    return;
+  }
+  if (x0 < x->x0) x->x0 = x0;
+  if (y0 < x->y0) x->y0 = y0;
+  if (x1 > x->x1) x->x1 = x1;
+  if (y1 > x->y1) x->y1 = y1;
+}
+
+void extent_point(struct extent *x, double px, double py)
+{
+  extent_box(x, px, py, px, py);
+}
+
+/* Evaluate a Bezier at t, clamped to [0, 1].  NaN fails the first
+   test, and becomes 0. */
+static inline double curve_at(double t, double p0, double p1,
+                              double p2, double p3)
+{
+  double u = t > 0.0 ? t : 0.0;
+  double m;
+
+  u = u < 1.0 ? u : 1.0;
+  m = 1.0 - u;
+  return m * m * m * p0 + 3.0 * m * u * (m * p1 + u * p2) + u * u * u * p3;
+}
+
+/* Find the range of one coordinate of each of 'n' Beziers, widened by
+   its padding.  The derivative divided by 3 is a*t^2 + b*t + c, whose
+   roots are found in a form that is stable when 'a' is small, and
+   clamped to [0, 1].  Every t in that range gives a point on the
+   curve, so a complex or spurious root does no harm, and every lane
+   does the same work without branching, which lets the compiler use
+   vector instructions. */
+static void curve_range(size_t n, const double *restrict p0,
+                        const double *restrict p1,
+                        const double *restrict p2,
+                        const double *restrict p3,
+                        const double *restrict pad,
+                        double *restrict lo, double *restrict hi)
+{
+  for (size_t i = 0; i < n; i++) {
+    double a = p3[i] - p0[i] + 3.0 * (p1[i] - p2[i]);
+    double b = 2.0 * (p0[i] - 2.0 * p1[i] + p2[i]);
+    double c = p1[i] - p0[i];
+    double disc = b * b - 4.0 * a * c;
+    double q = -0.5 * (b + copysign(sqrt(disc > 0.0 ? disc : 0.0), b));
+    double v0 = curve_at(q / a, p0[i], p1[i], p2[i], p3[i]);
+    double v1 = curve_at(c / q, p0[i], p1[i], p2[i], p3[i]);
+    double l = p0[i] < p3[i] ? p0[i] : p3[i];
+    double h = p0[i] < p3[i] ? p3[i] : p0[i];
+
+    l = v0 < l ? v0 : l;
+    l = v1 < l ? v1 : l;
+    h = v0 > h ? v0 : h;
+    h = v1 > h ? v1 : h;
+    lo[i] = l - pad[i];
+    hi[i] = h + pad[i];
+  }
+}
+
+void extent_flush(struct extent *x)
+{
+  size_t n = x->n;
+  double x0, y0, x1, y1;
+
+  if (n == 0)
+    return;
+  x->n = 0;
+
+  curve_range(n, x->px[0], x->px[1], x->px[2], x->px[3], x->pad,
+              x->lo, x->hi);
+  x0 = x->lo[0], x1 = x->hi[0];
+  for (size_t i = 1; i < n; i++) {
+    if (x->lo[i] < x0) x0 = x->lo[i];
+    if (x->hi[i] > x1) x1 = x->hi[i];
+  }
+
+  curve_range(n, x->py[0], x->py[1], x->py[2], x->py[3], x->pad,
+              x->lo, x->hi);
+  y0 = x->lo[0], y1 = x->hi[0];
+  for (size_t i = 1; i < n; i++) {
+    if (x->lo[i] < y0) y0 = x->lo[i];
+    if (x->hi[i] > y1) y1 = x->hi[i];
+  }
+
+  extent_box(x, x0, y0, x1, y1);
+}
+
+static void queue(struct extent *x, const double *pt, double pad)
+{
+  size_t i = x->n;
+
+  for (int k = 0; k < 4; k++) {
+    x->px[k][i] = pt[2 * k];
+    x->py[k][i] = pt[2 * k + 1];
+  }
+  x->pad[i] = pad;
+  if (++x->n == EXTENT_BATCH)
+    extent_flush(x);
+}
+
+/* Include the tip of a mitred join at (vx, vy), between segments
+   leaving in direction 'u' and arriving in direction 'w'.  A join
+   sharper than the limit is bevelled, and stays within half the
+   width of the vertex. */
+static void mitre(struct extent *x, double vx, double vy,
+                  const double *u, const double *w, double half)
+{
+  double lu = hypot(u[0], u[1]), lw = hypot(w[0], w[1]);
+  double ux, uy, wx, wy, cosine, ratio, bx, by, lb;
+
+  if (lu == 0.0 || lw == 0.0)
+    return;
+  ux = u[0] / lu, uy = u[1] / lu;
+  wx = w[0] / lw, wy = w[1] / lw;
+  cosine = ux * wx + uy * wy;
+  if (cosine <= -1.0)
+    return;
+  ratio = 1.0 / sqrt((1.0 + cosine) / 2.0);
+  bx = ux - wx, by = uy - wy;
+  lb = hypot(bx, by);
+  if (ratio > MITRE_LIMIT || lb == 0.0)
+    return;
+  extent_point(x, vx + bx / lb * half * ratio, vy + by / lb * half * ratio);
+}
+
+/* Include a cap at (ex, ey), pointing in direction 't'.  Butt and
+   round caps stay within half the width of the end. */
+static void cap(struct extent *x, double ex, double ey, const double *t,
+                int kind, double half, unsigned ctw, unsigned ctl)
+{
+  double l = hypot(t[0], t[1]), tx, ty, nx, ny;
+
+  if (l == 0.0)
+    return;
+  tx = t[0] / l, ty = t[1] / l;
+  nx = -ty, ny = tx;
+  switch (kind) {
+  case 2:
+    extent_point(x, ex + (tx + nx) * half, ey + (ty + ny) * half);
+    extent_point(x, ex + (tx - nx) * half, ey + (ty - ny) * half);
+    break;
+  case 3: {
+    /* Triangles are measured in sixteenths of the line width. */
+    double len = ctl / 8.0 * half, wid = ctw / 8.0 * half;
+    extent_point(x, ex + tx * len, ey + ty * len);
+    extent_point(x, ex + nx * wid, ey + ny * wid);
+    extent_point(x, ex - nx * wid, ey - ny * wid);
+  } break;
+  }
+}
+
+/* The state of a walk along a path */
+struct walk {
+  struct extent *x;
+  double half;
+  int join, scap, ecap;
+  unsigned ctw, ctl;
+
+  /* The start of the subpath, and the current point */
+  double sx, sy, cx, cy;
+
+  /* Directions leaving the start, and arriving at the current point,
+     if there have been any segments */
+  double first[2], last[2];
+  int segs;
+};
+
+static void segment(struct walk *wk, const double *pt)
+{
+  double t0[2], t1[2];
+
+  /* Find the directions at each end, skipping coincident points. */
+  for (int k = 1; k < 4; k++) {
+    t0[0] = pt[2 * k] - pt[0], t0[1] = pt[2 * k + 1] - pt[1];
+    if (t0[0] != 0.0 || t0[1] != 0.0)
+      break;
+  }
+  for (int k = 2; k >= 0; k--) {
+    t1[0] = pt[6] - pt[2 * k], t1[1] = pt[7] - pt[2 * k + 1];
+    if (t1[0] != 0.0 || t1[1] != 0.0)
+      break;
+  }
+
+  if (wk->half > 0.0) {
+    if (wk->segs == 0) {
+      wk->first[0] = t0[0], wk->first[1] = t0[1];
+    } else if (wk->join == 0) {
+      mitre(wk->x, pt[0], pt[1], wk->last, t0, wk->half);
+    }
+  }
+  wk->last[0] = t1[0], wk->last[1] = t1[1];
+  wk->segs++;
+  wk->cx = pt[6], wk->cy = pt[7];
+  queue(wk->x, pt, wk->half);
+}
+
+/* Cap the ends of an open subpath. */
+static void end_open(struct walk *wk)
+{
+  double back[2];
+
+  if (wk->half <= 0.0 || wk->segs == 0)
+    return;
+  back[0] = -wk->first[0], back[1] = -wk->first[1];
+  cap(wk->x, wk->sx, wk->sy, back, wk->scap, wk->half, wk->ctw, wk->ctl);
+  cap(wk->x, wk->cx, wk->cy, wk->last, wk->ecap, wk->half,
+      wk->ctw, wk->ctl);
+}
+
+void extent_path(struct extent *x, const int *d, double thin)
+{
+  const int *p = d + 10 + ((d[9] >> 7 & 1) ? 2 + d[11] : 0);
+  const int *e = d + (d[1] >> 2);
+  struct walk wk;
+  double pt[8];
+
+  if ((~d[6] & 0xff) == 0 && (~d[7] & 0xff) == 0)
+    return;
+
+  wk.x = x;
+  wk.half = (~d[7] & 0xff) == 0 ? 0.0 : (d[8] ? d[8] : thin) / 2.0;
+  wk.join = d[9] & 3;
+  wk.ecap = (d[9] >> 2) & 3;
+  wk.scap = (d[9] >> 4) & 3;
+  wk.ctw = (d[9] >> 16) & 0xff;
+  wk.ctl = (d[9] >> 24) & 0xff;
+  wk.sx = wk.sy = wk.cx = wk.cy = 0.0;
+  wk.segs = 0;
+
+  while (p < e && p[0] != 0) {
+    pt[0] = wk.cx, pt[1] = wk.cy;
+    switch (p[0]) {
+    case 2:
+      end_open(&wk);
+      wk.sx = wk.cx = p[1];
+      wk.sy = wk.cy = p[2];
+      wk.segs = 0;
+      p += 3;
+      break;
+    case 8:
+      pt[2] = pt[0], pt[3] = pt[1];
+      pt[4] = pt[6] = p[1];
+      pt[5] = pt[7] = p[2];
+      segment(&wk, pt);
+      p += 3;
+      break;
+    case 6:
+      for (int k = 0; k < 6; k++)
+        pt[2 + k] = p[1 + k];
+      segment(&wk, pt);
+      p += 7;
+      break;
+    case 5:
+      /* Draw the closing line, and join it to the start. */
+      if (wk.segs > 0 && (wk.cx != wk.sx || wk.cy != wk.sy)) {
+        pt[2] = pt[0], pt[3] = pt[1];
+        pt[4] = pt[6] = wk.sx;
+        pt[5] = pt[7] = wk.sy;
+        segment(&wk, pt);
+      }
+      if (wk.segs > 0 && wk.half > 0.0 && wk.join == 0)
+        mitre(x, wk.sx, wk.sy, wk.last, wk.first, wk.half);
+      wk.segs = 0;
+      p += 1;
+      break;
+    default:
+      /* Something we can't follow */
+      end_open(&wk);
+      return;
+    }
+  }
+  end_open(&wk);
+}
@@ -0,0 +1,61 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include <stddef.h>
+
+/* Segments measured together */
+#define EXTENT_BATCH 256
+
+/* The extent of what has been measured so far, in draw units.
+   Segments are queued as cubic Beziers, lines having control points
+   at their ends, and measured a batch at a time.  Each coordinate is
+   kept in its own array, so that the same arithmetic is applied to
+   every lane. */
+struct extent {
+  double x0, y0, x1, y1;
+  int empty;
+
+  size_t n;
+  double px[4][EXTENT_BATCH], py[4][EXTENT_BATCH], pad[EXTENT_BATCH];
+  double lo[EXTENT_BATCH], hi[EXTENT_BATCH];
+};
+
+void extent_init(struct extent *x);
+
+/* Include a box, or a point. */
+void extent_box(struct extent *x, double x0, double y0,
+                double x1, double y1);
+void extent_point(struct extent *x, double px, double py);
+
+/* Include what a path object paints, including its outline, joins
+   and caps.  Thin outlines are 'thin' draw units wide. */
+void extent_path(struct extent *x, const int *d, double thin);
+
+/* Measure any queued segments.  Call before reading the extent. */
+void extent_flush(struct extent *x);
+
+#endif
@@ -47,6 +47,17 @@ int get_file_type_and_length(const char *s, int *ftp, size_t *st)
   return t;
 }
 
+/* Get the load and execution addresses, which hold the time a typed
+   file was last modified. */
+int get_file_stamp(const char *s, unsigned *stamp)
+{
+  int t;
+
+  _swi(OS_File, _INR(0,1)|_OUT(0)|_OUTR(2,3), 17, s, &t,
+       &stamp[0], &stamp[1]);
+  return t;
+}
+
 int set_file_type(const char *s, int ft)
 {
   _swi(OS_File, _INR(0,2), 18, s, ft);
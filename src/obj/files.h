@@ -28,6 +28,7 @@
 #include <stddef.h>
 
 int get_file_type_and_length(const char *s, int *ftp, size_t *st);
+int get_file_stamp(const char *s, unsigned *stamp);
 int set_file_type(const char *s, int ft);
 int load_file(const char *s, void *b);
 
@@ -0,0 +1,176 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fmt.h"
+
+#define D10(d) d "0" d "1" d "2" d "3" d "4" d "5" d "6" d "7" d "8" d "9"
+
+/* Pairs of decimal digits, "00" to "99" */
+static const char dec2[200] =
+  D10("0") D10("1") D10("2") D10("3") D10("4")
+  D10("5") D10("6") D10("7") D10("8") D10("9");
+
+#define H16(h) \
+  h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" \
+  h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+
+/* Pairs of hex digits for each of the 256 byte values */
+static const char hex2[512] =
+  H16("0") H16("1") H16("2") H16("3") H16("4") H16("5") H16("6") H16("7")
+  H16("8") H16("9") H16("A") H16("B") H16("C") H16("D") H16("E") H16("F");
+
+static const double pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+  1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+static int ndigits(unsigned long v)
+{
+  int n = 1;
+
+  for (;;) {
+    if (v < 10) return n;
+    if (v < 100) return n + 1;
+    if (v < 1000) return n + 2;
+    if (v < 10000) return n + 3;
+    v /= 10000;
+    n += 4;
+  }
+}
+
+/* Write exactly 'n' digits of 'v', zero-padded on the left. */
+static char *put_digits(char *p, unsigned long v, int n)
+{
+  char *q = p + n;
+
+  while (q - p >= 2) {
+    q -= 2;
+    memcpy(q, dec2 + v % 100 * 2, 2);
+    v /= 100;
+  }
+  if (q > p)
+    *--q = '0' + v % 10;
+  return p + n;
+}
+
+char *fmt_int(char *p, long v)
+{
+  unsigned long u = v;
+
+  if (v < 0) {
+    *p++ = '-';
+    u = -u;
+  }
+  return put_digits(p, u, ndigits(u));
+}
+
+char *fmt_double(char *p, double v)
+{
+  double a = fabs(v);
+  int prec = 15;
+
+  if (a == 0.0) {
+    *p++ = '0';
+    return p;
+  }
+
+  if (a < 1e15) {
+    /* Find the fewest decimal places that reproduce the value.  The
+       candidate is read back by dividing two exactly representable
+       numbers, which rounds just as strtod() would. */
+    for (size_t k = 0; k < sizeof pow10 / sizeof pow10[0]; k++) {
+      double s = a * pow10[k], m;
+      if (s >= 9e15) {
+        /* Every candidate of up to 15 digits has been tried. */
+        prec = 16;
+        break;
+      }
+      m = floor(s + 0.5);
+      if (m / pow10[k] == a) {
+        /* Split the mantissa to keep the digit generation in native
+           integers. */
+        double hi = floor(m / 1e8);
+        unsigned long lo = (unsigned long) (m - hi * 1e8);
+        char dig[20], *dp = dig;
+        int nd;
+
+        if (hi > 0.0) {
+          dp = put_digits(dp, (unsigned long) hi,
+                          ndigits((unsigned long) hi));
+          dp = put_digits(dp, lo, 8);
+        } else {
+          dp = put_digits(dp, lo, ndigits(lo));
+        }
+        nd = dp - dig;
+
+        if (v < 0.0)
+          *p++ = '-';
+        if (nd > (int) k) {
+          memcpy(p, dig, nd - k);
+          p += nd - k;
+          if (k > 0) {
+            *p++ = '.';
+            memcpy(p, dig + nd - k, k);
+            p += k;
+          }
+        } else {
+          *p++ = '0';
+          *p++ = '.';
+          memset(p, '0', k - nd);
+          p += k - nd;
+          memcpy(p, dig, nd);
+          p += nd;
+        }
+        return p;
+      }
+    }
+  }
+
+  /* Too big, too small or too precise for the quick method */
+  {
+    char tmp[FMT_DBL_MAX];
+    int n = 0;
+    for (; prec <= 17; prec++) {
+      n = snprintf(tmp, sizeof tmp, "%.*g", prec, v);
+      if (strtod(tmp, NULL) == v)
+        break;
+    }
+    memcpy(p, tmp, n);
+    return p + n;
+  }
+}
+
+char *fmt_colour(char *p, unsigned long c)
+{
+  *p++ = '#';
+  memcpy(p, hex2 + (c >> 8 & 0xff) * 2, 2);
+  memcpy(p + 2, hex2 + (c >> 16 & 0xff) * 2, 2);
+  memcpy(p + 4, hex2 + (c >> 24 & 0xff) * 2, 2);
+  return p + 6;
+}
@@ -0,0 +1,45 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef FMT_H
+#define FMT_H
+
+/* Each of these writes a number at 'p' without a terminator, and
+   returns the position just after it.  The buffer must have room for
+   the corresponding FMT_*_MAX characters. */
+
+#define FMT_INT_MAX 21
+#define FMT_DBL_MAX 32
+#define FMT_COL_MAX 7
+
+/* Decimal integer */
+char *fmt_int(char *p, long v);
+
+/* The shortest decimal that reads back as exactly 'v' */
+char *fmt_double(char *p, double v);
+
+/* #RRGGBB from a drawfile colour word (&BBGGRR00) */
+char *fmt_colour(char *p, unsigned long c);
+
+#endif
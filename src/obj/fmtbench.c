@@ -0,0 +1,145 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+/* Time the number formatting used for path data and colours against
+   the printf forms it replaced.  Reals are timed both as the short
+   decimals that coordinates rounded by --precision give, and as
+   arbitrary values needing up to 17 digits.  An optional argument
+   gives the number of values formatted by each. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fmt.h"
+
+#define NVALS 4096
+
+static int ivals[NVALS];
+static double svals[NVALS], dvals[NVALS];
+static unsigned long cvals[NVALS];
+
+/* Totals of the lengths written, so that no work can be skipped */
+static unsigned long sink;
+
+/* Produce the same values on every run. */
+static unsigned long next(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245ul + 12345ul) & 0x7ffffffful;
+  return *seed;
+}
+
+static void make_values(void)
+{
+  unsigned long seed = 1;
+
+  for (int i = 0; i < NVALS; i++) {
+    /* Coordinates in draw units, mostly six or seven digits */
+    ivals[i] = (int) (next(&seed) % 4000000) - 500000;
+    /* The same, to two decimal places */
+    svals[i] = ivals[i] / 100.0;
+    /* Cap geometry and widths, with fractions */
+    dvals[i] = ((double) next(&seed) - 0x40000000) / 1024.0;
+    cvals[i] = next(&seed) << 8 & 0xffffff00ul;
+  }
+}
+
+static double seconds(clock_t start)
+{
+  return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void report(const char *what, double ours, double theirs)
+{
+  printf("%-8s %9.3fs %9.3fs %7.2fx\n", what, ours, theirs,
+         ours > 0.0 ? theirs / ours : 0.0);
+}
+
+/* %g loses precision, so round-tripping needs %.17g, but both are
+   timed. */
+static void time_reals(const char *what, const double *vals, long n)
+{
+  char buf[64];
+  double ours, theirs;
+  clock_t start;
+
+  start = clock();
+  for (long i = 0; i < n; i++)
+    sink += fmt_double(buf, vals[i % NVALS]) - buf;
+  ours = seconds(start);
+  start = clock();
+  for (long i = 0; i < n; i++)
+    sink += sprintf(buf, "%.17g", vals[i % NVALS]);
+  theirs = seconds(start);
+  report(what, ours, theirs);
+  start = clock();
+  for (long i = 0; i < n; i++)
+    sink += sprintf(buf, "%g", vals[i % NVALS]);
+  report("(%g)", ours, seconds(start));
+}
+
+int main(int argc, char **argv)
+{
+  char buf[64];
+  long n = argc > 1 ? atol(argv[1]) : 10000000l;
+  double ours, theirs;
+  clock_t start;
+
+  if (n <= 0) {
+    fprintf(stderr, "usage: %s [count]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  make_values();
+  printf("%-8s %10s %10s %8s\n", "", "fmt", "printf", "speedup");
+
+  start = clock();
+  for (long i = 0; i < n; i++)
+    sink += fmt_int(buf, ivals[i % NVALS]) - buf;
+  ours = seconds(start);
+  start = clock();
+  for (long i = 0; i < n; i++)
+    sink += sprintf(buf, "%d", ivals[i % NVALS]);
+  theirs = seconds(start);
+  report("int", ours, theirs);
+
+  time_reals("short", svals, n);
+  time_reals("double", dvals, n);
+
+  start = clock();
+  for (long i = 0; i < n; i++)
+    sink += fmt_colour(buf, cvals[i % NVALS]) - buf;
+  ours = seconds(start);
+  start = clock();
+  for (long i = 0; i < n; i++) {
+    unsigned long c = cvals[i % NVALS];
+    sink += sprintf(buf, "#%02X%02X%02X", (unsigned) (c >> 8 & 0xff),
+                    (unsigned) (c >> 16 & 0xff), (unsigned) (c >> 24 & 0xff));
+  }
+  theirs = seconds(start);
+  report("colour", ours, theirs);
+
+  fprintf(stderr, "(%lu characters)\n", sink);
+  return EXIT_SUCCESS;
+}
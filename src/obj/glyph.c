@@ -0,0 +1,527 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "glyph.h"
+#include "nomem.h"
+
+void glyphs_init(struct glyphs *gs)
+{
+  gs->fonts = NULL;
+  gs->nfonts = gs->fcap = 0;
+  gs->ents = NULL;
+  gs->n = gs->cap = 0;
+  gs->slots = NULL;
+  gs->nslots = 0;
+  gs->ids = 0;
+  gs->file.data = NULL;
+  gs->file.len = 0;
+  gs->file.slots = NULL;
+  gs->file.nslots = 0;
+  gs->loaded = 0;
+}
+
+static void file_free(struct glyph_file *gf)
+{
+  free(gf->data);
+  free(gf->slots);
+}
+
+void glyphs_free(struct glyphs *gs)
+{
+  for (size_t i = 0; i < gs->n; i++)
+    free(gs->ents[i].obj);
+  free(gs->ents);
+  free(gs->slots);
+  free(gs->fonts);
+  file_free(&gs->file);
+}
+
+/* A drawing uses few fonts, so a list is enough. */
+struct font_entry *glyph_font_find(struct glyphs *gs, const char *name,
+                                   int xsize, int ysize)
+{
+  for (size_t i = 0; i < gs->nfonts; i++) {
+    struct font_entry *fe = &gs->fonts[i];
+    if (fe->xsize == xsize && fe->ysize == ysize && !strcmp(fe->name, name))
+      return fe;
+  }
+  return NULL;
+}
+
+struct font_entry *glyph_font_add(struct glyphs *gs, const char *name,
+                                  int xsize, int ysize, int handle)
+{
+  struct font_entry *fe;
+
+  if (gs->nfonts == gs->fcap) {
+    size_t nc = gs->fcap ? gs->fcap * 2 : 8;
+    void *nf = realloc(gs->fonts, nc * sizeof *gs->fonts);
+    if (!nf) nomem();
+    gs->fonts = nf;
+    gs->fcap = nc;
+  }
+  fe = &gs->fonts[gs->nfonts++];
+  fe->name = name;
+  fe->xsize = xsize;
+  fe->ysize = ysize;
+  fe->handle = handle;
+  fe->outline = NULL;
+  fe->xscale = fe->yscale = 1.0;
+  fe->id[0] = fe->id[1] = 0;
+  fe->keyed = 0;
+  return fe;
+}
+
+static unsigned long mix(unsigned long h, unsigned long v)
+{
+  return (h ^ v) * 0x01000193ul;
+}
+
+static unsigned long glyph_hash(int handle, int ch, const int *mat)
+{
+  unsigned long h = mix(mix(0x811c9dc5ul, handle), ch);
+
+  for (int i = 0; i < 4; i++)
+    h = mix(h, mat[i]);
+  return h;
+}
+
+/* Find the slot holding a glyph, or the empty slot where it should
+   go.  Slots hold entry numbers plus one. */
+static size_t *glyph_slot(const struct glyphs *gs, unsigned long hash,
+                          int handle, int ch, const int *mat)
+{
+  size_t mask = gs->nslots - 1;
+  size_t i = hash & mask;
+
+  for (; gs->slots[i]; i = (i + 1) & mask) {
+    const struct glyph *g = &gs->ents[gs->slots[i] - 1];
+    if (g->hash == hash && g->handle == handle && g->ch == ch &&
+        !memcmp(g->mat, mat, sizeof g->mat))
+      break;
+  }
+  return &gs->slots[i];
+}
+
+static void glyph_grow(struct glyphs *gs)
+{
+  size_t ns = gs->nslots ? gs->nslots * 2 : 256;
+  size_t *old = gs->slots, on = gs->nslots;
+
+  gs->slots = calloc(ns, sizeof *gs->slots);
+  if (!gs->slots) nomem();
+  gs->nslots = ns;
+  for (size_t i = 0; i < on; i++)
+    if (old[i]) {
+      const struct glyph *g = &gs->ents[old[i] - 1];
+      *glyph_slot(gs, g->hash, g->handle, g->ch, g->mat) = old[i];
+    }
+  free(old);
+}
+
+struct glyph *glyph_find(struct glyphs *gs, int handle, int ch,
+                         const int *mat)
+{
+  size_t *slot;
+
+  if (gs->nslots == 0)
+    return NULL;
+  slot = glyph_slot(gs, glyph_hash(handle, ch, mat), handle, ch, mat);
+  return *slot ? &gs->ents[*slot - 1] : NULL;
+}
+
+struct glyph *glyph_add(struct glyphs *gs, int handle, int ch,
+                        const int *mat, int *obj, const double *adv)
+{
+  unsigned long hash = glyph_hash(handle, ch, mat);
+  struct glyph *g;
+  size_t *slot;
+
+  if ((gs->n + 1) * 2 > gs->nslots)
+    glyph_grow(gs);
+  slot = glyph_slot(gs, hash, handle, ch, mat);
+
+  if (gs->n == gs->cap) {
+    size_t nc = gs->cap ? gs->cap * 2 : 128;
+    void *ne = realloc(gs->ents, nc * sizeof *gs->ents);
+    if (!ne) nomem();
+    gs->ents = ne;
+    gs->cap = nc;
+  }
+  g = &gs->ents[gs->n];
+  g->handle = handle;
+  g->ch = ch;
+  memcpy(g->mat, mat, sizeof g->mat);
+  g->obj = obj;
+  g->adv[0] = adv[0];
+  g->adv[1] = adv[1];
+  g->hash = hash;
+  g->id = obj && obj[0] ? ++gs->ids : 0;
+  g->saved = 0;
+  *slot = ++gs->n;
+  return g;
+}
+
+/* A cache file starts with a header of GCACHE_HDR words: the magic
+   word, the version, the length of the rest in words, and a checksum
+   of it.  Then come records, each of:
+
+     0     length of the record in words
+     1-2   font size
+     3-4   font id
+     5     character
+     6-9   matrix, without translation
+     10-13 advance, as two doubles
+     14    length of the font name in words, then the name
+
+   and then the glyph's path objects, ending with a zero word.  Words
+   are in the host's order, as the file is only a cache. */
+#define GCACHE_MAGIC "D2SG"
+#define GCACHE_VERSION 2u
+#define GCACHE_HDR 4
+#define GCACHE_KEY 9
+#define GCACHE_ADV (1 + GCACHE_KEY)
+#define GCACHE_NAME (GCACHE_ADV + 4)
+
+/* Temporary names tried when saving */
+#define GCACHE_TRIES 16
+
+static unsigned long checksum(const unsigned *p, size_t n)
+{
+  unsigned long h = 0x811c9dc5ul;
+
+  for (size_t i = 0; i < n; i++)
+    h = mix(h, p[i]);
+  return h & 0xfffffffful;
+}
+
+static unsigned long key_hash(const char *name, size_t nlen,
+                              const unsigned *key)
+{
+  unsigned long h = 0x811c9dc5ul;
+
+  for (size_t i = 0; i < nlen; i++)
+    h = mix(h, (unsigned char) name[i]);
+  for (int i = 0; i < GCACHE_KEY; i++)
+    h = mix(h, key[i]);
+  return h;
+}
+
+/* Set out the size, id, character and matrix of a glyph as they are
+   stored. */
+static void make_key(unsigned *key, const struct font_entry *fe,
+                     int ch, const int *mat)
+{
+  key[0] = fe->xsize;
+  key[1] = fe->ysize;
+  key[2] = fe->id[0];
+  key[3] = fe->id[1];
+  key[4] = ch;
+  for (int i = 0; i < 4; i++)
+    key[5 + i] = mat[i];
+}
+
+/* Find the record of a glyph, or return NULL. */
+static const unsigned *file_find(const struct glyph_file *gf,
+                                 const char *name, const unsigned *key)
+{
+  size_t nlen = strlen(name);
+  size_t mask = gf->nslots - 1;
+  size_t i;
+
+  if (gf->nslots == 0)
+    return NULL;
+  for (i = key_hash(name, nlen, key) & mask; gf->slots[i];
+       i = (i + 1) & mask) {
+    const unsigned *r = gf->data + gf->slots[i];
+    if (!memcmp(r + 1, key, GCACHE_KEY * sizeof *key) &&
+        !strncmp((const char *) (r + GCACHE_NAME + 1), name,
+                 r[GCACHE_NAME] * sizeof *r) &&
+        strlen((const char *) (r + GCACHE_NAME + 1)) == nlen)
+      return r;
+  }
+  return NULL;
+}
+
+/* Read a cache file, checking that each record fits and holds
+   well-formed objects, and index its records.  A file that is missing
+   or damaged is treated as empty. */
+static int file_load(struct glyph_file *gf, const char *name)
+{
+  FILE *fp = fopen(name, "rb");
+  unsigned hdr[GCACHE_HDR];
+  size_t n = 0, words;
+  long flen;
+  int rc = -1;
+
+  gf->data = NULL;
+  gf->len = 0;
+  gf->slots = NULL;
+  gf->nslots = 0;
+  if (!fp)
+    return -1;
+  /* The header must give the length the file actually has. */
+  if (fseek(fp, 0, SEEK_END) != 0 || (flen = ftell(fp)) < 0 ||
+      (unsigned long) flen < sizeof hdr ||
+      (flen - sizeof hdr) % sizeof *gf->data != 0 ||
+      fseek(fp, 0, SEEK_SET) != 0 ||
+      fread(hdr, sizeof hdr, 1, fp) != 1 ||
+      memcmp(hdr, GCACHE_MAGIC, 4) || hdr[1] != GCACHE_VERSION)
+    goto done;
+  words = (flen - sizeof hdr) / sizeof *gf->data;
+  if (hdr[2] != words || words > (size_t) -1 / sizeof *gf->data - GCACHE_HDR)
+    goto done;
+  gf->data = malloc((words + GCACHE_HDR) * sizeof *gf->data);
+  if (!gf->data) nomem();
+  memcpy(gf->data, hdr, sizeof hdr);
+  if (fread(gf->data + GCACHE_HDR, sizeof *gf->data, words, fp) != words ||
+      checksum(gf->data + GCACHE_HDR, words) != hdr[3])
+    goto done;
+  gf->len = words + GCACHE_HDR;
+
+  for (size_t p = GCACHE_HDR; p < gf->len; p += gf->data[p]) {
+    const unsigned *r = gf->data + p;
+    size_t rlen = r[0], q;
+
+    if (rlen < GCACHE_NAME + 2 || rlen > gf->len - p ||
+        r[GCACHE_NAME] == 0 || r[GCACHE_NAME] > rlen - GCACHE_NAME - 2 ||
+        ((const char *) (r + GCACHE_NAME + 1 +
+                         r[GCACHE_NAME]))[-1] != '\0')
+      goto done;
+    for (q = GCACHE_NAME + 1 + r[GCACHE_NAME]; q < rlen && r[q];
+         q += r[q + 1] >> 2)
+      if (rlen - q < 2 || r[q + 1] < 40 || (r[q + 1] & 3) ||
+          (r[q + 1] >> 2) > rlen - q - 1)
+        goto done;
+    if (q != rlen - 1)
+      goto done;
+    n++;
+  }
+
+  gf->nslots = 16;
+  while (gf->nslots < n * 2)
+    gf->nslots *= 2;
+  gf->slots = calloc(gf->nslots, sizeof *gf->slots);
+  if (!gf->slots) nomem();
+  for (size_t p = GCACHE_HDR; p < gf->len; p += gf->data[p]) {
+    const unsigned *r = gf->data + p;
+    const char *fname = (const char *) (r + GCACHE_NAME + 1);
+    size_t mask = gf->nslots - 1;
+    size_t i = key_hash(fname, strlen(fname), r + 1) & mask;
+
+    while (gf->slots[i])
+      i = (i + 1) & mask;
+    gf->slots[i] = p;
+  }
+  rc = 0;
+
+ done:
+  fclose(fp);
+  if (rc != 0) {
+    file_free(gf);
+    gf->data = NULL;
+    gf->slots = NULL;
+    gf->len = gf->nslots = 0;
+  }
+  return rc;
+}
+
+int glyph_cache_load(struct glyphs *gs, const char *name)
+{
+  file_free(&gs->file);
+  return file_load(&gs->file, name);
+}
+
+static const struct font_entry *font_of(const struct glyphs *gs,
+                                        int handle)
+{
+  for (size_t i = 0; i < gs->nfonts; i++)
+    if (gs->fonts[i].handle == handle)
+      return &gs->fonts[i];
+  return NULL;
+}
+
+struct glyph *glyph_cache_find(struct glyphs *gs, int handle, int ch,
+                               const int *mat)
+{
+  const struct font_entry *fe = font_of(gs, handle);
+  const unsigned *r, *o;
+  unsigned key[GCACHE_KEY];
+  double adv[2];
+  int *obj = NULL;
+  struct glyph *g;
+  size_t n;
+
+  if (!fe || !fe->keyed)
+    return NULL;
+  make_key(key, fe, ch, mat);
+  r = file_find(&gs->file, fe->name, key);
+  if (!r)
+    return NULL;
+  memcpy(adv, r + GCACHE_ADV, sizeof adv);
+  o = r + GCACHE_NAME + 1 + r[GCACHE_NAME];
+  n = r[0] - (o - r);
+  if (n > 1) {
+    obj = malloc(n * sizeof *obj);
+    if (!obj) nomem();
+    memcpy(obj, o, n * sizeof *obj);
+  }
+  g = glyph_add(gs, handle, ch, mat, obj, adv);
+  g->saved = 1;
+  gs->loaded++;
+  return g;
+}
+
+static size_t obj_len(const int *obj)
+{
+  const int *p = obj;
+
+  if (!obj)
+    return 1;
+  while (*p)
+    p += p[1] >> 2;
+  return p - obj + 1;
+}
+
+/* Write the new glyphs not already in 'old'. */
+static int write_new(FILE *fp, const struct glyphs *gs,
+                     const struct glyph_file *old, unsigned long *sum,
+                     size_t *len)
+{
+  static const int none = 0;
+
+  for (size_t i = 0; i < gs->n; i++) {
+    const struct glyph *g = &gs->ents[i];
+    const struct font_entry *fe;
+    unsigned rec[GCACHE_NAME + 1];
+    size_t nlen, nw, on;
+    char *nbuf;
+
+    if (g->saved || !(fe = font_of(gs, g->handle)) || !fe->keyed)
+      continue;
+    make_key(rec + 1, fe, g->ch, g->mat);
+    if (file_find(old, fe->name, rec + 1))
+      continue;
+    memcpy(rec + GCACHE_ADV, g->adv, sizeof g->adv);
+    nlen = strlen(fe->name) + 1;
+    nw = (nlen + sizeof *rec - 1) / sizeof *rec;
+    on = obj_len(g->obj);
+    rec[0] = GCACHE_NAME + 1 + nw + on;
+    rec[GCACHE_NAME] = nw;
+    nbuf = calloc(nw, sizeof *rec);
+    if (!nbuf) nomem();
+    memcpy(nbuf, fe->name, nlen);
+    if (fwrite(rec, sizeof rec, 1, fp) != 1 ||
+        fwrite(nbuf, sizeof *rec, nw, fp) != nw ||
+        fwrite(g->obj ? g->obj : &none, sizeof *rec, on, fp) != on) {
+      free(nbuf);
+      return -1;
+    }
+    for (size_t k = 0; k < GCACHE_NAME + 1; k++)
+      *sum = mix(*sum, rec[k]);
+    for (size_t k = 0; k < nw; k++) {
+      unsigned w;
+      memcpy(&w, nbuf + k * sizeof w, sizeof w);
+      *sum = mix(*sum, w);
+    }
+    for (size_t k = 0; k < on; k++)
+      *sum = mix(*sum, g->obj ? (unsigned) g->obj[k] : 0u);
+    *len += rec[0];
+    free(nbuf);
+  }
+  return 0;
+}
+
+/* Other conversions may have saved glyphs since the file was read,
+   so the file is read again, and only glyphs it lacks are added.  The
+   new file is written beside the old one, and renamed over it, so
+   that a conversion reading it sees the whole of one or the other.
+   Conversions saving at once may lose each other's glyphs, which are
+   just found again later. */
+int glyph_cache_save(const struct glyphs *gs, const char *name)
+{
+  struct glyph_file old;
+  unsigned hdr[GCACHE_HDR];
+  unsigned long sum = 0x811c9dc5ul;
+  size_t len = 0, i;
+  size_t tlen = strlen(name) + 20;
+  unsigned long base;
+  char *tname;
+  FILE *fp = NULL;
+  int rc = 0;
+
+  for (i = 0; i < gs->n && gs->ents[i].saved; i++)
+    ;
+  if (i == gs->n)
+    return 0;
+
+  /* The temporary file is created only if no other conversion has
+     one of the same name, trying a few names before giving up. */
+  tname = malloc(tlen);
+  if (!tname) nomem();
+  base = (unsigned long) time(NULL) ^ (unsigned long) clock() << 12;
+  for (i = 0; i < GCACHE_TRIES && !fp; i++) {
+    snprintf(tname, tlen, "%s-%lx", name, (base + i) & 0xffffffful);
+    fp = fopen(tname, "wbx");
+  }
+  if (!fp) {
+    free(tname);
+    return -1;
+  }
+  file_load(&old, name);
+  if (old.len > GCACHE_HDR) {
+    len = old.len - GCACHE_HDR;
+    sum = old.data[3];
+  }
+
+  /* The checksum is filled in once the records are written. */
+  memcpy(hdr, GCACHE_MAGIC, 4);
+  hdr[1] = GCACHE_VERSION;
+  hdr[2] = hdr[3] = 0;
+  if (fwrite(hdr, sizeof hdr, 1, fp) != 1 ||
+      (len > 0 && fwrite(old.data + GCACHE_HDR, sizeof *old.data, len, fp)
+       != len) ||
+      write_new(fp, gs, &old, &sum, &len) < 0)
+    rc = -1;
+  hdr[2] = len;
+  hdr[3] = sum & 0xfffffffful;
+  if (rc == 0 && (fseek(fp, 0, SEEK_SET) != 0 ||
+                  fwrite(hdr, sizeof hdr, 1, fp) != 1))
+    rc = -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  file_free(&old);
+
+  if (rc == 0 && rename(tname, name) != 0)
+    rc = -1;
+  if (rc != 0)
+    remove(tname);
+  free(tname);
+  return rc;
+}
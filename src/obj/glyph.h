@@ -0,0 +1,123 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef GLYPH_H
+#define GLYPH_H
+
+#include <stddef.h>
+
+struct ofont;
+
+/* A font looked up for text, by name and size in 1/640 point.  The
+   handle is negative if the font couldn't be found.  Fonts read from
+   a font directory instead of the font manager have their outlines,
+   scaled by 'xscale' and 'yscale' if a stand-in font is used.  'id'
+   tells apart the fonts that may be found under one name, so that
+   saved glyphs are only used for the same font.  Unless 'keyed' is
+   set, the font couldn't be identified, and its glyphs are neither
+   read from nor added to a cache file. */
+struct font_entry {
+  const char *name;
+  int xsize, ysize;
+  int handle;
+  struct ofont *outline;
+  double xscale, yscale;
+  unsigned id[2];
+  int keyed;
+};
+
+/* The outline of a character, as the font manager paints it at the
+   origin under a transformation matrix without its translation: Draw
+   path objects, in draw units, followed by a zero word.  The advance
+   is how far the character moves the pen, in millipoints.  A
+   character that paints nothing has no objects, and is not given an
+   id.  A glyph read from a cache file is not saved again. */
+struct glyph {
+  int handle, ch, mat[4];
+  int *obj;
+  double adv[2];
+  unsigned long hash;
+  unsigned id;
+  int saved;
+};
+
+/* Glyphs saved by earlier conversions, as read from a cache file, and
+   indexed by font, character and matrix.  Slots hold the offsets of
+   records in words, or 0. */
+struct glyph_file {
+  unsigned *data;
+  size_t len;
+  size_t *slots;
+  size_t nslots;
+};
+
+/* Fonts and glyphs used so far in a conversion */
+struct glyphs {
+  struct font_entry *fonts;
+  size_t nfonts, fcap;
+
+  struct glyph *ents;
+  size_t n, cap;
+  size_t *slots;
+  size_t nslots;
+
+  unsigned ids;
+
+  struct glyph_file file;
+  unsigned long loaded;
+};
+
+void glyphs_init(struct glyphs *gs);
+void glyphs_free(struct glyphs *gs);
+
+/* Find a font by name and size, or return NULL. */
+struct font_entry *glyph_font_find(struct glyphs *gs, const char *name,
+                                   int xsize, int ysize);
+
+/* Record the handle found for a font. */
+struct font_entry *glyph_font_add(struct glyphs *gs, const char *name,
+                                  int xsize, int ysize, int handle);
+
+/* Find a character of a font under the first four entries of a
+   matrix, or return NULL. */
+struct glyph *glyph_find(struct glyphs *gs, int handle, int ch,
+                         const int *mat);
+
+/* Add a character, taking ownership of its path objects, which may be
+   NULL. */
+struct glyph *glyph_add(struct glyphs *gs, int handle, int ch,
+                        const int *mat, int *obj, const double *adv);
+
+/* Read the glyphs saved in a cache file.  Return 0 on success. */
+int glyph_cache_load(struct glyphs *gs, const char *name);
+
+/* Add a character saved in the cache file, or return NULL. */
+struct glyph *glyph_cache_find(struct glyphs *gs, int handle, int ch,
+                               const int *mat);
+
+/* Add the glyphs found since the cache file was read to those now in
+   it, and replace it in one step.  Return 0 on success. */
+int glyph_cache_save(const struct glyphs *gs, const char *name);
+
+#endif
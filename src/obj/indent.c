@@ -30,18 +30,113 @@
 #include <string.h>
 
 #include "context.h"
+#include "nomem.h"
+#include "scan.h"
+#include "sink.h"
 
-int findent(FILE *fp, int hm)
+/* Output is flushed, and recorded pretty output laid out, once this
+   much has accumulated. */
+#define OUT_BLOCK (64 * 1024)
+
+static int put_record(struct ws *ws, int pretty, const char *s, size_t n);
+static int put_compact(struct ws *ws, int pretty, const char *s, size_t n);
+static void layout_run(struct ws *ws);
+
+void out_init(struct ws *ws, struct sink *out, int compact)
+{
+  ws->out = out;
+  ws->obuf = ws->fbuf = ws->tbuf = NULL;
+  ws->olen = ws->ocap = ws->fcap = ws->tlen = ws->tcap = 0;
+  ws->spans = NULL;
+  ws->nspans = ws->scap = 0;
+  ws->oerr = false;
+  ws->cpos = -1;
+  ws->put = compact ? &put_compact : &put_record;
+  ws->lastc = '>';
+  ws->gap = false;
+}
+
+static int out_drain(struct ws *ws)
+{
+  if (ws->olen > 0) {
+    if (sink_write(ws->out, ws->obuf, ws->olen) < 0)
+      ws->oerr = true;
+    ws->olen = 0;
+  }
+  return ws->oerr ? -1 : 0;
+}
+
+int out_flush(struct ws *ws)
 {
-  char sp[LINE_WIDTH + 1], *ptr = sp;
-  while (hm > 0 && ptr < sp + (sizeof sp - 1)) {
+  layout_run(ws);
+  return out_drain(ws);
+}
+
+void out_free(struct ws *ws)
+{
+  free(ws->obuf);
+  ws->obuf = NULL;
+  ws->olen = ws->ocap = 0;
+  free(ws->fbuf);
+  ws->fbuf = NULL;
+  ws->fcap = 0;
+  free(ws->tbuf);
+  ws->tbuf = NULL;
+  ws->tlen = ws->tcap = 0;
+  free(ws->spans);
+  ws->spans = NULL;
+  ws->nspans = ws->scap = 0;
+}
+
+/* Ensure there's room for another n bytes, and return where to put
+   them. */
+static char *out_reserve(struct ws *ws, size_t n)
+{
+  if (ws->olen + n > ws->ocap) {
+    size_t nc = ws->ocap ? ws->ocap : OUT_BLOCK;
+    void *nb;
+    while (nc < ws->olen + n)
+      nc *= 2;
+    nb = realloc(ws->obuf, nc);
+    if (!nb) nomem();
+    ws->obuf = nb;
+    ws->ocap = nc;
+  }
+  return ws->obuf + ws->olen;
+}
+
+static void out_commit(struct ws *ws, size_t n)
+{
+  ws->olen += n;
+  if (ws->olen >= OUT_BLOCK)
+    out_drain(ws);
+}
+
+static void out_write(struct ws *ws, const char *s, size_t n)
+{
+  memcpy(out_reserve(ws, n), s, n);
+  out_commit(ws, n);
+}
+
+static void out_char(struct ws *ws, char c)
+{
+  *out_reserve(ws, 1) = c;
+  out_commit(ws, 1);
+}
+
+/* Write hm columns of tabs and spaces, but no more than 'lim'
+   characters. */
+static int out_indent(struct ws *ws, int hm, int lim)
+{
+  char *start = out_reserve(ws, lim), *ptr = start;
+  while (hm > 0 && ptr < start + lim) {
     if (hm >= 8)
       *ptr++ = '\t', hm -= 8;
     else
       *ptr++ = ' ', hm--;
   }
-  *ptr = '\0';
-  return fprintf(fp, "%s", sp);
+  out_commit(ws, ptr - start);
+  return ptr - start;
 }
 
 void indent(struct ws *ws)
@@ -50,9 +145,9 @@ void indent(struct ws *ws)
 
   while (hm > 0) {
     if (hm >= 8)
-      fputc('\t', ws->out), hm -= 8;
+      output_str(ws, false, "\t", 1), hm -= 8;
     else
-      fputc(' ', ws->out), hm--;
+      output_str(ws, false, " ", 1), hm--;
   }
 }
 
@@ -61,79 +156,288 @@ void cindent(struct ws *ws, int *spp, int req)
   if (*spp < req) {
     if (ws->indent >= 36) {
       *spp = LINE_WIDTH - 2;
-      fprintf(ws->out, "\n  ");
+      output_str(ws, false, "\n  ", 3);
     } else {
       *spp = LINE_WIDTH - ws->indent;
-      fputc('\n', ws->out);
+      output_str(ws, false, "\n", 1);
       indent(ws);
     }
   }
 }
 
-int output(struct ws *ws, int pretty, const char *fmt, ...)
+/* Pretty output is produced in two stages.  Each call is first
+   recorded as a span of text, along with the indentation in force,
+   and whether it may be wrapped.  Unwrappable calls with the same
+   indentation are merged.  Then, a block at a time, the spans are
+   laid out to LINE_WIDTH, and written. */
+
+/* Get the column after some text without newlines, honouring tab
+   stops. */
+static int layout_advance(int cpos, const char *s, const char *lim)
 {
-  va_list ap;
-  int rc = 0;
-  const char *ptr;
-  static char line[200];
+  for (;;) {
+    size_t n = scan_span(s, lim - s, "\t");
+    cpos += n;
+    s += n;
+    if (s == lim)
+      return cpos;
+    cpos += 8 - cpos % 8;
+    s++;
+  }
+}
 
-  va_start(ap, fmt);
-  vsprintf(line, fmt, ap);
-  va_end(ap);
+/* Lay out text that may not be wrapped.  Only the ends of lines need
+   attention: indentation is added at the start, and trailing spaces
+   are dropped. */
+static void layout_plain(struct ws *ws, int ind, const char *s, size_t n)
+{
+  const char *ptr = s, *lim = s + n;
+
+  while (ptr < lim) {
+    const char *nl = memchr(ptr, '\n', lim - ptr);
 
-  ptr = line;
-  while (*ptr) {
+    if (ws->cpos < 0) {
+      out_indent(ws, ind, LINE_WIDTH);
+      ws->cpos = ind;
+    }
+    if (nl) {
+      const char *end = nl;
+      while (end > ptr && (end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+      out_write(ws, ptr, end - ptr);
+      out_char(ws, '\n');
+      ws->cpos = -1;
+      ptr = nl + 1;
+    } else {
+      out_write(ws, ptr, lim - ptr);
+      ws->cpos = layout_advance(ws->cpos, ptr, lim);
+      ptr = lim;
+    }
+  }
+}
+
+/* Lay out text word by word, moving a word to a new line if it would
+   pass LINE_WIDTH. */
+static void layout_wrap(struct ws *ws, int ind, const char *s, size_t n)
+{
+  const char *ptr = s, *lim = s + n;
+
+  while (ptr < lim) {
     int npos, opos, mpos;
     const char *start, *nosp;
 
     if (ws->cpos < 0) {
-      rc += findent(ws->out, ws->indent);
-      ws->cpos = ws->indent;
+      out_indent(ws, ind, LINE_WIDTH);
+      ws->cpos = ind;
     }
 
     opos = ws->cpos;
     for (start = ptr;
-         *ptr && (*ptr == ' ' || *ptr == '\t');
+         ptr < lim && (*ptr == ' ' || *ptr == '\t');
          ptr++)
       ws->cpos += (*ptr == '\t' ? 8 - ws->cpos % 8 : 1);
-    if (*ptr == '\n') {
-      putc('\n', ws->out);
-      rc++;
+    if (ptr < lim && *ptr == '\n') {
+      out_char(ws, '\n');
       ws->cpos = -1;
       ptr++;
       continue;
     }
     mpos = ws->cpos;
 
-    for (nosp = ptr; *ptr && !isspace(*ptr); ptr++)
-      ws->cpos++;
+    /* Find the end of the word.  Only control characters and spaces
+       need a closer look. */
+    for (nosp = ptr;; ptr++) {
+      ptr += scan_ctl(ptr, lim - ptr);
+      if (ptr == lim || isspace((unsigned char) *ptr))
+        break;
+    }
+    ws->cpos += ptr - nosp;
 
-    if (pretty && ws->cpos > LINE_WIDTH) {
-      if (opos > 0) putc('\n', ws->out), rc++;
+    if (ws->cpos > LINE_WIDTH) {
+      if (opos > 0) out_char(ws, '\n');
       if (ws->cpos - mpos > LINE_WIDTH) {
         npos = LINE_WIDTH - (ws->cpos - mpos);
         if (npos < 0) npos = 0;
       } else {
-        npos = ws->indent;
+        npos = ind;
       }
       start = nosp;
-      rc += findent(ws->out, npos);
+      out_indent(ws, npos, LINE_WIDTH);
       ws->cpos = npos + (ptr - start);
     }
-    rc += fprintf(ws->out, "%.*s", (int) (ptr - start), start);
+    out_write(ws, start, ptr - start);
   }
-  return rc;
 }
 
-int output_esc(struct ws *ws, unsigned flags, const char *fmt, ...)
+/* Lay out and write everything recorded so far. */
+static void layout_run(struct ws *ws)
+{
+  size_t start = 0;
+
+  for (size_t i = 0; i < ws->nspans; i++) {
+    const struct span *sp = &ws->spans[i];
+    (sp->pretty ? layout_wrap : layout_plain)
+      (ws, sp->indent, ws->tbuf + start, sp->end - start);
+    start = sp->end;
+  }
+  ws->tlen = 0;
+  ws->nspans = 0;
+}
+
+static int put_record(struct ws *ws, int pretty, const char *s, size_t n)
+{
+  struct span *sp = ws->nspans > 0 ? &ws->spans[ws->nspans - 1] : NULL;
+
+  if (n == 0)
+    return 0;
+
+  if (ws->tlen + n > ws->tcap) {
+    size_t nc = ws->tcap ? ws->tcap : OUT_BLOCK;
+    void *nb;
+    while (nc < ws->tlen + n)
+      nc *= 2;
+    nb = realloc(ws->tbuf, nc);
+    if (!nb) nomem();
+    ws->tbuf = nb;
+    ws->tcap = nc;
+  }
+  memcpy(ws->tbuf + ws->tlen, s, n);
+  ws->tlen += n;
+
+  /* Spaces before a newline are dropped, but not if they end a
+     previous call, so such calls can't be merged. */
+  if (!pretty && sp && !sp->pretty && sp->indent == ws->indent &&
+      ws->tbuf[sp->end - 1] != ' ' && ws->tbuf[sp->end - 1] != '\t') {
+    sp->end = ws->tlen;
+  } else {
+    if (ws->nspans == ws->scap) {
+      size_t nc = ws->scap ? ws->scap * 2 : 1024;
+      void *nb = realloc(ws->spans, nc * sizeof *ws->spans);
+      if (!nb) nomem();
+      ws->spans = nb;
+      ws->scap = nc;
+    }
+    sp = &ws->spans[ws->nspans++];
+    sp->end = ws->tlen;
+    sp->indent = ws->indent;
+    sp->pretty = pretty;
+  }
+
+  if (ws->tlen >= OUT_BLOCK)
+    layout_run(ws);
+  return n;
+}
+
+/* Whitespace is dropped after these characters in compact output... */
+static const char compact_after[] = ">;:,(={}";
+
+/* ...and before these. */
+static const char compact_before[] = "</>{}";
+
+/* Write without indentation or line breaks, reducing each run of
+   whitespace to a single space, or to nothing where XML and CSS
+   syntax don't need it. */
+static int put_compact(struct ws *ws, int pretty, const char *s, size_t n)
 {
-  static size_t buflen = 0;
-  static char *buf = NULL;
+  const char *ptr = s, *lim = s + n;
+  char *start = out_reserve(ws, n + 1), *q = start;
+
+  while (ptr < lim) {
+    const char *word = ptr;
+
+    while (ptr < lim && *ptr != ' ' && *ptr != '\t' && *ptr != '\n')
+      ptr++;
+    if (ptr > word) {
+      if (ws->gap && !strchr(compact_before, *word))
+        *q++ = ' ';
+      ws->gap = false;
+      memcpy(q, word, ptr - word);
+      q += ptr - word;
+      ws->lastc = (unsigned char) ptr[-1];
+    }
+
+    if (ptr < lim) {
+      while (ptr < lim && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n'))
+        ptr++;
+      if (!strchr(compact_after, ws->lastc))
+        ws->gap = true;
+    }
+  }
 
+  out_commit(ws, q - start);
+  return q - start;
+}
+
+int output_str(struct ws *ws, int pretty, const char *s, size_t n)
+{
+  return (*ws->put)(ws, pretty, s, n);
+}
+
+/* Write character data.  Compact output leaves it untouched. */
+static int out_text(struct ws *ws, int pretty, const char *s, size_t n)
+{
+  if (ws->put != &put_compact)
+    return put_record(ws, pretty, s, n);
+
+  if (n == 0)
+    return 0;
+  if (ws->gap)
+    out_char(ws, ' ');
+  ws->gap = false;
+  out_write(ws, s, n);
+  ws->lastc = (unsigned char) s[n - 1];
+  return n;
+}
+
+/* Format into the scratch buffer, enlarging it if necessary. */
+static int out_vformat(struct ws *ws, const char *fmt, va_list ap)
+{
+  va_list aq;
+  int rc;
+
+  va_copy(aq, ap);
+  rc = vsnprintf(ws->fbuf, ws->fcap, fmt, aq);
+  va_end(aq);
+  if (rc < 0)
+    return rc;
+
+  if ((size_t) rc >= ws->fcap) {
+    /* The scratch buffer is too small.  Enlarge it, and format
+       again. */
+    size_t nc = rc + 1 + ws->fcap / 2;
+    void *nb = realloc(ws->fbuf, nc);
+    if (!nb) nomem();
+    ws->fbuf = nb;
+    ws->fcap = nc;
+
+    rc = vsnprintf(ws->fbuf, ws->fcap, fmt, ap);
+    if (rc < 0)
+      return rc;
+    assert((size_t) rc < ws->fcap);
+  }
+  return rc;
+}
+
+int output(struct ws *ws, int pretty, const char *fmt, ...)
+{
   va_list ap;
   int rc;
+
+  va_start(ap, fmt);
+  rc = out_vformat(ws, fmt, ap);
+  va_end(ap);
+  if (rc < 0)
+    return rc;
+
+  return output_str(ws, pretty, ws->fbuf, rc);
+}
+
+int output_esc_str(struct ws *ws, unsigned flags, const char *s, size_t n)
+{
+  int rc = 0;
   char special[10] = "";
   int pretty = !!(flags & OUT_PRETTY);
+  const char *pos = s, *end = s + n;
 
   {
     char *p = special;
@@ -150,57 +454,31 @@ int output_esc(struct ws *ws, unsigned flags, const char *fmt, ...)
     *p = '\0';
   }
 
-  va_start(ap, fmt);
-  rc = vsnprintf(buf, buflen, fmt, ap);
-  va_end(ap);
-
-  if (rc < 0)
-    return rc;
-
-  if (!buf || (unsigned) rc >= buflen) {
-    /* There was insufficient space in the current.  Re-allocate it to
-       be big enough. */
-    size_t nbl = rc + 1 + buflen / 2;
-    void *nb = realloc(buf, nbl);
-    if (!nb) return -1;
-    buflen = nbl;
-    buf = nb;
-
-    va_start(ap, fmt);
-    rc = vsnprintf(buf, buflen, fmt, ap);
-    va_end(ap);
-
-    if (rc < 0)
-      return -1;
-
-    assert((unsigned) rc < buflen);
-  }
-
-  rc = 0;
-  for (const char *pos = buf; *pos; pos++) {
+  for (; pos < end; pos++) {
     /* Print out the largest prefix that doesn't need escaping, and
        discard it. */
-    size_t n = strcspn(pos, special);
-    rc += output(ws, pretty, "%.*s", (int) n, pos);
-    pos += n;
-    if (!*pos) break;
+    size_t len = scan_span(pos, end - pos, special);
+    if (len > 0)
+      rc += out_text(ws, pretty, pos, len);
+    pos += len;
+    if (pos == end) break;
 
     /* Escape the current character. */
     switch (*pos) {
     case '&':
-      rc += output(ws, pretty, "&amp;");
+      rc += out_text(ws, pretty, "&amp;", 5);
       break;
     case '<':
-      rc += output(ws, pretty, "&lt;");
+      rc += out_text(ws, pretty, "&lt;", 4);
       break;
     case '>':
-      rc += output(ws, pretty, "&gt;");
+      rc += out_text(ws, pretty, "&gt;", 4);
       break;
     case '"':
-      rc += output(ws, pretty, "&quot;");
+      rc += out_text(ws, pretty, "&quot;", 6);
       break;
     case '\'':
-      rc += output(ws, pretty, "&apos;");
+      rc += out_text(ws, pretty, "&apos;", 6);
       break;
     default:
       assert(false);
@@ -210,3 +488,17 @@ int output_esc(struct ws *ws, unsigned flags, const char *fmt, ...)
 
   return rc;
 }
+
+int output_esc(struct ws *ws, unsigned flags, const char *fmt, ...)
+{
+  va_list ap;
+  int rc;
+
+  va_start(ap, fmt);
+  rc = out_vformat(ws, fmt, ap);
+  va_end(ap);
+  if (rc < 0)
+    return rc;
+
+  return output_esc_str(ws, flags, ws->fbuf, rc);
+}
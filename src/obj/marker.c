@@ -0,0 +1,60 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+
+#include "marker.h"
+#include "nomem.h"
+
+void markers_init(struct markers *ms)
+{
+  ms->ents = NULL;
+  ms->n = ms->cap = 0;
+}
+
+void markers_free(struct markers *ms)
+{
+  free(ms->ents);
+}
+
+/* Drawings use few distinct caps, so a list is enough. */
+unsigned marker_intern(struct markers *ms, const struct marker *m)
+{
+  for (size_t i = 0; i < ms->n; i++) {
+    const struct marker *o = &ms->ents[i];
+    if (o->colour == m->colour && o->cap == m->cap && o->end == m->end &&
+        o->tri_width == m->tri_width && o->tri_length == m->tri_length)
+      return i + 1;
+  }
+
+  if (ms->n == ms->cap) {
+    size_t nc = ms->cap ? ms->cap * 2 : 16;
+    void *ne = realloc(ms->ents, nc * sizeof *ms->ents);
+    if (!ne) nomem();
+    ms->ents = ne;
+    ms->cap = nc;
+  }
+  ms->ents[ms->n] = *m;
+  return ++ms->n;
+}
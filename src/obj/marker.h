@@ -0,0 +1,52 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef MARKER_H
+#define MARKER_H
+
+#include <stddef.h>
+
+/* A cap drawn by a <marker> at one end of a path, in units of the
+   path's stroke width, so that lines of any width share it.  It faces
+   along the path at its end, or back along it at its start.
+   Triangles are measured in sixteenths of the width, and the colour
+   is a drawfile colour word, as the marker is filled with it. */
+struct marker {
+  unsigned long colour;
+  int cap, end;
+  unsigned tri_width, tri_length;
+};
+
+struct markers {
+  struct marker *ents;
+  size_t n, cap;
+};
+
+void markers_init(struct markers *ms);
+void markers_free(struct markers *ms);
+
+/* Get the number of a marker, from 1, adding it if new. */
+unsigned marker_intern(struct markers *ms, const struct marker *m);
+
+#endif
@@ -0,0 +1,125 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+
+#include "context.h"
+#include "nomem.h"
+#include "occlude.h"
+
+void occlusion_init(struct occlusion *oc)
+{
+  oc->occ = NULL;
+  oc->nocc = oc->occap = 0;
+  oc->hidden = NULL;
+  oc->n = oc->cap = 0;
+}
+
+void occlusion_free(struct occlusion *oc)
+{
+  free(oc->occ);
+  free(oc->hidden);
+}
+
+int occluder_covers(const struct occluder *o, const int *box)
+{
+  switch (o->kind) {
+  case OCCLUDER_RECT:
+    return o->box[0] < box[0] && box[2] < o->box[2] &&
+      o->box[1] < box[1] && box[3] < o->box[3];
+  }
+  return false;
+}
+
+int occlusion_covers(const struct occlusion *oc, const int *box)
+{
+  for (size_t i = 0; i < oc->nocc; i++)
+    if (occluder_covers(&oc->occ[i], box))
+      return true;
+  return false;
+}
+
+void occlusion_add(struct occlusion *oc, const struct occluder *o)
+{
+  size_t j = 0;
+
+  /* Everything still to be examined is painted before both, so an
+     occluder within another is of no further use. */
+  if (occlusion_covers(oc, o->box))
+    return;
+  for (size_t i = 0; i < oc->nocc; i++)
+    if (!occluder_covers(o, oc->occ[i].box))
+      oc->occ[j++] = oc->occ[i];
+  oc->nocc = j;
+
+  if (oc->nocc == oc->occap) {
+    size_t nc = oc->occap ? oc->occap * 2 : 16;
+    void *nb = realloc(oc->occ, nc * sizeof *oc->occ);
+    if (!nb) nomem();
+    oc->occ = nb;
+    oc->occap = nc;
+  }
+  oc->occ[oc->nocc++] = *o;
+}
+
+void occlusion_hide(struct occlusion *oc, const int *d)
+{
+  if (oc->n == oc->cap) {
+    size_t nc = oc->cap ? oc->cap * 2 : 64;
+    void *nb = realloc(oc->hidden, nc * sizeof *oc->hidden);
+    if (!nb) nomem();
+    oc->hidden = nb;
+    oc->cap = nc;
+  }
+  oc->hidden[oc->n++] = d;
+}
+
+void occlusion_done(struct occlusion *oc)
+{
+  /* Put the hidden objects in order of position. */
+  for (size_t i = 0, j = oc->n; i + 1 < j; i++, j--) {
+    const int *t = oc->hidden[i];
+    oc->hidden[i] = oc->hidden[j - 1];
+    oc->hidden[j - 1] = t;
+  }
+  free(oc->occ);
+  oc->occ = NULL;
+  oc->nocc = oc->occap = 0;
+}
+
+int occlusion_hidden(const struct occlusion *oc, const int *d)
+{
+  size_t lo = 0, hi = oc->n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (oc->hidden[mid] == d)
+      return true;
+    if (oc->hidden[mid] < d)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return false;
+}
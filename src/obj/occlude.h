@@ -0,0 +1,71 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef OCCLUDE_H
+#define OCCLUDE_H
+
+#include <stddef.h>
+
+enum { OCCLUDER_RECT };
+
+/* An opaque area painted over earlier objects.  Only axis-aligned
+   rectangles are recognised, given by their box; other convex shapes
+   would need their own kind, and a test in occluder_covers(). */
+struct occluder {
+  int kind;
+  int box[4];
+};
+
+/* Objects found to be hidden, and the occluders painted after the
+   object being examined */
+struct occlusion {
+  struct occluder *occ;
+  size_t nocc, occap;
+  const int **hidden;
+  size_t n, cap;
+};
+
+void occlusion_init(struct occlusion *oc);
+void occlusion_free(struct occlusion *oc);
+
+/* Does an occluder cover the interior of a box (x0, y0, x1, y1)? */
+int occluder_covers(const struct occluder *o, const int *box);
+
+/* Is a box covered by any occluder added so far? */
+int occlusion_covers(const struct occlusion *oc, const int *box);
+
+/* Add an occluder, painted before all those added so far, dropping
+   any that it makes redundant. */
+void occlusion_add(struct occlusion *oc, const struct occluder *o);
+
+/* Record an object as hidden.  Objects must be recorded in reverse
+   order of position, and occlusion_done() called before looking them
+   up. */
+void occlusion_hide(struct occlusion *oc, const int *d);
+void occlusion_done(struct occlusion *oc);
+
+/* Was an object recorded as hidden? */
+int occlusion_hidden(const struct occlusion *oc, const int *d);
+
+#endif
@@ -0,0 +1,592 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "nomem.h"
+#include "ofont.h"
+
+#ifndef false
+#define false 0
+#endif
+
+#ifndef true
+#define true 1
+#endif
+
+/* Font names and file names are joined as on the host. */
+#ifdef __riscos
+#define DIR_SEP '.'
+#else
+#define DIR_SEP '/'
+#endif
+
+/* How deeply composite characters may be built of others */
+#define MAX_DEPTH 4
+
+struct kern_pair {
+  unsigned left, right;
+  int dx, dy;
+};
+
+struct ofont {
+  unsigned char *outlines, *metrics;
+  size_t olen, mlen;
+  int version, design;
+
+  /* Where each character's data starts in the Outlines file, or 0 */
+  size_t chars[256];
+
+  /* How far each character moves the pen, in 1/1000 em */
+  int adv[256][2];
+
+  /* Adjustments between pairs of characters, in 1/1000 em, sorted */
+  struct kern_pair *kerns;
+  size_t nkerns;
+};
+
+/* Font files are little-endian. */
+static unsigned get16(const unsigned char *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static int get16s(const unsigned char *p)
+{
+  int v = get16(p);
+  return v >= 0x8000 ? v - 0x10000 : v;
+}
+
+static unsigned long get32(const unsigned char *p)
+{
+  return p[0] | p[1] << 8 | (unsigned long) p[2] << 16 |
+    (unsigned long) p[3] << 24;
+}
+
+/* Load one of a font's files, or return NULL. */
+static unsigned char *load(const char *dir, const char *name,
+                           const char *leaf, size_t *lenp)
+{
+  size_t dl = strlen(dir), nl = strlen(name), ll = strlen(leaf);
+  char *path = malloc(dl + nl + ll + 3);
+  unsigned char *data = NULL;
+  FILE *fp;
+  long len;
+
+  if (!path) nomem();
+  memcpy(path, dir, dl);
+  path[dl] = DIR_SEP;
+  for (size_t i = 0; i < nl; i++)
+    path[dl + 1 + i] = name[i] == '.' ? DIR_SEP : name[i];
+  path[dl + 1 + nl] = DIR_SEP;
+  memcpy(path + dl + nl + 2, leaf, ll + 1);
+
+  fp = fopen(path, "rb");
+  free(path);
+  if (!fp)
+    return NULL;
+  if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 &&
+      fseek(fp, 0, SEEK_SET) == 0) {
+    data = malloc(len);
+    if (!data) nomem();
+    if (fread(data, 1, len, fp) == (size_t) len) {
+      *lenp = len;
+    } else {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(fp);
+  return data;
+}
+
+/* Find where each character's data starts.  Characters come in
+   chunks of 32, each with an index of offsets from the index.  From
+   version 8, the chunks are listed in a table of their own, and each
+   index follows a flags word. */
+static int index_outlines(struct ofont *f)
+{
+  const unsigned char *o = f->outlines;
+  size_t table, nchunks;
+
+  if (f->olen < 52 || memcmp(o, "FONT", 4) || o[4] != 0)
+    return -1;
+  f->version = o[5];
+  f->design = get16(o + 6);
+  if (f->design == 0)
+    return -1;
+  if (f->version >= 8) {
+    table = get32(o + 16);
+    nchunks = get32(o + 20);
+  } else {
+    table = 16;
+    nchunks = 8;
+  }
+  if (nchunks > 8)
+    nchunks = 8;
+  if (table > f->olen || nchunks * 4 > f->olen - table)
+    return -1;
+
+  for (size_t i = 0; i < nchunks; i++) {
+    size_t chunk = get32(o + table + 4 * i);
+    size_t idx = chunk + (f->version >= 8 ? 4 : 0);
+
+    if (chunk == 0)
+      continue;
+    if (idx > f->olen || f->olen - idx < 32 * 4)
+      return -1;
+    for (size_t k = 0; k < 32; k++) {
+      size_t off = get32(o + idx + 4 * k);
+      if (off != 0 && off < f->olen - idx)
+        f->chars[i * 32 + k] = idx + off;
+    }
+  }
+  return 0;
+}
+
+static int by_pair(const void *av, const void *bv)
+{
+  const struct kern_pair *a = av, *b = bv;
+
+  if (a->left != b->left)
+    return a->left < b->left ? -1 : 1;
+  return a->right < b->right ? -1 : a->right > b->right;
+}
+
+/* Read the kern pairs: for each left character, its code, then the
+   code and adjustments of each right character, ending with a zero
+   code.  A zero left code ends the lot. */
+static void read_kerns(struct ofont *f, size_t p, unsigned flags)
+{
+  const unsigned char *m = f->metrics;
+  size_t len = f->mlen, cap = 0;
+  size_t wide = flags & 0x40 ? 2 : 1;
+  size_t step = wide + (flags & 2 ? 0 : 2) + (flags & 4 ? 0 : 2);
+
+  while (p <= len && len - p >= wide) {
+    unsigned left = wide == 2 ? get16(m + p) : m[p];
+
+    p += wide;
+    if (left == 0)
+      break;
+    while (p <= len && len - p >= wide) {
+      unsigned right = wide == 2 ? get16(m + p) : m[p];
+      struct kern_pair *kp;
+      size_t q = p + wide;
+
+      if (right == 0) {
+        p += wide;
+        break;
+      }
+      if (len - p < step)
+        return;
+      if (f->nkerns == cap) {
+        size_t nc = cap ? cap * 2 : 64;
+        void *nk = realloc(f->kerns, nc * sizeof *f->kerns);
+        if (!nk) nomem();
+        f->kerns = nk;
+        cap = nc;
+      }
+      kp = &f->kerns[f->nkerns++];
+      kp->left = left;
+      kp->right = right;
+      kp->dx = kp->dy = 0;
+      if (!(flags & 2)) {
+        kp->dx = get16s(m + q);
+        q += 2;
+      }
+      if (!(flags & 4))
+        kp->dy = get16s(m + q);
+      p += step;
+    }
+  }
+  qsort(f->kerns, f->nkerns, sizeof *f->kerns, by_pair);
+}
+
+/* Read the advance of each character, and the kern pairs.  The
+   metrics of a character are found through a map from its code,
+   after which come boxes, x advances and y advances, any of which may
+   be left out, and then a table locating further data. */
+static int index_metrics(struct ofont *f)
+{
+  const unsigned char *m = f->metrics;
+  size_t len = f->mlen, p = 52, map, mapsize = 256, n;
+  size_t xoff = 0, yoff = 0;
+  unsigned flags;
+
+  if (len < 52)
+    return -1;
+  n = m[48] | (m[49] >= 1 ? m[51] << 8 : 0);
+  flags = m[50];
+  if (flags & 0x20) {
+    if (len - p < 2)
+      return -1;
+    mapsize = get16(m + p);
+    p += 2;
+  }
+  map = p;
+  p += mapsize;
+  if (!(flags & 1))
+    p += 8 * n;
+  if (!(flags & 2)) {
+    xoff = p;
+    p += 2 * n;
+  }
+  if (!(flags & 4)) {
+    yoff = p;
+    p += 2 * n;
+  }
+  if (p > len)
+    return -1;
+
+  for (size_t c = 0; c < 256 && c < mapsize; c++) {
+    size_t i = m[map + c];
+    if (i >= n)
+      continue;
+    if (xoff)
+      f->adv[c][0] = get16s(m + xoff + 2 * i);
+    if (yoff)
+      f->adv[c][1] = get16s(m + yoff + 2 * i);
+  }
+  if ((flags & 8) && len - p >= 4)
+    read_kerns(f, p + get16(m + p + 2), flags);
+  return 0;
+}
+
+struct ofont *ofont_open(const char *dir, const char *name)
+{
+  static const char *const leaves[][2] = {
+    { "Outlines", "IntMetrics" },
+    { "Outlines0", "IntMetrics0" },
+  };
+  struct ofont *f = calloc(1, sizeof *f);
+
+  if (!f) nomem();
+  for (size_t i = 0; i < sizeof leaves / sizeof leaves[0]; i++) {
+    f->outlines = load(dir, name, leaves[i][0], &f->olen);
+    if (!f->outlines)
+      continue;
+    f->metrics = load(dir, name, leaves[i][1], &f->mlen);
+    if (f->metrics && index_outlines(f) == 0 && index_metrics(f) == 0)
+      return f;
+    break;
+  }
+  ofont_close(f);
+  return NULL;
+}
+
+void ofont_id(const struct ofont *f, unsigned *id)
+{
+  unsigned long h = 0x811c9dc5ul;
+
+  for (size_t i = 0; i < f->olen; i++)
+    h = (h ^ f->outlines[i]) * 0x01000193ul;
+  for (size_t i = 0; i < f->mlen; i++)
+    h = (h ^ f->metrics[i]) * 0x01000193ul;
+  id[0] = f->olen + f->mlen;
+  id[1] = h & 0xfffffffful;
+}
+
+void ofont_close(struct ofont *f)
+{
+  free(f->outlines);
+  free(f->metrics);
+  free(f->kerns);
+  free(f);
+}
+
+/* Where a character is being painted: the matrix taking design units
+   to draw units, and the character's origin */
+struct pen {
+  struct ofont_buf *out;
+  double m[4], x, y;
+  int open, box[4];
+};
+
+static void put(struct ofont_buf *b, int v)
+{
+  if (b->n == b->cap) {
+    size_t nc = b->cap ? b->cap * 2 : 256;
+    void *nv = realloc(b->v, nc * sizeof *b->v);
+    if (!nv) nomem();
+    b->v = nv;
+    b->cap = nc;
+  }
+  b->v[b->n++] = v;
+}
+
+static void put_point(struct pen *pn, int gx, int gy)
+{
+  int x = (int) floor(pn->x + pn->m[0] * gx + pn->m[2] * gy + 0.5);
+  int y = (int) floor(pn->y + pn->m[1] * gx + pn->m[3] * gy + 0.5);
+
+  put(pn->out, x);
+  put(pn->out, y);
+  if (x < pn->box[0]) pn->box[0] = x;
+  if (y < pn->box[1]) pn->box[1] = y;
+  if (x > pn->box[2]) pn->box[2] = x;
+  if (y > pn->box[3]) pn->box[3] = y;
+}
+
+/* Read a coordinate pair, of 12 bits each packed into three bytes,
+   or 8 bits each. */
+static int get_pair(const unsigned char **pp, const unsigned char *e,
+                    int wide, int *x, int *y)
+{
+  const unsigned char *p = *pp;
+
+  if (e - p < (wide ? 3 : 2))
+    return -1;
+  if (wide) {
+    *x = p[0] | (p[1] & 0x0f) << 8;
+    *y = p[1] >> 4 | p[2] << 4;
+    if (*x >= 0x800) *x -= 0x1000;
+    if (*y >= 0x800) *y -= 0x1000;
+    *pp = p + 3;
+  } else {
+    *x = p[0] >= 0x80 ? p[0] - 0x100 : p[0];
+    *y = p[1] >= 0x80 ? p[1] - 0x100 : p[1];
+    *pp = p + 2;
+  }
+  return 0;
+}
+
+static int get_code(const unsigned char **pp, const unsigned char *e,
+                    int wide, unsigned *code)
+{
+  const unsigned char *p = *pp;
+
+  if (e - p < (wide ? 2 : 1))
+    return -1;
+  *code = wide ? get16(p) : p[0];
+  *pp = p + (wide ? 2 : 1);
+  return 0;
+}
+
+/* Add the outline of a character, moved by (ox, oy) in design units,
+   to the path being painted.  A composite character is its base
+   character, and perhaps an accent moved from it.  Scaffold links,
+   which only hint small sizes, are ignored, as are the strokes that
+   may follow the outline. */
+static void draw_char(const struct ofont *f, struct pen *pn, unsigned ch,
+                      int ox, int oy, int depth)
+{
+  const unsigned char *p, *e = f->outlines + f->olen;
+  unsigned flags;
+  int wide;
+
+  if (ch >= 256 || !f->chars[ch] || depth > MAX_DEPTH)
+    return;
+  p = f->outlines + f->chars[ch];
+  flags = *p++;
+  wide = flags & 1;
+
+  if (f->version >= 8 && (flags & 0x10)) {
+    unsigned base, accent;
+    int ax, ay;
+
+    if (get_code(&p, e, flags & 0x40, &base) < 0)
+      return;
+    draw_char(f, pn, base, ox, oy, depth + 1);
+    if ((flags & 0x20) && get_code(&p, e, flags & 0x40, &accent) == 0 &&
+        get_pair(&p, e, wide, &ax, &ay) == 0)
+      draw_char(f, pn, accent, ox + ax, oy + ay, depth + 1);
+    return;
+  }
+  if (!(flags & 8))
+    return;
+  if (f->version < 8) {
+    /* Skip the box. */
+    int x, y;
+    if (get_pair(&p, e, wide, &x, &y) < 0 ||
+        get_pair(&p, e, wide, &x, &y) < 0)
+      return;
+  }
+
+  /* Skip the scaffold: the character whose lines are borrowed, masks
+     of those borrowed and of those defined here, and three bytes for
+     each line defined here. */
+  {
+    unsigned base, local, lines = 0;
+
+    if (get_code(&p, e, flags & 0x40, &base) < 0 || e - p < 4)
+      return;
+    for (local = p[2] | p[3] << 8; local; local >>= 1)
+      lines += local & 1;
+    p += 4;
+    if ((size_t) (e - p) < 3 * lines)
+      return;
+    p += 3 * lines;
+  }
+
+  while (p < e) {
+    int kind = *p++ & 3, n = kind == 3 ? 3 : 1;
+    int x[3], y[3];
+
+    if (kind == 0)
+      return;
+    for (int i = 0; i < n; i++)
+      if (get_pair(&p, e, wide, &x[i], &y[i]) < 0)
+        return;
+    if (kind == 1) {
+      if (pn->open)
+        put(pn->out, 5);
+      put(pn->out, 2);
+      pn->open = true;
+    } else if (!pn->open) {
+      continue;
+    } else {
+      put(pn->out, kind == 2 ? 8 : 6);
+    }
+    for (int i = 0; i < n; i++)
+      put_point(pn, x[i] + ox, y[i] + oy);
+  }
+}
+
+/* Paint a character as a path object of its own, filled black with
+   the non-zero rule, unless it paints nothing. */
+static void paint_char(const struct ofont *f, struct pen *pn, unsigned ch)
+{
+  struct ofont_buf *b = pn->out;
+  size_t start = b->n;
+
+  for (int i = 0; i < 10; i++)
+    put(b, 0);
+  pn->open = false;
+  pn->box[0] = pn->box[1] = INT_MAX;
+  pn->box[2] = pn->box[3] = INT_MIN;
+  draw_char(f, pn, ch, 0, 0, 0);
+  if (b->n == start + 10) {
+    b->n = start;
+    return;
+  }
+  if (pn->open)
+    put(b, 5);
+  put(b, 0);
+  b->v[start] = 2;
+  b->v[start + 1] = (b->n - start) * sizeof *b->v;
+  memcpy(b->v + start + 2, pn->box, sizeof pn->box);
+  b->v[start + 6] = 0;
+  b->v[start + 7] = -1;
+  b->v[start + 8] = 0;
+  b->v[start + 9] = 0;
+}
+
+static const struct kern_pair *find_kern(const struct ofont *f,
+                                         unsigned left, unsigned right)
+{
+  struct kern_pair key;
+
+  key.left = left;
+  key.right = right;
+  return f->nkerns == 0 ? NULL :
+    bsearch(&key, f->kerns, f->nkerns, sizeof key, by_pair);
+}
+
+/* Move the pen along a string, painting each character if asked, and
+   find where it ends up relative to where it started.  Control
+   characters are skipped. */
+static void lay_out(const struct ofont *f, const struct ofont_layout *lo,
+                    const char *s, size_t n, struct pen *pn,
+                    double x0, double y0, double *pen)
+{
+  double a = 1.0, b = 0.0, c = 0.0, d = 1.0;
+  double dir = lo->rtl ? -1.0 : 1.0;
+  double lx = 0.0, ly = 0.0;
+  unsigned prev = 0;
+
+  if (lo->mat) {
+    a = lo->mat[0] / 65536.0;
+    b = lo->mat[1] / 65536.0;
+    c = lo->mat[2] / 65536.0;
+    d = lo->mat[3] / 65536.0;
+    x0 += lo->mat[4] * 16.0 / 25.0;
+    y0 += lo->mat[5] * 16.0 / 25.0;
+  }
+  if (pn) {
+    pn->m[0] = a * lo->xsize / f->design;
+    pn->m[1] = b * lo->xsize / f->design;
+    pn->m[2] = c * lo->ysize / f->design;
+    pn->m[3] = d * lo->ysize / f->design;
+  }
+
+  for (size_t i = 0; i < n && s[i]; i++) {
+    unsigned ch = (unsigned char) s[i];
+    double ax, ay;
+
+    if (ch < 32)
+      continue;
+    if (lo->kern && prev) {
+      const struct kern_pair *kp = find_kern(f, prev, ch);
+      if (kp) {
+        lx += dir * kp->dx * lo->xsize / 1000.0;
+        ly += dir * kp->dy * lo->ysize / 1000.0;
+      }
+    }
+    ax = dir * f->adv[ch][0] * lo->xsize / 1000.0;
+    ay = dir * f->adv[ch][1] * lo->ysize / 1000.0;
+
+    /* Right-to-left text is painted to the left of the pen. */
+    if (lo->rtl) {
+      lx += ax;
+      ly += ay;
+    }
+    if (pn) {
+      pn->x = x0 + a * lx + c * ly;
+      pn->y = y0 + b * lx + d * ly;
+      paint_char(f, pn, ch);
+    }
+    if (!lo->rtl) {
+      lx += ax;
+      ly += ay;
+    }
+    prev = ch;
+  }
+  if (pen) {
+    pen[0] = a * lx + c * ly;
+    pen[1] = b * lx + d * ly;
+  }
+}
+
+void ofont_paint(const struct ofont *f, const struct ofont_layout *lo,
+                 const char *s, size_t n, double x, double y,
+                 struct ofont_buf *out)
+{
+  struct pen pn;
+
+  out->n = 0;
+  pn.out = out;
+  lay_out(f, lo, s, n, &pn, x, y, NULL);
+  put(out, 0);
+}
+
+void ofont_scan(const struct ofont *f, const struct ofont_layout *lo,
+                const char *s, size_t n, double *pen)
+{
+  lay_out(f, lo, s, n, NULL, 0.0, 0.0, pen);
+}
@@ -0,0 +1,73 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef OFONT_H
+#define OFONT_H
+
+#include <stddef.h>
+
+/* A RISC OS outline font, read from its Outlines and IntMetrics files
+   without the font manager.  Nothing is changed once a font is open,
+   and no state is kept between calls, so any number of threads may
+   lay out text with the same font at once. */
+struct ofont;
+
+/* Painted text, as the font manager writes it to a buffer: a Draw
+   path object for each character that paints anything, and a zero
+   word */
+struct ofont_buf {
+  int *v;
+  size_t n, cap;
+};
+
+/* How to lay out text: the size of an em in draw units, the matrix
+   of Font_Paint (a to d in 16.16 fixed point, e and f in
+   millipoints), or NULL, and whether to kern, and to run from right
+   to left */
+struct ofont_layout {
+  double xsize, ysize;
+  const int *mat;
+  int kern, rtl;
+};
+
+/* Open a font, such as "Homerton.Medium", in a directory of fonts
+   laid out as on RISC OS, or return NULL. */
+struct ofont *ofont_open(const char *dir, const char *name);
+void ofont_close(struct ofont *f);
+
+/* Get two words identifying the contents of a font's files. */
+void ofont_id(const struct ofont *f, unsigned *id);
+
+/* Paint up to 'n' characters of a string, starting the baseline at
+   (x, y) in draw units, replacing the contents of 'out'. */
+void ofont_paint(const struct ofont *f, const struct ofont_layout *lo,
+                 const char *s, size_t n, double x, double y,
+                 struct ofont_buf *out);
+
+/* Find how far up to 'n' characters of a string move the pen, in
+   draw units. */
+void ofont_scan(const struct ofont *f, const struct ofont_layout *lo,
+                const char *s, size_t n, double *pen);
+
+#endif
@@ -0,0 +1,251 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "context.h"
+#include "fmt.h"
+#include "pathopt.h"
+
+/* A command letter and up to six operands */
+#define TOKEN_MAX (2 + 6 * (FMT_INT_MAX + 1))
+
+/* Write operands with the separators path data needs.  In compact
+   output, a minus sign serves as a separator. */
+static char *put_ops(char *p, int compact, int n, const int *v)
+{
+  for (int i = 0; i < n; i++) {
+    if (i > 0 && (v[i] >= 0 || !compact)) *p++ = ' ';
+    p = fmt_int(p, v[i]);
+  }
+  return p;
+}
+
+/* Form a token for a command, leaving out the letter if it repeats
+   the last one. */
+static size_t form(const struct pathopt *po, char *buf,
+                   int cmd, int n, const int *v)
+{
+  char *p = buf;
+
+  if (cmd != po->cmd || cmd == 'M' || cmd == 'm') {
+    *p++ = cmd;
+  } else if (v[0] >= 0 || !po->compact) {
+    *p++ = ' ';
+  }
+  return put_ops(p, po->compact, n, v) - buf;
+}
+
+/* Write whichever of the absolute and relative forms is shorter,
+   preferring relative. */
+static void emit(struct pathopt *po, int cmd, int n, const int *abs)
+{
+  char abuf[TOKEN_MAX], rbuf[TOKEN_MAX];
+  int rel[6];
+  size_t alen, rlen;
+
+  for (int i = 0; i < n; i++)
+    rel[i] = abs[i] - (cmd == 'V' || i % 2 ? po->y : po->x);
+  alen = form(po, abuf, cmd, n, abs);
+  rlen = form(po, rbuf, cmd + 'a' - 'A', n, rel);
+  if (alen < rlen) {
+    output_str(po->ws, true, abuf, alen);
+    po->cmd = cmd;
+  } else {
+    output_str(po->ws, true, rbuf, rlen);
+    po->cmd = cmd + 'a' - 'A';
+    alen = rlen;
+  }
+  if (po->stats)
+    po->ws->path_bytes += alen;
+}
+
+/* Count what the unoptimized form would have written. */
+static void legacy(struct pathopt *po, const char *cmd, int n, ...)
+{
+  char buf[TOKEN_MAX];
+  int v[6];
+  va_list ap;
+
+  if (!po->stats)
+    return;
+  va_start(ap, n);
+  for (int i = 0; i < n; i++)
+    v[i] = va_arg(ap, int);
+  va_end(ap);
+  po->ws->path_legacy += strlen(cmd) + (put_ops(buf, po->compact, n, v) - buf);
+}
+
+/* Write out a line held back for merging. */
+static void flush_line(struct pathopt *po)
+{
+  if (!po->line)
+    return;
+  po->line = false;
+  if (po->ly == po->y) {
+    emit(po, 'H', 1, &po->lx);
+  } else if (po->lx == po->x) {
+    emit(po, 'V', 1, &po->ly);
+  } else {
+    int v[2] = { po->lx, po->ly };
+    emit(po, 'L', 2, v);
+  }
+  po->x = po->lx;
+  po->y = po->ly;
+}
+
+void pathopt_init(struct pathopt *po, struct ws *ws)
+{
+  po->ws = ws;
+  po->compact = ws->ct->compact;
+  po->stats = ws->ct->stats;
+  po->cmd = 0;
+  po->x = po->y = po->sx = po->sy = 0;
+  po->px = po->py = 0;
+  po->curve = po->line = false;
+}
+
+void pathopt_move(struct pathopt *po, int x, int y)
+{
+  int v[2] = { x, y };
+
+  legacy(po, "M", 2, x, y);
+  po->px = x, po->py = y;
+
+  flush_line(po);
+  emit(po, 'M', 2, v);
+  po->x = po->sx = x;
+  po->y = po->sy = y;
+  po->curve = false;
+}
+
+/* Hold back a line, writing out the one held before unless this one
+   continues it.  Bytes are counted when lines are written out. */
+static void hold_line(struct pathopt *po, int x, int y)
+{
+  po->curve = false;
+  if (po->line) {
+    /* Extend the held line if this one carries on in the same
+       direction. */
+    long long ax = po->lx - po->x, ay = po->ly - po->y;
+    long long bx = x - po->lx, by = y - po->ly;
+    if (ax * by == ay * bx && ax * bx + ay * by > 0) {
+      po->lx = x, po->ly = y;
+      return;
+    }
+    flush_line(po);
+  }
+  po->line = true;
+  po->lx = x, po->ly = y;
+}
+
+void pathopt_line(struct pathopt *po, int x, int y)
+{
+  if (x == po->px)
+    legacy(po, "v", 1, y - po->py);
+  else if (y == po->py)
+    legacy(po, "h", 1, x - po->px);
+  else
+    legacy(po, "l", 2, x - po->px, y - po->py);
+  po->px = x, po->py = y;
+
+  hold_line(po, x, y);
+}
+
+/* Is (x, y) within half a unit of the chord from the current point to
+   (ex, ey), and between its ends? */
+static int on_chord(const struct pathopt *po, int x, int y, int ex, int ey)
+{
+  double cx = ex - po->x, cy = ey - po->y;
+  double px = x - po->x, py = y - po->y;
+  double len2 = cx * cx + cy * cy;
+  double cross = cx * py - cy * px;
+  double dot = cx * px + cy * py;
+
+  if (len2 == 0.0)
+    return px == 0.0 && py == 0.0;
+  return cross * cross <= 0.25 * len2 && dot >= 0.0 && dot <= len2;
+}
+
+void pathopt_curve(struct pathopt *po,
+                   int x1, int y1, int x2, int y2, int x, int y)
+{
+  int startx, starty;
+
+  legacy(po, "c", 6, x1 - po->px, y1 - po->py,
+         x2 - po->px, y2 - po->py, x - po->px, y - po->py);
+  po->px = x, po->py = y;
+
+  /* Check against where the curve really starts, even if a line is
+     being held back. */
+  startx = po->line ? po->lx : po->x;
+  starty = po->line ? po->ly : po->y;
+  {
+    struct pathopt from = *po;
+    from.x = startx, from.y = starty;
+    if (on_chord(&from, x1, y1, x, y) && on_chord(&from, x2, y2, x, y)) {
+      /* The curve traces its chord, so it's really a line, already
+         counted as a curve in the unoptimized form. */
+      hold_line(po, x, y);
+      return;
+    }
+  }
+
+  flush_line(po);
+  if (po->curve &&
+      x1 == 2 * po->x - po->cx && y1 == 2 * po->y - po->cy) {
+    int v[4] = { x2, y2, x, y };
+    emit(po, 'S', 4, v);
+  } else {
+    int v[6] = { x1, y1, x2, y2, x, y };
+    emit(po, 'C', 6, v);
+  }
+  po->curve = true;
+  po->cx = x2, po->cy = y2;
+  po->x = x, po->y = y;
+}
+
+void pathopt_close(struct pathopt *po)
+{
+  legacy(po, "z", 0);
+  po->px = po->sx, po->py = po->sy;
+
+  /* A line back to the start is drawn by the close anyway. */
+  if (po->line && po->lx == po->sx && po->ly == po->sy)
+    po->line = false;
+  flush_line(po);
+  output_str(po->ws, true, "z", 1);
+  if (po->stats)
+    po->ws->path_bytes++;
+  po->cmd = 0;
+  po->curve = false;
+  po->x = po->sx, po->y = po->sy;
+}
+
+void pathopt_end(struct pathopt *po)
+{
+  flush_line(po);
+}
@@ -0,0 +1,65 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef PATHOPT_H
+#define PATHOPT_H
+
+struct ws;
+
+/* Path data is passed through one of these on its way out.  Each
+   segment is written in whichever of its absolute and relative forms
+   is shorter, and repeated command letters are left out.  Curves
+   whose control points lie on their chords become lines, lines
+   continuing in the same direction are merged, and curves that
+   continue smoothly use the S/s shorthand. */
+struct pathopt {
+  struct ws *ws;
+  int compact, stats;
+
+  /* The last command letter written, or 0 if one is required */
+  int cmd;
+
+  /* The current point, and the start of the subpath */
+  int x, y, sx, sy;
+
+  /* The second control point of the previous segment, if a curve */
+  int curve, cx, cy;
+
+  /* A line to (lx, ly), held back in case the next one continues
+     it */
+  int line, lx, ly;
+
+  /* The last point given, as the unoptimized form would see it */
+  int px, py;
+};
+
+void pathopt_init(struct pathopt *po, struct ws *ws);
+void pathopt_move(struct pathopt *po, int x, int y);
+void pathopt_line(struct pathopt *po, int x, int y);
+void pathopt_curve(struct pathopt *po,
+                   int x1, int y1, int x2, int y2, int x, int y);
+void pathopt_close(struct pathopt *po);
+void pathopt_end(struct pathopt *po);
+
+#endif
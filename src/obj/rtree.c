@@ -0,0 +1,264 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "nomem.h"
+#include "rtree.h"
+
+/* The format of saved trees */
+#define RTREE_MAGIC "D2SI"
+#define RTREE_VERSION 1
+
+void rtree_init(struct rtree *rt)
+{
+  rt->ents = NULL;
+  rt->n = rt->cap = 0;
+  rt->nodes = NULL;
+  rt->nnodes = 0;
+  rt->nlevels = 0;
+}
+
+void rtree_free(struct rtree *rt)
+{
+  free(rt->ents);
+  free(rt->nodes);
+}
+
+void rtree_add(struct rtree *rt, const int *box, unsigned long ref)
+{
+  if (rt->n == rt->cap) {
+    size_t nc = rt->cap ? rt->cap * 2 : 256;
+    void *nb = realloc(rt->ents, nc * sizeof *rt->ents);
+    if (!nb) nomem();
+    rt->ents = nb;
+    rt->cap = nc;
+  }
+  memcpy(rt->ents[rt->n].box, box, sizeof rt->ents[rt->n].box);
+  rt->ents[rt->n++].ref = ref;
+}
+
+static int by_x(const void *av, const void *bv)
+{
+  const struct rtree_entry *a = av, *b = bv;
+  long long ac = (long long) a->box[0] + a->box[2];
+  long long bc = (long long) b->box[0] + b->box[2];
+  return ac < bc ? -1 : ac > bc;
+}
+
+static int by_y(const void *av, const void *bv)
+{
+  const struct rtree_entry *a = av, *b = bv;
+  long long ac = (long long) a->box[1] + a->box[3];
+  long long bc = (long long) b->box[1] + b->box[3];
+  return ac < bc ? -1 : ac > bc;
+}
+
+static void unite(int *acc, const int *box, int first)
+{
+  if (first) {
+    memcpy(acc, box, 4 * sizeof *acc);
+    return;
+  }
+  if (box[0] < acc[0]) acc[0] = box[0];
+  if (box[1] < acc[1]) acc[1] = box[1];
+  if (box[2] > acc[2]) acc[2] = box[2];
+  if (box[3] > acc[3]) acc[3] = box[3];
+}
+
+/* Build the levels above the entries. */
+static void build(struct rtree *rt)
+{
+  int k;
+
+  free(rt->nodes);
+  rt->nodes = NULL;
+  rt->nnodes = 0;
+  rt->nlevels = 0;
+  if (rt->n == 0)
+    return;
+
+  rt->start[0] = 0;
+  rt->count[0] = rt->n;
+  for (k = 0; rt->count[k] > RTREE_FANOUT; k++) {
+    rt->start[k + 1] = rt->nnodes;
+    rt->count[k + 1] = (rt->count[k] + RTREE_FANOUT - 1) / RTREE_FANOUT;
+    rt->nnodes += rt->count[k + 1];
+  }
+  rt->nlevels = k + 1;
+  if (rt->nnodes == 0)
+    return;
+  rt->nodes = malloc(rt->nnodes * sizeof *rt->nodes);
+  if (!rt->nodes) nomem();
+
+  for (k = 1; k < rt->nlevels; k++)
+    for (size_t i = 0; i < rt->count[k - 1]; i++) {
+      const int *box = k == 1 ? rt->ents[i].box :
+        rt->nodes[rt->start[k - 1] + i];
+      unite(rt->nodes[rt->start[k] + i / RTREE_FANOUT], box,
+            i % RTREE_FANOUT == 0);
+    }
+}
+
+void rtree_pack(struct rtree *rt)
+{
+  size_t leaves = (rt->n + RTREE_FANOUT - 1) / RTREE_FANOUT;
+  size_t slices = 1, per;
+
+  /* Cut the entries into vertical slices, each of about the square
+     root of the number of leaves, and sort each slice from bottom to
+     top, so that each leaf covers a compact tile. */
+  while (slices * slices < leaves)
+    slices++;
+  per = slices * RTREE_FANOUT;
+  if (rt->n > 1) {
+    qsort(rt->ents, rt->n, sizeof *rt->ents, by_x);
+    for (size_t s = 0; s < rt->n; s += per)
+      qsort(rt->ents + s, rt->n - s < per ? rt->n - s : per,
+            sizeof *rt->ents, by_y);
+  }
+  build(rt);
+}
+
+struct found {
+  unsigned long *res;
+  size_t n, cap;
+};
+
+static int meets(const int *a, const int *b)
+{
+  return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+static void visit(const struct rtree *rt, int k, size_t i0, size_t i1,
+                  const int *box, struct found *f)
+{
+  for (size_t i = i0; i < i1; i++) {
+    if (k == 0) {
+      if (!meets(rt->ents[i].box, box))
+        continue;
+      if (f->n == f->cap) {
+        size_t nc = f->cap ? f->cap * 2 : 256;
+        void *nb = realloc(f->res, nc * sizeof *f->res);
+        if (!nb) nomem();
+        f->res = nb;
+        f->cap = nc;
+      }
+      f->res[f->n++] = rt->ents[i].ref;
+    } else if (meets(rt->nodes[rt->start[k] + i], box)) {
+      size_t j1 = (i + 1) * RTREE_FANOUT;
+      visit(rt, k - 1, i * RTREE_FANOUT,
+            j1 < rt->count[k - 1] ? j1 : rt->count[k - 1], box, f);
+    }
+  }
+}
+
+static int ascending(const void *av, const void *bv)
+{
+  unsigned long a = *(const unsigned long *) av;
+  unsigned long b = *(const unsigned long *) bv;
+  return a < b ? -1 : a > b;
+}
+
+size_t rtree_query(const struct rtree *rt, const int *box,
+                   unsigned long **res, size_t *cap)
+{
+  struct found f = { *res, 0, *cap };
+
+  if (rt->nlevels > 0)
+    visit(rt, rt->nlevels - 1, 0, rt->count[rt->nlevels - 1], box, &f);
+  if (f.n > 1)
+    qsort(f.res, f.n, sizeof *f.res, ascending);
+  *res = f.res;
+  *cap = f.cap;
+  return f.n;
+}
+
+/* Only the entries are saved, as the levels above them are quick to
+   rebuild. */
+int rtree_save(const struct rtree *rt, const char *name,
+               const unsigned *key, size_t nkey)
+{
+  FILE *fp = fopen(name, "wb");
+  unsigned hdr[3] = { RTREE_VERSION, nkey, rt->n };
+  int rc = 0;
+
+  if (!fp)
+    return -1;
+  if (fwrite(RTREE_MAGIC, 4, 1, fp) != 1 ||
+      fwrite(hdr, sizeof hdr, 1, fp) != 1 ||
+      fwrite(key, sizeof *key, nkey, fp) != nkey)
+    rc = -1;
+  for (size_t i = 0; i < rt->n && rc == 0; i++) {
+    unsigned ref = rt->ents[i].ref;
+    if (fwrite(rt->ents[i].box, sizeof rt->ents[i].box, 1, fp) != 1 ||
+        fwrite(&ref, sizeof ref, 1, fp) != 1)
+      rc = -1;
+  }
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0)
+    remove(name);
+  return rc;
+}
+
+int rtree_load(struct rtree *rt, const char *name,
+               const unsigned *key, size_t nkey)
+{
+  FILE *fp = fopen(name, "rb");
+  char magic[4];
+  unsigned hdr[3], k;
+  int rc = 0;
+
+  if (!fp)
+    return -1;
+  if (fread(magic, 4, 1, fp) != 1 || memcmp(magic, RTREE_MAGIC, 4) ||
+      fread(hdr, sizeof hdr, 1, fp) != 1 ||
+      hdr[0] != RTREE_VERSION || hdr[1] != nkey) {
+    fclose(fp);
+    return -1;
+  }
+  for (size_t i = 0; i < nkey && rc == 0; i++)
+    if (fread(&k, sizeof k, 1, fp) != 1 || k != key[i])
+      rc = -1;
+  rt->n = 0;
+  for (size_t i = 0; i < hdr[2] && rc == 0; i++) {
+    int box[4];
+    unsigned ref;
+    if (fread(box, sizeof box, 1, fp) != 1 ||
+        fread(&ref, sizeof ref, 1, fp) != 1)
+      rc = -1;
+    else
+      rtree_add(rt, box, ref);
+  }
+  fclose(fp);
+  if (rc == 0)
+    build(rt);
+  else
+    rt->n = 0;
+  return rc;
+}
@@ -0,0 +1,75 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef RTREE_H
+#define RTREE_H
+
+#include <stddef.h>
+
+/* Children per node */
+#define RTREE_FANOUT 16
+
+/* A box (x0, y0, x1, y1) in draw units, and what it belongs to */
+struct rtree_entry {
+  int box[4];
+  unsigned long ref;
+};
+
+/* A packed R-tree.  The entries are sorted into tiles of nearby boxes
+   once they have all been added, and each level above them gives the
+   box of each run of RTREE_FANOUT nodes in the level below, so no
+   links are stored. */
+struct rtree {
+  struct rtree_entry *ents;
+  size_t n, cap;
+
+  /* Level 0 is the entries.  Level k > 0 has 'count[k]' nodes from
+     'start[k]'.  The top level has no more than RTREE_FANOUT. */
+  int (*nodes)[4];
+  size_t nnodes;
+  size_t start[sizeof(size_t) * 8], count[sizeof(size_t) * 8];
+  int nlevels;
+};
+
+void rtree_init(struct rtree *rt);
+void rtree_free(struct rtree *rt);
+
+void rtree_add(struct rtree *rt, const int *box, unsigned long ref);
+
+/* Sort the entries, and build the levels above them. */
+void rtree_pack(struct rtree *rt);
+
+/* Get the references of the boxes meeting 'box', in ascending order,
+   in '*res', which is reallocated as needed.  Return how many. */
+size_t rtree_query(const struct rtree *rt, const int *box,
+                   unsigned long **res, size_t *cap);
+
+/* Save a packed tree, or load one saved under the same key, which
+   identifies what it indexes.  Return 0 on success. */
+int rtree_save(const struct rtree *rt, const char *name,
+               const unsigned *key, size_t nkey);
+int rtree_load(struct rtree *rt, const char *name,
+               const unsigned *key, size_t nkey);
+
+#endif
@@ -0,0 +1,158 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <string.h>
+#include <assert.h>
+
+#if defined __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+size_t scan_span(const char *s, size_t n, const char *set)
+{
+  size_t ns = strlen(set), i = 0;
+
+  if (ns == 0)
+    return n;
+  assert(ns <= SCAN_SET_MAX);
+
+#if defined __AVX2__
+  {
+    __m256i v[SCAN_SET_MAX];
+
+    for (size_t k = 0; k < ns; k++)
+      v[k] = _mm256_set1_epi8(set[k]);
+    for (; i + 32 <= n; i += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (s + i));
+      __m256i m = _mm256_cmpeq_epi8(x, v[0]);
+      unsigned bits;
+      for (size_t k = 1; k < ns; k++)
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, v[k]));
+      bits = _mm256_movemask_epi8(m);
+      if (bits)
+        return i + __builtin_ctz(bits);
+    }
+  }
+#endif
+
+#if defined __SSE2__
+  {
+    __m128i v[SCAN_SET_MAX];
+
+    for (size_t k = 0; k < ns; k++)
+      v[k] = _mm_set1_epi8(set[k]);
+    for (; i + 16 <= n; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (s + i));
+      __m128i m = _mm_cmpeq_epi8(x, v[0]);
+      unsigned bits;
+      for (size_t k = 1; k < ns; k++)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(x, v[k]));
+      bits = _mm_movemask_epi8(m);
+      if (bits)
+        return i + __builtin_ctz(bits);
+    }
+  }
+#else
+  {
+    /* Test a word at a time.  A byte of x ^ (ones * c) is zero where x
+       has c, and (y - ones) & ~y & highs then picks it out. */
+    typedef unsigned long word;
+    const word ones = (word) -1 / 0xff, highs = ones << 7;
+
+    for (; i + sizeof(word) <= n; i += sizeof(word)) {
+      word x, hit = 0;
+      memcpy(&x, s + i, sizeof x);
+      for (size_t k = 0; k < ns; k++) {
+        word y = x ^ (ones * (unsigned char) set[k]);
+        hit |= (y - ones) & ~y & highs;
+      }
+      if (hit)
+        break;
+    }
+  }
+#endif
+
+  for (; i < n; i++)
+    if (memchr(set, s[i], ns))
+      return i;
+  return n;
+}
+
+size_t scan_ctl(const char *s, size_t n)
+{
+  size_t i = 0;
+
+#if defined __AVX2__
+  {
+    const __m256i sp = _mm256_set1_epi8(' ');
+
+    for (; i + 32 <= n; i += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) (s + i));
+      unsigned bits =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(x, sp), x));
+      if (bits)
+        return i + __builtin_ctz(bits);
+    }
+  }
+#endif
+
+#if defined __SSE2__
+  {
+    const __m128i sp = _mm_set1_epi8(' ');
+
+    for (; i + 16 <= n; i += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *) (s + i));
+      unsigned bits =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, sp), x));
+      if (bits)
+        return i + __builtin_ctz(bits);
+    }
+  }
+#else
+  {
+    /* (x - ones * 0x21) & ~x & highs is non-zero if any byte of x is
+       below 0x21. */
+    typedef unsigned long word;
+    const word ones = (word) -1 / 0xff, highs = ones << 7;
+
+    for (; i + sizeof(word) <= n; i += sizeof(word)) {
+      word x;
+      memcpy(&x, s + i, sizeof x);
+      if ((x - ones * 0x21) & ~x & highs)
+        break;
+    }
+  }
+#endif
+
+  for (; i < n; i++)
+    if ((unsigned char) s[i] <= ' ')
+      return i;
+  return n;
+}
@@ -0,0 +1,180 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+
+#include "context.h"
+#include "shape.h"
+
+/* The distance of a Bezier control point from its end, as a fraction
+   of the radius, for a quarter of an ellipse */
+#define KAPPA 0.5522847498
+
+/* Does 'v' lie within 'tol' of 'want'? */
+static int near(int v, double want, double tol)
+{
+  return v >= want - tol && v <= want + tol;
+}
+
+/* Do four curves from 'p' (end points at p[0..1], then control
+   points and ends seven words apart) trace the ellipse in the box
+   x0,y0 to x1,y1?  Each end must be at the middle of a side, and each
+   control point along the tangent there by the usual proportion of
+   the radius. */
+static int is_ellipse(const int *p, int x0, int y0, int x1, int y1)
+{
+  double rx = (x1 - x0) / 2.0, ry = (y1 - y0) / 2.0;
+  double cx = x0 + rx, cy = y0 + ry;
+  double tol = 1.0 + (rx > ry ? rx : ry) / 512.0;
+  int ax = p[1], ay = p[2];
+  int ends[4][2];
+
+  if (rx <= 0 || ry <= 0)
+    return false;
+  for (int i = 0; i < 4; i++) {
+    const int *c = p + 4 + 7 * i;
+    int bx = c[4], by = c[5];
+    int aside = ax == x0 || ax == x1, bside = bx == x0 || bx == x1;
+
+    /* The ends must be at alternate kinds of extreme. */
+    if (aside == bside)
+      return false;
+    if (aside ? !near(ay, cy, 0.5) :
+        (!near(ax, cx, 0.5) || (ay != y0 && ay != y1)))
+      return false;
+
+    /* It must go all the way round, not back the way it came. */
+    ends[i][0] = ax, ends[i][1] = ay;
+    if (i >= 2 && ax == ends[i - 2][0] && ay == ends[i - 2][1])
+      return false;
+
+    /* Leave the first end along its tangent, towards the second, and
+       arrive at the second along its tangent. */
+    if (aside) {
+      if (c[0] != ax || !near(c[1], ay + KAPPA * (by - ay), tol) ||
+          c[3] != by || !near(c[2], bx + KAPPA * (ax - bx), tol))
+        return false;
+    } else {
+      if (c[1] != ay || !near(c[0], ax + KAPPA * (bx - ax), tol) ||
+          c[2] != bx || !near(c[3], by + KAPPA * (ay - by), tol))
+        return false;
+    }
+    ax = bx, ay = by;
+  }
+  return true;
+}
+
+int shape_classify(const int *d, const int *e, int stroked,
+                   struct shape *sh)
+{
+  const int *p = d;
+  size_t lines = 0, curves = 0;
+  int closed = false, shut, x0, y0, x1, y1;
+
+  sh->kind = SHAPE_NONE;
+  if (d >= e || d[0] != 2)
+    return SHAPE_NONE;
+
+  /* Find the extent of the only subpath, and the box of its ends. */
+  x0 = x1 = d[1];
+  y0 = y1 = d[2];
+  for (p = d + 3; p < e && p[0] != 0; ) {
+    if (closed)
+      return SHAPE_NONE;
+    switch (p[0]) {
+    case 5:
+      closed = true;
+      p += 1;
+      continue;
+    case 6:
+      curves++;
+      p += 5;
+      break;
+    case 8:
+      lines++;
+      p += 1;
+      break;
+    default:
+      return SHAPE_NONE;
+    }
+    if (p[0] < x0) x0 = p[0];
+    if (p[0] > x1) x1 = p[0];
+    if (p[1] < y0) y0 = p[1];
+    if (p[1] > y1) y1 = p[1];
+    p += 2;
+  }
+  if (!closed && stroked && (lines == 0 || curves > 0))
+    return SHAPE_NONE;
+
+  /* Filling alone closes a shape implicitly. */
+  shut = closed || !stroked;
+
+  if (curves == 0 && lines > 0) {
+    /* Leave out a last vertex that repeats the first. */
+    size_t n = lines + 1;
+    const int *last = d + 3 * lines;
+
+    if (shut && n > 1 && last[1] == d[1] && last[2] == d[2])
+      n--;
+
+    if (shut && n == 4 && x0 < x1 && y0 < y1) {
+      /* Each side must be horizontal or vertical, in turn. */
+      int h = d[2] == d[5];
+      int ok = true;
+
+      for (size_t i = 0; i < 4 && ok; i++) {
+        const int *a = d + 3 * i, *b = d + 3 * ((i + 1) % 4);
+        if ((i % 2 == 0) == h ? a[2] != b[2] : a[1] != b[1])
+          ok = false;
+      }
+      if (ok) {
+        sh->x0 = x0, sh->y0 = y0, sh->x1 = x1, sh->y1 = y1;
+        return sh->kind = SHAPE_RECT;
+      }
+    }
+    sh->el = d;
+    sh->n = n;
+    if (shut) {
+      if (n < 3)
+        return SHAPE_NONE;
+      return sh->kind = SHAPE_POLYGON;
+    }
+    if (lines == 1) {
+      sh->x0 = d[1], sh->y0 = d[2], sh->x1 = d[4], sh->y1 = d[5];
+      return sh->kind = SHAPE_LINE;
+    }
+    return sh->kind = SHAPE_POLYLINE;
+  }
+
+  if (curves == 4 && lines == 0) {
+    const int *last = d + 3 + 7 * 3;
+
+    if (last[5] == d[1] && last[6] == d[2] &&
+        is_ellipse(d, x0, y0, x1, y1)) {
+      sh->x0 = x0, sh->y0 = y0, sh->x1 = x1, sh->y1 = y1;
+      return sh->kind = SHAPE_ELLIPSE;
+    }
+  }
+  return SHAPE_NONE;
+}
@@ -0,0 +1,52 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <stddef.h>
+
+enum {
+  SHAPE_NONE, SHAPE_RECT, SHAPE_ELLIPSE, SHAPE_LINE,
+  SHAPE_POLYLINE, SHAPE_POLYGON
+};
+
+/* A path recognised as a simpler element.  A rectangle or ellipse is
+   given by opposite corners of its box, and a line by its ends.  The
+   vertices of a polyline or polygon are the operands of 'n'
+   consecutive moves and lines starting at 'el', three words apart. */
+struct shape {
+  int kind;
+  int x0, y0, x1, y1;
+  const int *el;
+  size_t n;
+};
+
+/* Classify the elements of a path.  A stroked shape must be closed
+   explicitly to be drawn as a rectangle, ellipse or polygon, as
+   otherwise its ends are capped. */
+int shape_classify(const int *d, const int *e, int stroked,
+                   struct shape *sh);
+
+#endif
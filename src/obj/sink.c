@@ -0,0 +1,639 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#if HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "sink.h"
+
+#ifndef false
+#define false 0
+#endif
+
+#ifndef true
+#define true 1
+#endif
+
+int sink_write(struct sink *s, const void *p, size_t n)
+{
+  s->bytes += n;
+  return (*s->write)(s, p, n);
+}
+
+int sink_finish(struct sink *s)
+{
+  int rc = 0;
+
+  for (; s; s = s->down)
+    if ((*s->finish)(s) < 0)
+      rc = -1;
+  return rc;
+}
+
+void sink_free(struct sink *s)
+{
+  while (s) {
+    struct sink *down = s->down;
+    (*s->release)(s);
+    s = down;
+  }
+}
+
+
+struct file_sink {
+  struct sink base;
+  FILE *fp;
+  int err;
+};
+
+static int file_write(struct sink *s, const void *p, size_t n)
+{
+  struct file_sink *fs = (struct file_sink *) s;
+
+  if (fwrite(p, 1, n, fs->fp) != n)
+    fs->err = true;
+  return fs->err ? -1 : 0;
+}
+
+static int file_finish(struct sink *s)
+{
+  struct file_sink *fs = (struct file_sink *) s;
+
+  if (fs->fp && fclose(fs->fp) == EOF)
+    fs->err = true;
+  fs->fp = NULL;
+  return fs->err ? -1 : 0;
+}
+
+static void file_release(struct sink *s)
+{
+  struct file_sink *fs = (struct file_sink *) s;
+
+  if (fs->fp)
+    fclose(fs->fp);
+  free(fs);
+}
+
+struct sink *sink_file(const char *name)
+{
+  struct file_sink *fs = malloc(sizeof *fs);
+
+  if (!fs)
+    return NULL;
+  fs->fp = fopen(name, "wb");
+  if (!fs->fp) {
+    free(fs);
+    return NULL;
+  }
+  fs->err = false;
+  fs->base.write = &file_write;
+  fs->base.finish = &file_finish;
+  fs->base.release = &file_release;
+  fs->base.down = NULL;
+  fs->base.bytes = 0;
+  return &fs->base;
+}
+
+
+/* Asynchronous output uses this many buffers of this size. */
+#define ASYNC_BUFS 2
+#define ASYNC_SIZE (1024 * 1024)
+
+struct async_buf {
+  char *data;
+  size_t len;
+  off_t off;
+  int busy;
+};
+
+struct async_sink {
+  struct sink base;
+  int fd;
+  off_t pos;
+  int reserved, err, closed;
+
+  /* The buffer being filled */
+  size_t cur;
+  struct async_buf buf[ASYNC_BUFS];
+
+#if HAVE_LIBURING
+  /* Writes are submitted to the kernel directly, if possible. */
+  int uring;
+  struct io_uring ring;
+#endif
+
+  /* Otherwise, a thread writes the buffers in order. */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t full, empty;
+  size_t next;
+  int closing;
+};
+
+static int async_pwrite(int fd, const char *p, size_t n, off_t off)
+{
+  while (n > 0) {
+    ssize_t rc = pwrite(fd, p, n, off);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += rc;
+    n -= rc;
+    off += rc;
+  }
+  return 0;
+}
+
+static void *async_main(void *ctxt)
+{
+  struct async_sink *as = ctxt;
+
+  pthread_mutex_lock(&as->lock);
+  for (;;) {
+    struct async_buf *b = &as->buf[as->next];
+    int rc;
+
+    while (!b->busy && !as->closing)
+      pthread_cond_wait(&as->full, &as->lock);
+    if (!b->busy)
+      break;
+    pthread_mutex_unlock(&as->lock);
+
+    rc = async_pwrite(as->fd, b->data, b->len, b->off);
+
+    pthread_mutex_lock(&as->lock);
+    if (rc < 0)
+      as->err = true;
+    b->busy = false;
+    as->next = (as->next + 1) % ASYNC_BUFS;
+    pthread_cond_signal(&as->empty);
+  }
+  pthread_mutex_unlock(&as->lock);
+  return NULL;
+}
+
+#if HAVE_LIBURING
+/* Wait for one write to complete, and resubmit whatever of it was
+   left over. */
+static void async_reap(struct async_sink *as)
+{
+  struct io_uring_cqe *cqe;
+  struct async_buf *b;
+  int res;
+
+  if (io_uring_wait_cqe(&as->ring, &cqe) < 0) {
+    /* Nothing more can be known about the outstanding writes. */
+    as->err = true;
+    for (size_t i = 0; i < ASYNC_BUFS; i++)
+      as->buf[i].busy = false;
+    return;
+  }
+  b = io_uring_cqe_get_data(cqe);
+  res = cqe->res;
+  io_uring_cqe_seen(&as->ring, cqe);
+
+  if (res < 0 && res != -EINTR && res != -EAGAIN) {
+    as->err = true;
+    b->busy = false;
+  } else if (res >= 0 && (size_t) res == b->len) {
+    b->busy = false;
+  } else {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&as->ring);
+    if (res > 0) {
+      memmove(b->data, b->data + res, b->len - res);
+      b->len -= res;
+      b->off += res;
+    }
+    if (!sqe) {
+      if (async_pwrite(as->fd, b->data, b->len, b->off) < 0)
+        as->err = true;
+      b->busy = false;
+      return;
+    }
+    io_uring_prep_write(sqe, as->fd, b->data, b->len, b->off);
+    io_uring_sqe_set_data(sqe, b);
+    io_uring_submit(&as->ring);
+  }
+}
+#endif
+
+/* Has any write failed?  The writer thread records its failures
+   under the lock. */
+static int async_failed(struct async_sink *as)
+{
+  int err;
+
+#if HAVE_LIBURING
+  if (as->uring)
+    return as->err;
+#endif
+  pthread_mutex_lock(&as->lock);
+  err = as->err;
+  pthread_mutex_unlock(&as->lock);
+  return err;
+}
+
+/* Pass the current buffer to the writer, and wait for the next to
+   become free. */
+static void async_submit(struct async_sink *as)
+{
+  struct async_buf *b = &as->buf[as->cur];
+
+  if (b->len > 0) {
+    b->off = as->pos;
+    as->pos += b->len;
+#if HAVE_LIBURING
+    if (as->uring) {
+      struct io_uring_sqe *sqe = io_uring_get_sqe(&as->ring);
+      b->busy = true;
+      if (sqe) {
+        io_uring_prep_write(sqe, as->fd, b->data, b->len, b->off);
+        io_uring_sqe_set_data(sqe, b);
+        io_uring_submit(&as->ring);
+      } else {
+        if (async_pwrite(as->fd, b->data, b->len, b->off) < 0)
+          as->err = true;
+        b->busy = false;
+      }
+    } else
+#endif
+    {
+      pthread_mutex_lock(&as->lock);
+      b->busy = true;
+      pthread_cond_signal(&as->full);
+      pthread_mutex_unlock(&as->lock);
+    }
+    as->cur = (as->cur + 1) % ASYNC_BUFS;
+  }
+
+  b = &as->buf[as->cur];
+#if HAVE_LIBURING
+  if (as->uring) {
+    while (b->busy)
+      async_reap(as);
+  } else
+#endif
+  {
+    pthread_mutex_lock(&as->lock);
+    while (b->busy)
+      pthread_cond_wait(&as->empty, &as->lock);
+    pthread_mutex_unlock(&as->lock);
+  }
+  b->len = 0;
+}
+
+static int async_write(struct sink *s, const void *p, size_t n)
+{
+  struct async_sink *as = (struct async_sink *) s;
+  const char *q = p;
+
+  while (n > 0) {
+    struct async_buf *b = &as->buf[as->cur];
+    size_t rem = ASYNC_SIZE - b->len;
+    if (rem > n)
+      rem = n;
+    memcpy(b->data + b->len, q, rem);
+    b->len += rem;
+    q += rem;
+    n -= rem;
+    if (b->len == ASYNC_SIZE)
+      async_submit(as);
+  }
+  return async_failed(as) ? -1 : 0;
+}
+
+static int async_finish(struct sink *s)
+{
+  struct async_sink *as = (struct async_sink *) s;
+
+  if (as->closed)
+    return async_failed(as) ? -1 : 0;
+  as->closed = true;
+
+  /* Write out the partial buffer, and wait for everything. */
+  async_submit(as);
+#if HAVE_LIBURING
+  if (as->uring) {
+    for (size_t i = 0; i < ASYNC_BUFS; i++)
+      while (as->buf[i].busy)
+        async_reap(as);
+    io_uring_queue_exit(&as->ring);
+  } else
+#endif
+  {
+    pthread_mutex_lock(&as->lock);
+    as->closing = true;
+    pthread_cond_signal(&as->full);
+    pthread_mutex_unlock(&as->lock);
+    pthread_join(as->thread, NULL);
+  }
+
+  /* Give back any space reserved but not used. */
+  if (as->reserved && ftruncate(as->fd, as->pos) < 0)
+    as->err = true;
+  if (close(as->fd) < 0)
+    as->err = true;
+  return async_failed(as) ? -1 : 0;
+}
+
+static void async_release(struct sink *s)
+{
+  struct async_sink *as = (struct async_sink *) s;
+
+  async_finish(s);
+#if HAVE_LIBURING
+  if (!as->uring)
+#endif
+  {
+    pthread_cond_destroy(&as->empty);
+    pthread_cond_destroy(&as->full);
+    pthread_mutex_destroy(&as->lock);
+  }
+  for (size_t i = 0; i < ASYNC_BUFS; i++)
+    free(as->buf[i].data);
+  free(as);
+}
+
+struct sink *sink_async(const char *name, unsigned long long estimate)
+{
+  struct async_sink *as = malloc(sizeof *as);
+
+  if (!as)
+    return NULL;
+  for (size_t i = 0; i < ASYNC_BUFS; i++) {
+    as->buf[i].len = 0;
+    as->buf[i].busy = false;
+    as->buf[i].data = malloc(ASYNC_SIZE);
+    if (!as->buf[i].data) {
+      while (i-- > 0)
+        free(as->buf[i].data);
+      free(as);
+      return NULL;
+    }
+  }
+
+  as->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (as->fd < 0) {
+    for (size_t i = 0; i < ASYNC_BUFS; i++)
+      free(as->buf[i].data);
+    free(as);
+    return NULL;
+  }
+
+  as->reserved = false;
+#if _POSIX_ADVISORY_INFO > 0
+  if (estimate > 0)
+    as->reserved = posix_fallocate(as->fd, 0, estimate) == 0;
+#else
+  (void) estimate;
+#endif
+
+  as->pos = 0;
+  as->cur = as->next = 0;
+  as->err = as->closed = as->closing = false;
+  as->base.write = &async_write;
+  as->base.finish = &async_finish;
+  as->base.release = &async_release;
+  as->base.down = NULL;
+  as->base.bytes = 0;
+
+#if HAVE_LIBURING
+  as->uring = io_uring_queue_init(ASYNC_BUFS * 2, &as->ring, 0) == 0;
+  if (as->uring)
+    return &as->base;
+#endif
+
+  pthread_mutex_init(&as->lock, NULL);
+  pthread_cond_init(&as->full, NULL);
+  pthread_cond_init(&as->empty, NULL);
+  if (pthread_create(&as->thread, NULL, &async_main, as) != 0) {
+    pthread_cond_destroy(&as->empty);
+    pthread_cond_destroy(&as->full);
+    pthread_mutex_destroy(&as->lock);
+    close(as->fd);
+    for (size_t i = 0; i < ASYNC_BUFS; i++)
+      free(as->buf[i].data);
+    free(as);
+    return NULL;
+  }
+  return &as->base;
+}
+
+
+/* Blocks waiting to be compressed are queued in a ring of this many
+   slots.  The writer waits when they are all full. */
+#define GZIP_SLOTS 4
+
+/* Compressed output is passed on in chunks of this size. */
+#define GZIP_CHUNK (64 * 1024)
+
+struct gzip_block {
+  char *data;
+  size_t len, cap;
+};
+
+struct gzip_sink {
+  struct sink base;
+  z_stream zs;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t more, room;
+  struct gzip_block slot[GZIP_SLOTS];
+  size_t head, count;
+  int closing, err;
+  unsigned char out[GZIP_CHUNK];
+};
+
+/* Compress some input, or finish the stream, passing on whatever
+   comes out. */
+static int gzip_deflate(struct gzip_sink *gs, const void *p, size_t n,
+                        int flush)
+{
+  int rc;
+
+  gs->zs.next_in = (Bytef *) p;
+  gs->zs.avail_in = n;
+  do {
+    gs->zs.next_out = gs->out;
+    gs->zs.avail_out = sizeof gs->out;
+    rc = deflate(&gs->zs, flush);
+    if (rc == Z_STREAM_ERROR)
+      return -1;
+    if (gs->zs.avail_out < sizeof gs->out &&
+        sink_write(gs->base.down, gs->out,
+                   sizeof gs->out - gs->zs.avail_out) < 0)
+      return -1;
+  } while (gs->zs.avail_out == 0 ||
+           (flush == Z_FINISH && rc != Z_STREAM_END));
+  return 0;
+}
+
+static void *gzip_main(void *ctxt)
+{
+  struct gzip_sink *gs = ctxt;
+  struct gzip_block mine = { NULL, 0, 0 };
+  int err = false;
+
+  for (;;) {
+    struct gzip_block tmp;
+
+    pthread_mutex_lock(&gs->lock);
+    while (gs->count == 0 && !gs->closing)
+      pthread_cond_wait(&gs->more, &gs->lock);
+    if (gs->count == 0) {
+      pthread_mutex_unlock(&gs->lock);
+      break;
+    }
+
+    /* Swap the full block for our empty one, and release the slot. */
+    tmp = gs->slot[gs->head];
+    gs->slot[gs->head] = mine;
+    gs->slot[gs->head].len = 0;
+    mine = tmp;
+    gs->head = (gs->head + 1) % GZIP_SLOTS;
+    gs->count--;
+    pthread_cond_signal(&gs->room);
+    pthread_mutex_unlock(&gs->lock);
+
+    if (!err && gzip_deflate(gs, mine.data, mine.len, Z_NO_FLUSH) < 0)
+      err = true;
+  }
+
+  if (!err && gzip_deflate(gs, NULL, 0, Z_FINISH) < 0)
+    err = true;
+  free(mine.data);
+
+  pthread_mutex_lock(&gs->lock);
+  gs->err = err;
+  pthread_mutex_unlock(&gs->lock);
+  return NULL;
+}
+
+static int gzip_write(struct sink *s, const void *p, size_t n)
+{
+  struct gzip_sink *gs = (struct gzip_sink *) s;
+  struct gzip_block *b;
+  int rc = 0;
+
+  pthread_mutex_lock(&gs->lock);
+  while (gs->count == GZIP_SLOTS)
+    pthread_cond_wait(&gs->room, &gs->lock);
+  b = &gs->slot[(gs->head + gs->count) % GZIP_SLOTS];
+  if (b->cap < n) {
+    void *nb = realloc(b->data, n);
+    if (!nb) {
+      rc = -1;
+      goto done;
+    }
+    b->data = nb;
+    b->cap = n;
+  }
+  memcpy(b->data, p, n);
+  b->len = n;
+  gs->count++;
+  pthread_cond_signal(&gs->more);
+ done:
+  pthread_mutex_unlock(&gs->lock);
+  return rc;
+}
+
+static int gzip_finish(struct sink *s)
+{
+  struct gzip_sink *gs = (struct gzip_sink *) s;
+
+  if (gs->closing)
+    return gs->err ? -1 : 0;
+
+  pthread_mutex_lock(&gs->lock);
+  gs->closing = true;
+  pthread_cond_signal(&gs->more);
+  pthread_mutex_unlock(&gs->lock);
+  pthread_join(gs->thread, NULL);
+  return gs->err ? -1 : 0;
+}
+
+static void gzip_release(struct sink *s)
+{
+  struct gzip_sink *gs = (struct gzip_sink *) s;
+
+  gzip_finish(s);
+  deflateEnd(&gs->zs);
+  pthread_cond_destroy(&gs->room);
+  pthread_cond_destroy(&gs->more);
+  pthread_mutex_destroy(&gs->lock);
+  for (size_t i = 0; i < GZIP_SLOTS; i++)
+    free(gs->slot[i].data);
+  free(gs);
+}
+
+struct sink *sink_gzip(struct sink *down, int level)
+{
+  struct gzip_sink *gs = malloc(sizeof *gs);
+
+  if (!gs)
+    return NULL;
+  memset(&gs->zs, 0, sizeof gs->zs);
+  /* Add 16 to the window size to get a gzip wrapper. */
+  if (deflateInit2(&gs->zs, level, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    free(gs);
+    return NULL;
+  }
+  for (size_t i = 0; i < GZIP_SLOTS; i++) {
+    gs->slot[i].data = NULL;
+    gs->slot[i].len = gs->slot[i].cap = 0;
+  }
+  gs->head = gs->count = 0;
+  gs->closing = gs->err = false;
+  gs->base.write = &gzip_write;
+  gs->base.finish = &gzip_finish;
+  gs->base.release = &gzip_release;
+  gs->base.down = down;
+  gs->base.bytes = 0;
+  pthread_mutex_init(&gs->lock, NULL);
+  pthread_cond_init(&gs->more, NULL);
+  pthread_cond_init(&gs->room, NULL);
+  if (pthread_create(&gs->thread, NULL, &gzip_main, gs) != 0) {
+    pthread_cond_destroy(&gs->room);
+    pthread_cond_destroy(&gs->more);
+    pthread_mutex_destroy(&gs->lock);
+    deflateEnd(&gs->zs);
+    free(gs);
+    return NULL;
+  }
+  return &gs->base;
+}
@@ -0,0 +1,64 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+
+/* A sink accepts the final bytes of output.  Some sinks transform
+   their input, and pass it on to another sink. */
+struct sink {
+  int (*write)(struct sink *, const void *, size_t);
+  int (*finish)(struct sink *);
+  void (*release)(struct sink *);
+  struct sink *down;
+
+  /* Bytes accepted so far */
+  unsigned long long bytes;
+};
+
+/* Write to a file, which is created or truncated. */
+struct sink *sink_file(const char *name);
+
+/* Write to a file through a set of large buffers, which a background
+   writer empties while the caller fills the next.  If 'estimate' is
+   non-zero, space for that many bytes is reserved in advance. */
+struct sink *sink_async(const char *name, unsigned long long estimate);
+
+/* Compress to gzip format on a separate thread, and pass the result
+   on to 'down', which then belongs to the new sink. */
+struct sink *sink_gzip(struct sink *down, int level);
+
+/* Return -1 on error. */
+int sink_write(struct sink *, const void *, size_t);
+
+/* Flush all pending output through the chain.  Return -1 if any
+   error has occurred. */
+int sink_finish(struct sink *);
+
+/* Release the sink and those below it. */
+void sink_free(struct sink *);
+
+#endif
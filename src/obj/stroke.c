@@ -0,0 +1,658 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "context.h"
+#include "nomem.h"
+#include "stroke.h"
+
+/* The default stroke-miterlimit, beyond which SVG bevels a join */
+#define MITRE_LIMIT 4.0
+
+/* Segments meeting at a smaller sine than this are joined straight
+   across, as the join would be too small to see */
+#define SMOOTH_TURN 0.05
+
+/* Curves are flattened into no more steps than this */
+#define MAX_STEPS 1024
+
+#define HALF_PI 1.57079632679489661923
+
+void stroke_init(struct stroke *s, const int *d, double thin)
+{
+  s->width = d[8] ? d[8] : thin;
+  s->join = d[9] & 3;
+  s->end_cap = (d[9] >> 2) & 3;
+  s->start_cap = (d[9] >> 4) & 3;
+  s->tri_width = s->width * ((d[9] >> 16) & 0xff) / 16.0;
+  s->tri_length = s->width * ((d[9] >> 24) & 0xff) / 16.0;
+  if ((d[9] >> 7) & 1) {
+    s->dash_offset = d[10];
+    s->ndash = d[11];
+    s->dash = d + 12;
+  } else {
+    s->dash_offset = s->ndash = 0;
+    s->dash = NULL;
+  }
+}
+
+/* One subpath's points, with curves flattened */
+struct walk {
+  /* Elements still to be read, and the end of the subpath */
+  const int *p, *e;
+
+  /* The current point, and where the subpath started */
+  double x, y, sx, sy;
+
+  /* The closing line is still to come. */
+  int closed;
+
+  /* The curve being flattened, and the steps taken along it */
+  double flatness;
+  double cx[4], cy[4];
+  int k, n;
+};
+
+/* Find the next subpath with something to draw from 'p', and start to
+   walk along it.  Return where to look for the one after, or null if
+   there are no more.  A subpath ends at a close, and what follows
+   starts from the same point. */
+static const int *walk_start(struct walk *w, const int *p, const int *e,
+                             double flatness)
+{
+  const int *q;
+
+  while (p < e && (p[0] == 2 || p[0] == 5)) {
+    if (p[0] == 2) {
+      w->sx = p[1];
+      w->sy = p[2];
+      p += 3;
+    } else {
+      p++;
+    }
+  }
+  if (p >= e || (p[0] != 6 && p[0] != 8))
+    return NULL;
+
+  for (q = p; q < e && (q[0] == 6 || q[0] == 8); q += q[0] == 6 ? 7 : 3)
+    ;
+  w->p = p;
+  w->e = q;
+  w->x = w->sx;
+  w->y = w->sy;
+  w->closed = q < e && q[0] == 5;
+  w->flatness = flatness;
+  w->k = w->n = 0;
+  return w->closed ? q + 1 : q;
+}
+
+/* Get the next point along a subpath, or return false at its end. */
+static int walk_next(struct walk *w, double *x, double *y)
+{
+  while (w->k >= w->n) {
+    if (w->p < w->e) {
+      const int *p = w->p;
+      double dx, dy, dd;
+
+      if (p[0] == 8) {
+        w->p += 3;
+        *x = w->x = p[1];
+        *y = w->y = p[2];
+        return true;
+      }
+
+      /* Take enough steps along a curve that none strays further
+         than the flatness from it, by Wang's formula. */
+      w->cx[0] = w->x;
+      w->cy[0] = w->y;
+      for (int i = 1; i < 4; i++) {
+        w->cx[i] = p[2 * i - 1];
+        w->cy[i] = p[2 * i];
+      }
+      w->p += 7;
+      dx = w->cx[0] - 2.0 * w->cx[1] + w->cx[2];
+      dy = w->cy[0] - 2.0 * w->cy[1] + w->cy[2];
+      dd = dx * dx + dy * dy;
+      dx = w->cx[1] - 2.0 * w->cx[2] + w->cx[3];
+      dy = w->cy[1] - 2.0 * w->cy[2] + w->cy[3];
+      if (dx * dx + dy * dy > dd)
+        dd = dx * dx + dy * dy;
+      dd = ceil(sqrt(0.75 * sqrt(dd) / w->flatness));
+      w->n = dd < 1.0 ? 1 : dd > MAX_STEPS ? MAX_STEPS : (int) dd;
+      w->k = 0;
+    } else if (w->closed) {
+      w->closed = false;
+      *x = w->x = w->sx;
+      *y = w->y = w->sy;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  if (++w->k == w->n) {
+    w->x = w->cx[3];
+    w->y = w->cy[3];
+  } else {
+    double t = (double) w->k / w->n, m = 1.0 - t;
+    w->x = m * m * m * w->cx[0] +
+      3.0 * m * t * (m * w->cx[1] + t * w->cx[2]) + t * t * t * w->cx[3];
+    w->y = m * m * m * w->cy[0] +
+      3.0 * m * t * (m * w->cy[1] + t * w->cy[2]) + t * t * t * w->cy[3];
+  }
+  *x = w->x;
+  *y = w->y;
+  return true;
+}
+
+/* The position along a dash pattern */
+struct dasher {
+  const struct stroke *s;
+
+  /* The dash or gap reached, counting round the pattern twice, so
+     that an odd number of lengths alternate between dash and gap */
+  int phase;
+
+  /* How much of it is still to come */
+  double left;
+};
+
+static double dash_len(const struct stroke *s, int phase)
+{
+  int l = s->dash[phase % s->ndash];
+  return l > 0 ? l : 0.0;
+}
+
+/* Is there a pattern to follow? */
+static int dash_usable(const struct stroke *s)
+{
+  double total = 0.0;
+
+  if (!s->dash || s->ndash <= 0)
+    return false;
+  for (int i = 0; i < s->ndash; i++)
+    total += dash_len(s, i);
+  return total > 0.0;
+}
+
+static int dash_on(const struct dasher *ds)
+{
+  return !(ds->phase & 1);
+}
+
+static void dash_next(struct dasher *ds)
+{
+  ds->phase = (ds->phase + 1) % (2 * ds->s->ndash);
+  ds->left = dash_len(ds->s, ds->phase);
+}
+
+/* Start the pattern again, as at the start of each subpath, skipping
+   the offset into it. */
+static void dash_reset(struct dasher *ds, const struct stroke *s)
+{
+  double period = 0.0, off;
+
+  for (int i = 0; i < s->ndash; i++)
+    period += dash_len(s, i);
+  if (s->ndash % 2)
+    period *= 2.0;
+  off = fmod((double) s->dash_offset, period);
+  if (off < 0.0)
+    off += period;
+
+  ds->s = s;
+  ds->phase = 0;
+  ds->left = dash_len(s, 0);
+  while (off >= ds->left) {
+    off -= ds->left;
+    dash_next(ds);
+  }
+  ds->left -= off;
+}
+
+/* Get the direction of a segment from (x, y) to (nx, ny), returning
+   its length. */
+static double unit(double x, double y, double nx, double ny,
+                   double *ux, double *uy)
+{
+  double l = hypot(nx - x, ny - y);
+
+  if (l > 0.0) {
+    *ux = (nx - x) / l;
+    *uy = (ny - y) / l;
+  }
+  return l;
+}
+
+/* Find the caps of an undashed open subpath from the directions of
+   its first and last elements.  One that goes nowhere is taken to
+   point along the x axis. */
+static void end_caps(const struct stroke *s, const struct walk *w,
+                     stroke_cap_fn *fn, void *ctx)
+{
+  double x = w->sx, y = w->sy;
+  double sx = 1.0, sy = 0.0, ex = 1.0, ey = 0.0;
+  int found = false;
+
+  for (const int *p = w->p; p < w->e; p += p[0] == 6 ? 7 : 3) {
+    int n = p[0] == 6 ? 3 : 1;
+    double nx = p[2 * n - 1], ny = p[2 * n];
+
+    /* A curve leaves towards its first control point that isn't where
+       it starts, and arrives from the last that isn't where it
+       ends. */
+    if (!found) {
+      for (int i = 0; i < n; i++)
+        if (unit(x, y, p[2 * i + 1], p[2 * i + 2], &sx, &sy) > 0.0) {
+          found = true;
+          break;
+        }
+    }
+    unit(x, y, nx, ny, &ex, &ey);
+    for (int i = n - 2; i >= 0; i--)
+      if (unit(p[2 * i + 1], p[2 * i + 2], nx, ny, &ex, &ey) > 0.0)
+        break;
+    x = nx;
+    y = ny;
+  }
+
+  if (s->start_cap != 0)
+    fn(ctx, s, s->start_cap, w->sx, w->sy, -sx, -sy);
+  if (s->end_cap != 0)
+    fn(ctx, s, s->end_cap, x, y, ex, ey);
+}
+
+/* Find the caps at the ends of each dash of a subpath. */
+static void dash_caps(const struct stroke *s, struct walk *w,
+                      stroke_cap_fn *fn, void *ctx)
+{
+  struct dasher ds;
+  double x = w->sx, y = w->sy, nx, ny, ux = 1.0, uy = 0.0;
+  int pending, moved = false;
+
+  dash_reset(&ds, s);
+  pending = dash_on(&ds);
+  while (walk_next(w, &nx, &ny)) {
+    double l = unit(x, y, nx, ny, &ux, &uy), pos = 0.0;
+
+    if (l <= 0.0)
+      continue;
+    if (pending && s->start_cap != 0)
+      fn(ctx, s, s->start_cap, x, y, -ux, -uy);
+    pending = false;
+    while (l - pos > ds.left) {
+      int cap = dash_on(&ds) ? s->end_cap : s->start_cap;
+      double dir = dash_on(&ds) ? 1.0 : -1.0;
+
+      pos += ds.left;
+      if (cap != 0)
+        fn(ctx, s, cap, x + ux * pos, y + uy * pos, dir * ux, dir * uy);
+      dash_next(&ds);
+    }
+    ds.left -= l - pos;
+    x = nx;
+    y = ny;
+    moved = true;
+  }
+  if (moved && dash_on(&ds) && s->end_cap != 0)
+    fn(ctx, s, s->end_cap, x, y, ux, uy);
+}
+
+void stroke_caps(const struct stroke *s, const int *p, const int *e,
+                 double flatness, stroke_cap_fn *fn, void *ctx)
+{
+  struct walk w;
+  int dashed = dash_usable(s);
+
+  w.sx = w.sy = 0.0;
+  while ((p = walk_start(&w, p, e, flatness)) != NULL) {
+    if (dashed)
+      dash_caps(s, &w, fn, ctx);
+    else if (!w.closed)
+      end_caps(s, &w, fn, ctx);
+  }
+}
+
+void stroke_space_init(struct stroke_space *sp)
+{
+  sp->v = NULL;
+  sp->n = sp->cap = 0;
+  sp->pt = sp->dpt = NULL;
+  sp->npt = sp->ptcap = sp->ndpt = sp->dptcap = 0;
+}
+
+void stroke_space_free(struct stroke_space *sp)
+{
+  free(sp->v);
+  free(sp->pt);
+  free(sp->dpt);
+}
+
+/* Add a point to a list of them, unless it's the same as the last. */
+static void add_point(double **pt, size_t *n, size_t *cap,
+                      double x, double y)
+{
+  if (*n > 0 && (*pt)[2 * *n - 2] == x && (*pt)[2 * *n - 1] == y)
+    return;
+  if (*n == *cap) {
+    size_t nc = *cap ? *cap * 2 : 64;
+    double *np = realloc(*pt, nc * 2 * sizeof *np);
+    if (!np) nomem();
+    *pt = np;
+    *cap = nc;
+  }
+  (*pt)[2 * *n] = x;
+  (*pt)[2 * *n + 1] = y;
+  ++*n;
+}
+
+/* An outline being written */
+struct outline {
+  struct stroke_space *sp;
+  const struct stroke *s;
+
+  /* Half the line's width */
+  double h;
+
+  /* The last point written */
+  int x, y;
+};
+
+static void put(struct outline *o, int n, const int *v)
+{
+  struct stroke_space *sp = o->sp;
+
+  if (sp->n + n > sp->cap) {
+    size_t nc = sp->cap ? sp->cap * 2 : 256;
+    int *nv;
+    while (nc < sp->n + n)
+      nc *= 2;
+    nv = realloc(sp->v, nc * sizeof *nv);
+    if (!nv) nomem();
+    sp->v = nv;
+    sp->cap = nc;
+  }
+  for (int i = 0; i < n; i++)
+    sp->v[sp->n++] = v[i];
+}
+
+static void put_code(struct outline *o, int code)
+{
+  put(o, 1, &code);
+}
+
+static void put_point(struct outline *o, int code, double x, double y)
+{
+  int v[3];
+
+  v[0] = code;
+  v[1] = (int) floor(x + 0.5);
+  v[2] = (int) floor(y + 0.5);
+  if (code == 8 && v[1] == o->x && v[2] == o->y)
+    return;
+  put(o, 3, v);
+  o->x = v[1];
+  o->y = v[2];
+}
+
+static void put_curve(struct outline *o, const double *c)
+{
+  int v[7];
+
+  v[0] = 6;
+  for (int i = 0; i < 6; i++)
+    v[i + 1] = (int) floor(c[i] + 0.5);
+  put(o, 7, v);
+  o->x = v[5];
+  o->y = v[6];
+}
+
+/* Sweep an arc of radius 'r' clockwise by 'angle' around (x, y), from
+   the direction (ux, uy), in curves of no more than a right
+   angle. */
+static void put_arc(struct outline *o, double x, double y, double r,
+                    double ux, double uy, double angle)
+{
+  int k = (int) ceil(angle / HALF_PI - 1e-9);
+  double step, kappa, t0 = atan2(uy, ux);
+
+  if (k < 1) k = 1;
+  step = angle / k;
+  kappa = 4.0 / 3.0 * tan(step / 4.0);
+  for (int i = 0; i < k; i++, t0 -= step) {
+    double t1 = t0 - step, c[6];
+    double s0 = sin(t0), c0 = cos(t0), s1 = sin(t1), c1 = cos(t1);
+
+    c[0] = x + r * (c0 + kappa * s0);
+    c[1] = y + r * (s0 - kappa * c0);
+    c[2] = x + r * (c1 - kappa * s1);
+    c[3] = y + r * (s1 + kappa * c1);
+    c[4] = x + r * c1;
+    c[5] = y + r * s1;
+    put_curve(o, c);
+  }
+}
+
+/* Join segments meeting at (x, y), on their left, arriving along
+   (ax, ay), leaving along (bx, by), and 'la' and 'lb' long.  The
+   outline is the sum of a box around each segment and a wedge at each
+   join, all turning the same way, so where they overlap the non-zero
+   rule fills them once.  On the inside of a turn, the outline goes
+   back through the point to keep to that sum, unless the turn is so
+   small that the boxes meet beyond it anyway. */
+static void put_join(struct outline *o, double x, double y,
+                     double ax, double ay, double la,
+                     double bx, double by, double lb)
+{
+  double h = o->h;
+  double cross = ax * by - ay * bx, dot = ax * bx + ay * by;
+
+  if (dot > 0.0 && fabs(cross) < SMOOTH_TURN &&
+      (cross <= 0.0 || (la >= h * cross && lb >= h * cross))) {
+    put_point(o, 8, x - h * by, y + h * bx);
+    return;
+  }
+  if (cross > 0.0) {
+    put_point(o, 8, x, y);
+  } else {
+    switch (o->s->join) {
+    case 0:
+      /* The mitre is as long as the line is wide over the sine of
+         half the angle between the segments. */
+      if ((1.0 + dot) * MITRE_LIMIT * MITRE_LIMIT >= 2.0) {
+        put_point(o, 8, x - h * (ay + by) / (1.0 + dot),
+                  y + h * (ax + bx) / (1.0 + dot));
+      }
+      break;
+    case 1: {
+      double angle = atan2(-cross, dot);
+      if (angle <= 0.0)
+        angle += 4.0 * HALF_PI;
+      put_arc(o, x, y, h, -ay, ax, angle);
+    } break;
+    }
+  }
+  put_point(o, 8, x - h * by, y + h * bx);
+}
+
+/* Draw a cap at (x, y), facing (ux, uy), from its left to its
+   right. */
+static void put_cap(struct outline *o, int cap, double x, double y,
+                    double ux, double uy)
+{
+  double h = o->h, nx = -uy, ny = ux;
+
+  switch (cap) {
+  case 1:
+    put_arc(o, x, y, h, nx, ny, 2.0 * HALF_PI);
+    break;
+  case 2:
+    put_point(o, 8, x + h * (nx + ux), y + h * (ny + uy));
+    put_point(o, 8, x + h * (ux - nx), y + h * (uy - ny));
+    break;
+  case 3:
+    put_point(o, 8, x + o->s->tri_width * nx, y + o->s->tri_width * ny);
+    put_point(o, 8, x + o->s->tri_length * ux, y + o->s->tri_length * uy);
+    put_point(o, 8, x - o->s->tri_width * nx, y - o->s->tri_width * ny);
+    break;
+  }
+  put_point(o, 8, x - h * nx, y - h * ny);
+}
+
+/* Follow the left of 'm' points, or of them in reverse, joining each
+   segment to the next, and the last to the first if closed, and
+   starting with a move if 'first'. */
+static void put_side(struct outline *o, const double *pt, size_t m,
+                     int rev, int closed, int first)
+{
+  size_t nseg = closed ? m : m - 1;
+  double ax = 1.0, ay = 0.0, la, bx = 1.0, by = 0.0, lb;
+  const double *a, *b;
+
+#define POINT(I) (pt + 2 * (rev ? m - 1 - (I) % m : (I) % m))
+  a = POINT(0);
+  b = POINT(1);
+  la = unit(a[0], a[1], b[0], b[1], &ax, &ay);
+  put_point(o, first ? 2 : 8, a[0] - o->h * ay, a[1] + o->h * ax);
+  for (size_t i = 0; i < nseg; i++) {
+    a = POINT(i + 1);
+    put_point(o, 8, a[0] - o->h * ay, a[1] + o->h * ax);
+    if (i + 1 == nseg && !closed)
+      break;
+    b = POINT(i + 2);
+    lb = unit(a[0], a[1], b[0], b[1], &bx, &by);
+    put_join(o, a[0], a[1], ax, ay, la, bx, by, lb);
+    ax = bx;
+    ay = by;
+    la = lb;
+  }
+#undef POINT
+}
+
+/* Outline an open line through 'm' points, with caps.  A single point
+   has its caps facing along (ux, uy). */
+static void put_open(struct outline *o, const double *pt, size_t m,
+                     double ux, double uy)
+{
+  const struct stroke *s = o->s;
+  double sx = ux, sy = uy, ex = ux, ey = uy;
+
+  if (m == 0 || (m == 1 && s->start_cap == 0 && s->end_cap == 0))
+    return;
+  if (m > 1) {
+    unit(pt[0], pt[1], pt[2], pt[3], &sx, &sy);
+    unit(pt[2 * m - 4], pt[2 * m - 3], pt[2 * m - 2], pt[2 * m - 1],
+         &ex, &ey);
+    put_side(o, pt, m, false, false, true);
+  } else {
+    put_point(o, 2, pt[0] - o->h * ey, pt[1] + o->h * ex);
+  }
+  put_cap(o, s->end_cap, pt[2 * m - 2], pt[2 * m - 1], ex, ey);
+  if (m > 1)
+    put_side(o, pt, m, true, false, false);
+  put_cap(o, s->start_cap, pt[0], pt[1], -sx, -sy);
+  put_code(o, 5);
+}
+
+/* Outline each dash along 'm' points. */
+static void put_dashes(struct outline *o, const double *pt, size_t m)
+{
+  struct stroke_space *sp = o->sp;
+  struct dasher ds;
+  double ux = 1.0, uy = 0.0;
+
+  dash_reset(&ds, o->s);
+  sp->ndpt = 0;
+  if (dash_on(&ds))
+    add_point(&sp->dpt, &sp->ndpt, &sp->dptcap, pt[0], pt[1]);
+  for (size_t i = 1; i < m; i++) {
+    const double *a = pt + 2 * i - 2, *b = pt + 2 * i;
+    double l = unit(a[0], a[1], b[0], b[1], &ux, &uy), pos = 0.0;
+
+    while (l - pos > ds.left) {
+      double x, y;
+
+      pos += ds.left;
+      x = a[0] + ux * pos;
+      y = a[1] + uy * pos;
+      if (dash_on(&ds)) {
+        add_point(&sp->dpt, &sp->ndpt, &sp->dptcap, x, y);
+        put_open(o, sp->dpt, sp->ndpt, ux, uy);
+      }
+      sp->ndpt = 0;
+      dash_next(&ds);
+      if (dash_on(&ds))
+        add_point(&sp->dpt, &sp->ndpt, &sp->dptcap, x, y);
+    }
+    ds.left -= l - pos;
+    if (dash_on(&ds))
+      add_point(&sp->dpt, &sp->ndpt, &sp->dptcap, b[0], b[1]);
+  }
+  if (dash_on(&ds) && m > 1)
+    put_open(o, sp->dpt, sp->ndpt, ux, uy);
+}
+
+void stroke_outline(const struct stroke *s, const int *p, const int *e,
+                    double flatness, struct stroke_space *sp)
+{
+  struct outline o;
+  struct walk w;
+  int dashed = dash_usable(s);
+  double x, y;
+
+  o.sp = sp;
+  o.s = s;
+  o.h = s->width / 2.0;
+  o.x = o.y = 0;
+  sp->n = 0;
+  w.sx = w.sy = 0.0;
+  while ((p = walk_start(&w, p, e, flatness)) != NULL) {
+    int closed = w.closed;
+
+    sp->npt = 0;
+    add_point(&sp->pt, &sp->npt, &sp->ptcap, w.sx, w.sy);
+    while (walk_next(&w, &x, &y))
+      add_point(&sp->pt, &sp->npt, &sp->ptcap, x, y);
+
+    if (dashed) {
+      put_dashes(&o, sp->pt, sp->npt);
+    } else if (!closed) {
+      put_open(&o, sp->pt, sp->npt, 1.0, 0.0);
+    } else {
+      /* A closed subpath has a loop on each side, and no caps. */
+      if (sp->npt > 1 && sp->pt[0] == sp->pt[2 * sp->npt - 2] &&
+          sp->pt[1] == sp->pt[2 * sp->npt - 1])
+        sp->npt--;
+      if (sp->npt > 1) {
+        put_side(&o, sp->pt, sp->npt, false, true, true);
+        put_code(&o, 5);
+        put_side(&o, sp->pt, sp->npt, true, true, true);
+        put_code(&o, 5);
+      }
+    }
+  }
+  put_code(&o, 0);
+}
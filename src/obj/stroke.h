@@ -0,0 +1,79 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef STROKE_H
+#define STROKE_H
+
+#include <stddef.h>
+
+/* How a path's outline is drawn, in draw units.  Caps and joins are
+   numbered as in drawfiles: butt, round, square and triangular caps;
+   mitred, round and bevelled joins.  A triangular cap reaches
+   'tri_width' either side of the line, and 'tri_length' beyond its
+   end.  The path is dashed if 'dash' is not null. */
+struct stroke {
+  double width, tri_width, tri_length;
+  int join, start_cap, end_cap;
+  int dash_offset, ndash;
+  const int *dash;
+};
+
+/* Get the outline of a path object, whose thin lines are 'thin' draw
+   units wide. */
+void stroke_init(struct stroke *s, const int *d, double thin);
+
+/* Called for each cap to be drawn at (x, y), facing away from the
+   line along the unit vector (dx, dy) */
+typedef void stroke_cap_fn(void *ctx, const struct stroke *s, int cap,
+                           double x, double y, double dx, double dy);
+
+/* Find the caps at the ends of the open subpaths of path elements
+   from 'p' to 'e', or at the ends of each dash.  The direction of an
+   undashed path's end is taken from its elements; dashes are found
+   along the path with curves flattened to within 'flatness'. */
+void stroke_caps(const struct stroke *s, const int *p, const int *e,
+                 double flatness, stroke_cap_fn *fn, void *ctx);
+
+/* Space for an outline, kept between calls */
+struct stroke_space {
+  /* The outline as path elements */
+  int *v;
+  size_t n, cap;
+
+  /* Points of the subpath and dash being outlined */
+  double *pt, *dpt;
+  size_t npt, ptcap, ndpt, dptcap;
+};
+
+void stroke_space_init(struct stroke_space *sp);
+void stroke_space_free(struct stroke_space *sp);
+
+/* Write the area covered by the outline of path elements from 'p' to
+   'e' to 'sp->v', as path elements ending with an end element, to be
+   filled with the non-zero rule.  Curves are flattened to within
+   'flatness'. */
+void stroke_outline(const struct stroke *s, const int *p, const int *e,
+                    double flatness, struct stroke_space *sp);
+
+#endif
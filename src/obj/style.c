@@ -0,0 +1,363 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "fmt.h"
+#include "nomem.h"
+#include "style.h"
+
+const char *join_str[] = { "miter", "round", "bevel", "inherit" };
+const char *cap_str[] = { "butt", "round", "square", "inherit" };
+const char *wind_str[] = { "nonzero", "evenodd" };
+
+static unsigned long mix(unsigned long h, unsigned long v)
+{
+  return (h ^ v) * 0x01000193ul;
+}
+
+static unsigned long mix_double(unsigned long h, double v)
+{
+  unsigned char b[sizeof v];
+  memcpy(b, &v, sizeof v);
+  for (size_t i = 0; i < sizeof v; i++)
+    h = mix(h, b[i]);
+  return h;
+}
+
+/* Hash only the properties that are set, so that others needn't be
+   initialized. */
+static unsigned long style_hash(const struct style *st)
+{
+  unsigned long h = mix(0x811c9dc5ul, st->set);
+
+  if (st->set & ST_STROKE)
+    h = mix(h, st->stroke);
+  if (st->set & ST_STROKE_OPACITY)
+    h = mix(h, st->stroke_opacity);
+  if (st->set & ST_LINECAP)
+    h = mix(h, st->cap);
+  if (st->set & ST_LINEJOIN)
+    h = mix(h, st->join);
+  if (st->set & ST_DASH) {
+    h = mix(h, st->dash_offset);
+    for (int i = 0; i < st->ndash; i++)
+      h = mix(h, st->dash[i]);
+  }
+  if (st->set & ST_STROKE_WIDTH)
+    h = mix_double(h, st->width);
+  if (st->set & ST_FONT_FAMILY)
+    for (const char *p = st->font; *p; p++)
+      h = mix(h, (unsigned char) *p);
+  if (st->set & ST_FONT_SIZE)
+    h = mix_double(h, st->font_size);
+  if (st->set & ST_FILL_RULE)
+    h = mix(h, st->rule);
+  if (st->set & ST_FILL_OPACITY)
+    h = mix(h, st->fill_opacity);
+  if (st->set & ST_FILL)
+    h = mix(h, st->fill);
+  if (st->set & ST_MARKER_START)
+    h = mix(h, st->marker_start);
+  if (st->set & ST_MARKER_END)
+    h = mix(h, st->marker_end);
+  return h;
+}
+
+/* Find which of the properties in 'mask' have different values in
+   two styles. */
+static unsigned style_diff(const struct style *a, const struct style *b,
+                           unsigned mask)
+{
+  unsigned diff = 0;
+
+  if ((mask & ST_STROKE) && a->stroke != b->stroke)
+    diff |= ST_STROKE;
+  if ((mask & ST_STROKE_OPACITY) && a->stroke_opacity != b->stroke_opacity)
+    diff |= ST_STROKE_OPACITY;
+  if ((mask & ST_LINECAP) && a->cap != b->cap)
+    diff |= ST_LINECAP;
+  if ((mask & ST_LINEJOIN) && a->join != b->join)
+    diff |= ST_LINEJOIN;
+  if ((mask & ST_DASH) &&
+      (a->dash_offset != b->dash_offset || a->ndash != b->ndash ||
+       memcmp(a->dash, b->dash, a->ndash * sizeof *a->dash)))
+    diff |= ST_DASH;
+  if ((mask & ST_STROKE_WIDTH) && a->width != b->width)
+    diff |= ST_STROKE_WIDTH;
+  if ((mask & ST_FONT_FAMILY) && strcmp(a->font, b->font))
+    diff |= ST_FONT_FAMILY;
+  if ((mask & ST_FONT_SIZE) && a->font_size != b->font_size)
+    diff |= ST_FONT_SIZE;
+  if ((mask & ST_FILL_RULE) && a->rule != b->rule)
+    diff |= ST_FILL_RULE;
+  if ((mask & ST_FILL_OPACITY) && a->fill_opacity != b->fill_opacity)
+    diff |= ST_FILL_OPACITY;
+  if ((mask & ST_FILL) && a->fill != b->fill)
+    diff |= ST_FILL;
+  if ((mask & ST_MARKER_START) && a->marker_start != b->marker_start)
+    diff |= ST_MARKER_START;
+  if ((mask & ST_MARKER_END) && a->marker_end != b->marker_end)
+    diff |= ST_MARKER_END;
+  return diff;
+}
+
+static int style_eq(const struct style *a, const struct style *b)
+{
+  return a->set == b->set && !style_diff(a, b, a->set);
+}
+
+void style_common(struct style *acc, const struct style *st)
+{
+  acc->set &= st->set;
+  acc->set &= ~style_diff(acc, st, acc->set);
+}
+
+void styles_init(struct styles *ss)
+{
+  ss->ents = NULL;
+  ss->n = ss->cap = 0;
+  ss->slots = NULL;
+  ss->nslots = 0;
+  ss->classes = 0;
+}
+
+void styles_free(struct styles *ss)
+{
+  free(ss->ents);
+  free(ss->slots);
+}
+
+/* Find the slot holding a style, or the empty slot where it should
+   go.  Slots hold entry numbers plus one. */
+static size_t *style_slot(const struct styles *ss, const struct style *st)
+{
+  size_t mask = ss->nslots - 1;
+  size_t i = style_hash(st) & mask;
+
+  while (ss->slots[i] && !style_eq(&ss->ents[ss->slots[i] - 1].st, st))
+    i = (i + 1) & mask;
+  return &ss->slots[i];
+}
+
+static void style_grow(struct styles *ss)
+{
+  size_t ns = ss->nslots ? ss->nslots * 2 : 64;
+  size_t *old = ss->slots, on = ss->nslots;
+
+  ss->slots = calloc(ns, sizeof *ss->slots);
+  if (!ss->slots) nomem();
+  ss->nslots = ns;
+  for (size_t i = 0; i < on; i++)
+    if (old[i])
+      *style_slot(ss, &ss->ents[old[i] - 1].st) = old[i];
+  free(old);
+}
+
+static const struct style_entry *style_find(const struct styles *ss,
+                                            const struct style *st)
+{
+  size_t *slot;
+
+  if (ss->nslots == 0)
+    return NULL;
+  slot = style_slot(ss, st);
+  return *slot ? &ss->ents[*slot - 1] : NULL;
+}
+
+void style_intern(struct styles *ss, const struct style *st)
+{
+  size_t *slot;
+
+  if ((ss->n + 1) * 2 > ss->nslots)
+    style_grow(ss);
+  slot = style_slot(ss, st);
+  if (*slot) {
+    ss->ents[*slot - 1].uses++;
+    return;
+  }
+
+  if (ss->n == ss->cap) {
+    size_t nc = ss->cap ? ss->cap * 2 : 32;
+    void *ne = realloc(ss->ents, nc * sizeof *ss->ents);
+    if (!ne) nomem();
+    ss->ents = ne;
+    ss->cap = nc;
+  }
+  ss->ents[ss->n].st = *st;
+  ss->ents[ss->n].uses = 1;
+  ss->ents[ss->n].id = 0;
+  *slot = ++ss->n;
+}
+
+void style_write(struct ws *ws, const struct style *st)
+{
+  const char *sep = "";
+
+  if (st->set & ST_STROKE) {
+    if (st->stroke == STYLE_NONE)
+      output(ws, false, "stroke: none;");
+    else
+      output_colour(ws, "stroke: ", st->stroke, ";");
+    sep = "\n";
+  }
+  if (st->set & ST_STROKE_OPACITY) {
+    output(ws, false, "%sstroke-opacity: %g;", sep, st->stroke_opacity/255.0);
+    sep = "\n";
+  }
+  if (st->set & ST_LINECAP) {
+    output(ws, false, "%sstroke-linecap: %s;", sep, cap_str[st->cap]);
+    sep = "\n";
+  }
+  if (st->set & ST_LINEJOIN) {
+    output(ws, false, "%sstroke-linejoin: %s;", sep, join_str[st->join]);
+    sep = "\n";
+  }
+  if (st->set & ST_DASH) {
+    double off;
+    output(ws, false, "%sstroke-dasharray:", sep);
+    for (int i = 0; i < st->ndash; i++) {
+      double len = map_size(ws, st->dash[i]);
+      output_nums(ws, i ? ", " : " ", 1, &len, "", "");
+    }
+    output(ws, false, ";\n");
+    off = map_size(ws, st->dash_offset);
+    output_nums(ws, "stroke-dashoffset: ", 1, &off, "", ";");
+    sep = "\n";
+  }
+  if (st->set & ST_STROKE_WIDTH) {
+    double wid = map_size(ws, st->width);
+    output(ws, false, "%sstroke-width: ", sep);
+    output_nums(ws, "", 1, &wid, "", ";");
+    sep = "\n";
+  }
+  if (st->set & ST_FONT_FAMILY) {
+    output(ws, false, "%sfont-family: \"%s\";", sep, st->font);
+    sep = "\n";
+  }
+  if (st->set & ST_FONT_SIZE) {
+    double size = map_size(ws, st->font_size);
+    output(ws, false, "%sfont-size: ", sep);
+    output_nums(ws, "", 1, &size, "", ";");
+    sep = "\n";
+  }
+  if (st->set & ST_FILL_RULE) {
+    output(ws, false, "%sfill-rule: %s;", sep, wind_str[st->rule]);
+    sep = "\n";
+  }
+  if (st->set & ST_FILL_OPACITY) {
+    output(ws, false, "%sfill-opacity: %g;", sep, st->fill_opacity/255.0);
+    sep = "\n";
+  }
+  if (st->set & ST_FILL) {
+    output(ws, false, "%s", sep);
+    if (st->fill == STYLE_NONE)
+      output(ws, false, "fill: none;");
+    else
+      output_colour(ws, "fill: ", st->fill, ";");
+    sep = "\n";
+  }
+  if (st->set & ST_MARKER_START) {
+    output(ws, false, "%smarker-start: url(#m%u);", sep, st->marker_start);
+    sep = "\n";
+  }
+  if (st->set & ST_MARKER_END)
+    output(ws, false, "%smarker-end: url(#m%u);", sep, st->marker_end);
+}
+
+void style_sheet(struct ws *ws, struct styles *ss)
+{
+  int open = false;
+
+  for (size_t i = 0; i < ss->n; i++) {
+    struct style_entry *se = &ss->ents[i];
+    char name[8 + FMT_INT_MAX], *p;
+
+    /* A class for a single element costs more than it saves. */
+    if (se->uses < 2)
+      continue;
+    if (!open) {
+      output(ws, false, "<style type='text/css'>\n");
+      ws->indent += 2;
+      open = true;
+    }
+    se->id = ++ss->classes;
+    name[0] = '.';
+    name[1] = 's';
+    p = fmt_int(name + 2, se->id);
+    p[0] = ' ';
+    p[1] = '{';
+    p[2] = ' ';
+    output_str(ws, false, name, p + 3 - name);
+    ws->indent += p + 3 - name;
+    style_write(ws, &se->st);
+    ws->indent -= p + 3 - name;
+    output(ws, false, " }\n");
+  }
+  if (open) {
+    ws->indent -= 2;
+    output(ws, false, "</style>\n");
+  }
+}
+
+/* Write a style attribute, indenting continued declarations by
+   'hang'. */
+static void attr(struct ws *ws, const struct style *st, const char *pre,
+                 const char *end, int hang)
+{
+  const struct style_entry *se = ws->styles ? style_find(ws->styles, st) : NULL;
+  struct style own;
+
+  if (se && se->id) {
+    output(ws, false, "%sclass='s%u'%s", pre, se->id, end);
+    return;
+  }
+
+  /* Leave out what the enclosing group sets. */
+  own = *st;
+  own.set &= ~ws->hoist;
+  if (!own.set) {
+    output(ws, false, "%s", end);
+    return;
+  }
+  output(ws, false, "%sstyle='", pre);
+  ws->indent += hang;
+  style_write(ws, &own);
+  ws->indent -= hang;
+  output(ws, false, "'%s", end);
+}
+
+void style_attr(struct ws *ws, const struct style *st, const char *pre,
+                const char *end)
+{
+  attr(ws, st, pre, end, 7);
+}
+
+void style_attr_flush(struct ws *ws, const struct style *st,
+                      const char *pre, const char *end)
+{
+  attr(ws, st, pre, end, 0);
+}
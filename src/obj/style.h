@@ -0,0 +1,112 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef STYLE_H
+#define STYLE_H
+
+#include <stddef.h>
+
+struct ws;
+
+extern const char *join_str[];
+extern const char *cap_str[];
+extern const char *wind_str[];
+
+/* Properties a style sets; anything else is inherited */
+#define ST_STROKE          0x001u
+#define ST_STROKE_OPACITY  0x002u
+#define ST_LINECAP         0x004u
+#define ST_LINEJOIN        0x008u
+#define ST_DASH            0x010u
+#define ST_STROKE_WIDTH    0x020u
+#define ST_FONT_FAMILY     0x040u
+#define ST_FONT_SIZE       0x080u
+#define ST_FILL_RULE       0x100u
+#define ST_FILL_OPACITY    0x200u
+#define ST_FILL            0x400u
+#define ST_MARKER_START    0x800u
+#define ST_MARKER_END     0x1000u
+
+/* A colour that paints nothing */
+#define STYLE_NONE 1ul
+
+/* The presentation of one element.  Colours are drawfile colour
+   words with the low byte cleared, opacities run from 0 to 255,
+   lengths are in draw units, and markers are numbered from 1. */
+struct style {
+  unsigned set;
+  unsigned long stroke, fill;
+  unsigned stroke_opacity, fill_opacity;
+  int cap, join, rule;
+  double width, font_size;
+  int dash_offset, ndash;
+  const int *dash;
+  const char *font;
+  unsigned marker_start, marker_end;
+};
+
+struct style_entry {
+  struct style st;
+  unsigned long uses;
+  unsigned id;
+};
+
+/* Styles seen so far, each with the number of elements using it */
+struct styles {
+  struct style_entry *ents;
+  size_t n, cap;
+  size_t *slots;
+  size_t nslots;
+  unsigned classes;
+};
+
+void styles_init(struct styles *ss);
+void styles_free(struct styles *ss);
+
+/* Count a use of a style, adding it if new. */
+void style_intern(struct styles *ss, const struct style *st);
+
+/* Write a <style> element giving a class to each style used more
+   than once. */
+void style_sheet(struct ws *ws, struct styles *ss);
+
+/* Write the declarations of a style, one per line. */
+void style_write(struct ws *ws, const struct style *st);
+
+/* Reduce 'acc' to the properties it shares with 'st'. */
+void style_common(struct style *acc, const struct style *st);
+
+/* Write a style as a class attribute if it has one, or as a style
+   attribute, after 'pre' and followed by 'end'.  Properties set by the
+   enclosing group are left out, and if none are left, only 'end' is
+   written. */
+void style_attr(struct ws *ws, const struct style *st, const char *pre,
+                const char *end);
+
+/* The same, but with continued declarations lined up with the start
+   of the attribute, as text has always been written */
+void style_attr_flush(struct ws *ws, const struct style *st,
+                      const char *pre, const char *end);
+
+#endif
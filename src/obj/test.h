@@ -0,0 +1,64 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#ifndef TEST_H
+#define TEST_H
+
+/* Checks made by the host-built tests of the portable modules.  A
+   failed check is reported, and the test carries on, failing once it
+   has finished. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef false
+#define false 0
+#endif
+
+#ifndef true
+#define true 1
+#endif
+
+static int test_failures;
+
+static void test_fail(const char *file, int line, const char *what)
+{
+  fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+  test_failures++;
+}
+
+#define CHECK(c) ((c) ? (void) 0 : test_fail(__FILE__, __LINE__, #c))
+
+/* Report the outcome, and give the exit status. */
+static int test_result(const char *name)
+{
+  if (test_failures) {
+    fprintf(stderr, "%s: %d checks failed\n", name, test_failures);
+    return EXIT_FAILURE;
+  }
+  printf("%s: passed\n", name);
+  return EXIT_SUCCESS;
+}
+
+#endif
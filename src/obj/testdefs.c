@@ -0,0 +1,152 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <string.h>
+
+#include "defs.h"
+#include "test.h"
+
+/* A path object for a w-by-h rectangle at (x, y), with a dash pattern
+   if 'dashed', in drawfile layout */
+static int *rect_path(int *d, int x, int y, int w, int h,
+                      unsigned fill, int dashed)
+{
+  int *p = d + 10;
+
+  d[0] = 2;
+  d[2] = x, d[3] = y, d[4] = x + w, d[5] = y + h;
+  d[6] = fill;
+  d[7] = 0;
+  d[8] = 0;
+  d[9] = dashed ? 1 << 7 : 0;
+  if (dashed) {
+    *p++ = 0;
+    *p++ = 2;
+    *p++ = 100;
+    *p++ = 200;
+  }
+  *p++ = 2, *p++ = x, *p++ = y;
+  *p++ = 8, *p++ = x + w, *p++ = y;
+  *p++ = 6, *p++ = x + w, *p++ = y, *p++ = x + w, *p++ = y + h;
+  *p++ = x + w, *p++ = y + h;
+  *p++ = 8, *p++ = x, *p++ = y + h;
+  *p++ = 5;
+  *p++ = 0;
+  d[1] = (p - d) * 4;
+  return p;
+}
+
+/* A group of two rectangles, with its own copy of their layout */
+static int *rect_group(int *d, int x, int y, unsigned fill, const char *name)
+{
+  int *p = d + 9;
+
+  d[0] = 6;
+  d[2] = x, d[3] = y, d[4] = x + 3000, d[5] = y + 1000;
+  memset(d + 6, ' ', 12);
+  memcpy(d + 6, name, strlen(name));
+  p = rect_path(p, x, y, 1000, 1000, fill, false);
+  p = rect_path(p, x + 2000, y, 1000, 500, 0, false);
+  d[1] = (p - d) * 4;
+  return p;
+}
+
+static void test_paths(void)
+{
+  static int a[40], b[40], c[40], e[40], f[300][40];
+  struct defs ds;
+  struct def *df;
+
+  defs_init(&ds, 32);
+  rect_path(a, 1000, 2000, 500, 300, 0x0000ff00u, false);
+  rect_path(b, -7000, 50, 500, 300, 0xff000000u, false);
+  rect_path(c, 1000, 2000, 500, 301, 0x0000ff00u, false);
+  rect_path(e, 9000, 9000, 500, 300, 0, true);
+
+  /* Translated copies match, whatever their style, and are anchored
+     at their first move. */
+  CHECK(!def_intern(&ds, DEF_PATH, a));
+  CHECK(def_intern(&ds, DEF_PATH, b));
+  CHECK(def_intern(&ds, DEF_PATH, e));
+  CHECK(!def_intern(&ds, DEF_PATH, c));
+  CHECK(ds.n == 2);
+  df = def_find(&ds, DEF_PATH, b);
+  CHECK(df && df->obj == a && df->uses == 3);
+  CHECK(df && df->ax == 1000 && df->ay == 2000);
+  df = def_find(&ds, DEF_PATH, c);
+  CHECK(df && df->obj == c && df->uses == 1);
+
+  /* Paths aren't groups. */
+  CHECK(def_find(&ds, DEF_GROUP, a) == NULL);
+
+  /* Many different paths, then the same ones again */
+  for (int round = 0; round < 2; round++)
+    for (int i = 0; i < 300; i++) {
+      rect_path(f[i], i * 10, 0, 100 + i, 100, 0, false);
+      CHECK(def_intern(&ds, DEF_PATH, f[i]) == round);
+    }
+  CHECK(ds.n == 302);
+  defs_free(&ds);
+
+  /* Small paths aren't considered. */
+  defs_init(&ds, 1000);
+  CHECK(!def_intern(&ds, DEF_PATH, a));
+  CHECK(!def_intern(&ds, DEF_PATH, b));
+  CHECK(ds.n == 0);
+  CHECK(def_find(&ds, DEF_PATH, a) == NULL);
+  defs_free(&ds);
+}
+
+static void test_groups(void)
+{
+  static int a[80], b[80], c[80];
+  struct defs ds;
+  struct def *df;
+
+  defs_init(&ds, 32);
+  rect_group(a, 0, 0, 0x0000ff00u, "one");
+  rect_group(b, 4000, -4000, 0x0000ff00u, "two");
+  rect_group(c, 4000, -4000, 0xff000000u, "one");
+
+  /* Translated copies match whatever their names, but not if what
+     they contain looks different. */
+  CHECK(!def_intern(&ds, DEF_GROUP, a));
+  CHECK(def_intern(&ds, DEF_GROUP, b));
+  CHECK(!def_intern(&ds, DEF_GROUP, c));
+  CHECK(ds.n == 2);
+  df = def_find(&ds, DEF_GROUP, b);
+  CHECK(df && df->obj == a && df->uses == 2);
+  CHECK(df && df->ax == 0 && df->ay == 0);
+
+  /* The paths in a group are separate. */
+  CHECK(def_find(&ds, DEF_PATH, a + 9) == NULL);
+  defs_free(&ds);
+}
+
+int main(void)
+{
+  test_paths();
+  test_groups();
+  return test_result("defs");
+}
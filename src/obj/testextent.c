@@ -0,0 +1,154 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "extent.h"
+#include "test.h"
+
+#define LEN(a) (sizeof (a) / sizeof (a)[0])
+
+/* A colour that is not painted */
+#define NONE -1
+
+/* Make a path object of some elements, which must end with an end
+   element. */
+static const int *make_path(int *d, const int *el, size_t n,
+                            int fill, int outline, int width, int style)
+{
+  d[0] = 2;
+  d[1] = (10 + n) * sizeof *d;
+  d[2] = d[3] = d[4] = d[5] = 0;
+  d[6] = fill;
+  d[7] = outline;
+  d[8] = width;
+  d[9] = style;
+  memcpy(d + 10, el, n * sizeof *el);
+  return d;
+}
+
+/* Is the extent x0, y0, x1, y1, to within half a unit? */
+static int is_box(const struct extent *x, double x0, double y0,
+                  double x1, double y1)
+{
+  return !x->empty && fabs(x->x0 - x0) <= 0.5 && fabs(x->y0 - y0) <= 0.5 &&
+    fabs(x->x1 - x1) <= 0.5 && fabs(x->y1 - y1) <= 0.5;
+}
+
+static void test_boxes(void)
+{
+  struct extent x;
+
+  extent_init(&x);
+  CHECK(x.empty);
+  extent_point(&x, 10, 20);
+  CHECK(is_box(&x, 10, 20, 10, 20));
+  extent_box(&x, -5, 30, 0, 40);
+  CHECK(is_box(&x, -5, 20, 10, 40));
+}
+
+static void test_lines(void)
+{
+  static const int square[] = {
+    2, 0, 0, 8, 1000, 0, 8, 1000, 1000, 8, 0, 1000, 5, 0
+  };
+  static const int line[] = { 2, 0, 0, 8, 1000, 0, 0 };
+  int d[40];
+  struct extent x;
+
+  /* Only the fill of a square */
+  extent_init(&x);
+  extent_path(&x, make_path(d, square, LEN(square), 0, NONE, 0, 0), 1.0);
+  extent_flush(&x);
+  CHECK(is_box(&x, 0, 0, 1000, 1000));
+
+  /* Each segment is widened by half the width in every direction,
+     which already covers butt, round and square caps. */
+  extent_init(&x);
+  extent_path(&x, make_path(d, line, LEN(line), NONE, 0, 100, 0), 1.0);
+  extent_flush(&x);
+  CHECK(is_box(&x, -50, -50, 1050, 50));
+  extent_init(&x);
+  extent_path(&x, make_path(d, line, LEN(line), NONE, 0, 100,
+                            2 << 2 | 2 << 4), 1.0);
+  extent_flush(&x);
+  CHECK(is_box(&x, -50, -50, 1050, 50));
+
+  /* A triangle cap twice the width long and wide reaches further. */
+  extent_init(&x);
+  extent_path(&x, make_path(d, line, LEN(line), NONE, 0, 100,
+                            3 << 2 | 32 << 16 | 32 << 24), 1.0);
+  extent_flush(&x);
+  CHECK(is_box(&x, -50, -200, 1200, 200));
+
+  /* A thin line is as wide as it is drawn. */
+  extent_init(&x);
+  extent_path(&x, make_path(d, line, LEN(line), NONE, 0, 0, 0), 10.0);
+  extent_flush(&x);
+  CHECK(is_box(&x, -5, -5, 1005, 5));
+
+  /* Nothing painted, nothing measured */
+  extent_init(&x);
+  extent_path(&x, make_path(d, line, LEN(line), NONE, NONE, 100, 0), 1.0);
+  extent_flush(&x);
+  CHECK(x.empty);
+}
+
+static void test_curves(void)
+{
+  static const int arch[] = {
+    2, 0, 0, 6, 0, 1000, 1000, 1000, 1000, 0, 5, 0
+  };
+  int d[40];
+  struct extent x;
+
+  /* The curve peaks halfway, well inside its control points. */
+  extent_init(&x);
+  extent_path(&x, make_path(d, arch, LEN(arch), 0, NONE, 0, 0), 1.0);
+  extent_flush(&x);
+  CHECK(is_box(&x, 0, 0, 1000, 750));
+
+  /* More curves than are measured at once */
+  extent_init(&x);
+  for (int i = 0; i < 3 * EXTENT_BATCH; i++) {
+    static const int xs[] = { 1, 4, 6, 8 };
+    int el[LEN(arch)];
+
+    memcpy(el, arch, sizeof el);
+    for (size_t k = 0; k < LEN(xs); k++)
+      el[xs[k]] += i * 10;
+    extent_path(&x, make_path(d, el, LEN(el), 0, NONE, 0, 0), 1.0);
+  }
+  extent_flush(&x);
+  CHECK(is_box(&x, 0, 0, 1000 + (3 * EXTENT_BATCH - 1) * 10, 750));
+}
+
+int main(void)
+{
+  test_boxes();
+  test_lines();
+  test_curves();
+  return test_result("extent");
+}
@@ -0,0 +1,177 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fmt.h"
+#include "test.h"
+
+/* Produce the same values on every run. */
+static unsigned long next(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245ul + 12345ul) & 0x7ffffffful;
+  return *seed;
+}
+
+static int int_is(long v, const char *want)
+{
+  char buf[FMT_INT_MAX + 1];
+  *fmt_int(buf, v) = '\0';
+  if (strcmp(buf, want)) {
+    fprintf(stderr, "%ld: wrote \"%s\"\n", v, buf);
+    return false;
+  }
+  return true;
+}
+
+static int double_is(double v, const char *want)
+{
+  char buf[FMT_DBL_MAX + 1];
+  *fmt_double(buf, v) = '\0';
+  if (strcmp(buf, want)) {
+    fprintf(stderr, "%.17g: wrote \"%s\"\n", v, buf);
+    return false;
+  }
+  return true;
+}
+
+static int colour_is(unsigned long c, const char *want)
+{
+  char buf[FMT_COL_MAX + 1];
+  *fmt_colour(buf, c) = '\0';
+  return strcmp(buf, want) == 0;
+}
+
+/* Count the significant digits of a number as written. */
+static size_t digits(const char *s)
+{
+  size_t n = 0, zeros = 0;
+  int seen = false;
+
+  for (; *s && *s != 'e'; s++) {
+    if (*s < '0' || *s > '9')
+      continue;
+    if (*s == '0') {
+      zeros += seen;
+      continue;
+    }
+    n += zeros + 1;
+    zeros = 0;
+    seen = true;
+  }
+  return n;
+}
+
+/* Does a value read back exactly, in no more significant digits than
+   it needs? */
+static int round_trips(double v)
+{
+  char buf[FMT_DBL_MAX + 1], alt[40], *end;
+  int prec;
+
+  *fmt_double(buf, v) = '\0';
+  if (strtod(buf, &end) != v || *end != '\0') {
+    fprintf(stderr, "%.17g: wrote \"%s\"\n", v, buf);
+    return false;
+  }
+  for (prec = 1; prec < 17; prec++) {
+    snprintf(alt, sizeof alt, "%.*g", prec, v);
+    if (strtod(alt, NULL) == v)
+      break;
+  }
+  if (prec < 17 && digits(buf) > digits(alt)) {
+    fprintf(stderr, "%.17g: wrote \"%s\", not \"%s\"\n", v, buf, alt);
+    return false;
+  }
+  return true;
+}
+
+static void test_ints(void)
+{
+  char buf[FMT_INT_MAX + 1];
+
+  CHECK(int_is(0, "0"));
+  CHECK(int_is(7, "7"));
+  CHECK(int_is(-7, "-7"));
+  CHECK(int_is(10, "10"));
+  CHECK(int_is(-1000000, "-1000000"));
+  CHECK(int_is(123456789, "123456789"));
+  snprintf(buf, sizeof buf, "%ld", LONG_MAX);
+  CHECK(int_is(LONG_MAX, buf));
+  snprintf(buf, sizeof buf, "%ld", LONG_MIN);
+  CHECK(int_is(LONG_MIN, buf));
+}
+
+static void test_doubles(void)
+{
+  unsigned long seed = 3;
+
+  CHECK(double_is(0.0, "0"));
+  CHECK(double_is(1.0, "1"));
+  CHECK(double_is(-250.0, "-250"));
+  CHECK(double_is(0.5, "0.5"));
+  CHECK(double_is(-0.125, "-0.125"));
+  CHECK(double_is(0.1, "0.1"));
+  CHECK(double_is(0.001, "0.001"));
+  CHECK(double_is(1.0 / 3.0, "0.3333333333333333"));
+  CHECK(double_is(0.1 + 0.2, "0.30000000000000004"));
+  CHECK(double_is(123.456, "123.456"));
+
+  /* Scaled draw units, as most numbers written are */
+  for (int i = -5000; i <= 5000; i++)
+    CHECK(round_trips(i / 640.0));
+
+  /* Anything else, including very large and very small values */
+  for (int i = 0; i < 100000; i++) {
+    unsigned long long bits;
+    double v;
+    bits = (unsigned long long) next(&seed) << 33 ^
+      (unsigned long long) next(&seed) << 2 ^ next(&seed);
+    memcpy(&v, &bits, sizeof v);
+    if (v != v || v - v != 0.0 || (v != 0.0 && v > -1e-300 && v < 1e-300))
+      continue;
+    CHECK(round_trips(v));
+  }
+}
+
+static void test_colours(void)
+{
+  CHECK(colour_is(0x00000000ul, "#000000"));
+  CHECK(colour_is(0xffffff00ul, "#FFFFFF"));
+  CHECK(colour_is(0x0000ff00ul, "#FF0000"));
+  CHECK(colour_is(0x00ff0000ul, "#00FF00"));
+  CHECK(colour_is(0xff000000ul, "#0000FF"));
+  CHECK(colour_is(0x12345600ul, "#563412"));
+}
+
+int main(void)
+{
+  test_ints();
+  test_doubles();
+  test_colours();
+  return test_result("fmt");
+}
@@ -0,0 +1,173 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "glyph.h"
+#include "test.h"
+
+/* Where the cache is written */
+#define TEMP_NAME "testglyph.tmp"
+
+#define FONT "Trinity.Medium"
+
+static const int ident[4] = { 65536, 0, 0, 65536 };
+static const int slant[4] = { 65536, 0, 16384, 65536 };
+
+/* A path object of one line, followed by a zero word */
+static const int line[] = {
+  2, 17 * sizeof (int), 0, 0, 100, 0, 0, -1, 0, 0,
+  2, 0, 0, 8, 100, 0, 0, 0
+};
+
+static int *make_obj(void)
+{
+  int *obj = malloc(sizeof line);
+
+  if (obj)
+    memcpy(obj, line, sizeof line);
+  return obj;
+}
+
+/* Set up the fonts as the font manager would find them. */
+static void add_font(struct glyphs *gs, int handle, unsigned id)
+{
+  struct font_entry *fe = glyph_font_add(gs, FONT, 320, 320, handle);
+
+  fe->keyed = 1;
+  fe->id[0] = 0x5eed;
+  fe->id[1] = id;
+}
+
+static void test_memory(void)
+{
+  static const double adv[2] = { 6000, 0 };
+  struct glyphs gs;
+  struct glyph *g;
+
+  glyphs_init(&gs);
+  add_font(&gs, 3, 1);
+  CHECK(glyph_font_find(&gs, FONT, 320, 320) != NULL);
+  CHECK(glyph_font_find(&gs, FONT, 320, 640) == NULL);
+  CHECK(glyph_find(&gs, 3, 'A', ident) == NULL);
+  g = glyph_add(&gs, 3, 'A', ident, make_obj(), adv);
+  CHECK(g && g->obj && g->adv[0] == 6000);
+  CHECK(glyph_find(&gs, 3, 'A', ident) == g);
+  CHECK(glyph_find(&gs, 3, 'A', slant) == NULL);
+  CHECK(glyph_find(&gs, 4, 'A', ident) == NULL);
+  CHECK(glyph_find(&gs, 3, 'B', ident) == NULL);
+
+  /* Enough to make the table grow */
+  for (int ch = 0; ch < 1000; ch++)
+    if (ch != 'A')
+      glyph_add(&gs, 3, ch, ident, NULL, adv);
+  g = glyph_find(&gs, 3, 'A', ident);
+  CHECK(g && g->ch == 'A' && g->obj != NULL);
+  CHECK(gs.n == 1000);
+  glyphs_free(&gs);
+}
+
+static void test_cache(void)
+{
+  static const double adv[2] = { 6000, 250 }, space[2] = { 3000, 0 };
+  struct glyphs gs;
+  struct glyph *g;
+  FILE *fp;
+
+  remove(TEMP_NAME);
+
+  /* Nothing new, nothing written */
+  glyphs_init(&gs);
+  CHECK(glyph_cache_load(&gs, TEMP_NAME) != 0);
+  CHECK(glyph_cache_save(&gs, TEMP_NAME) == 0);
+  CHECK((fp = fopen(TEMP_NAME, "rb")) == NULL);
+  if (fp)
+    fclose(fp);
+
+  add_font(&gs, 3, 1);
+  glyph_add(&gs, 3, 'A', ident, make_obj(), adv);
+  glyph_add(&gs, 3, ' ', ident, NULL, space);
+  CHECK(glyph_cache_save(&gs, TEMP_NAME) == 0);
+  glyphs_free(&gs);
+
+  /* The same font under another handle finds what was saved. */
+  glyphs_init(&gs);
+  add_font(&gs, 7, 1);
+  CHECK(glyph_cache_load(&gs, TEMP_NAME) == 0);
+  g = glyph_cache_find(&gs, 7, 'A', ident);
+  CHECK(g && g->saved && g->obj != NULL);
+  CHECK(g && g->obj && memcmp(g->obj, line, sizeof line) == 0);
+  CHECK(g && g->adv[0] == adv[0] && g->adv[1] == adv[1]);
+  CHECK(g && glyph_find(&gs, 7, 'A', ident) == g);
+  g = glyph_cache_find(&gs, 7, ' ', ident);
+  CHECK(g && g->obj == NULL && g->adv[0] == space[0]);
+  CHECK(glyph_cache_find(&gs, 7, 'A', slant) == NULL);
+  CHECK(glyph_cache_find(&gs, 7, 'B', ident) == NULL);
+
+  /* New glyphs are added to those saved before. */
+  glyph_add(&gs, 7, 'B', slant, make_obj(), adv);
+  CHECK(glyph_cache_save(&gs, TEMP_NAME) == 0);
+  glyphs_free(&gs);
+
+  glyphs_init(&gs);
+  add_font(&gs, 2, 1);
+  CHECK(glyph_cache_load(&gs, TEMP_NAME) == 0);
+  CHECK(glyph_cache_find(&gs, 2, 'A', ident) != NULL);
+  CHECK(glyph_cache_find(&gs, 2, 'B', slant) != NULL);
+  glyphs_free(&gs);
+
+  /* Another font of the same name, or one that can't be told apart,
+     finds nothing. */
+  glyphs_init(&gs);
+  add_font(&gs, 2, 2);
+  CHECK(glyph_cache_load(&gs, TEMP_NAME) == 0);
+  CHECK(glyph_cache_find(&gs, 2, 'A', ident) == NULL);
+  gs.fonts[0].id[1] = 1;
+  gs.fonts[0].keyed = 0;
+  CHECK(glyph_cache_find(&gs, 2, 'A', ident) == NULL);
+  glyphs_free(&gs);
+
+  /* A damaged file is ignored. */
+  if ((fp = fopen(TEMP_NAME, "r+b")) != NULL) {
+    fseek(fp, -8, SEEK_END);
+    fputc(0x55, fp);
+    fclose(fp);
+  }
+  glyphs_init(&gs);
+  add_font(&gs, 2, 1);
+  CHECK(glyph_cache_load(&gs, TEMP_NAME) != 0);
+  CHECK(glyph_cache_find(&gs, 2, 'A', ident) == NULL);
+  glyphs_free(&gs);
+
+  remove(TEMP_NAME);
+}
+
+int main(void)
+{
+  test_memory();
+  test_cache();
+  return test_result("glyph");
+}
@@ -0,0 +1,70 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include "marker.h"
+#include "test.h"
+
+int main(void)
+{
+  struct markers ms;
+  struct marker m = { 0x0000ff00ul, 3, 1, 32, 48 }, n;
+  unsigned first;
+
+  markers_init(&ms);
+  CHECK(ms.n == 0);
+
+  /* Numbers start from 1, and the same marker keeps its number. */
+  first = marker_intern(&ms, &m);
+  CHECK(first == 1);
+  n = m;
+  CHECK(marker_intern(&ms, &n) == first);
+  CHECK(ms.n == 1);
+
+  /* Any difference makes a new marker. */
+  n.end = 0;
+  CHECK(marker_intern(&ms, &n) == 2);
+  n = m, n.colour = 0xff000000ul;
+  CHECK(marker_intern(&ms, &n) == 3);
+  n = m, n.tri_width++;
+  CHECK(marker_intern(&ms, &n) == 4);
+  n = m, n.tri_length++;
+  CHECK(marker_intern(&ms, &n) == 5);
+  n = m, n.cap = 2;
+  CHECK(marker_intern(&ms, &n) == 6);
+  CHECK(marker_intern(&ms, &m) == first);
+
+  /* Enough to make the table grow */
+  for (unsigned i = 0; i < 100; i++) {
+    n = m, n.tri_width = 1000 + i;
+    CHECK(marker_intern(&ms, &n) == 7 + i);
+  }
+  for (unsigned i = 0; i < 100; i++) {
+    n = m, n.tri_width = 1000 + i;
+    CHECK(marker_intern(&ms, &n) == 7 + i);
+  }
+  CHECK(ms.n == 106);
+
+  markers_free(&ms);
+  return test_result("marker");
+}
@@ -0,0 +1,319 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+/* The font is written out in the form read from a font directory, so
+   this test needs a host with POSIX directories. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ofont.h"
+#include "test.h"
+
+/* Where the fonts are written */
+#define TEMP_DIR "testofont.tmp"
+
+/* A file being made up */
+struct bytes {
+  unsigned char v[4096];
+  size_t n;
+};
+
+static void put8(struct bytes *b, unsigned v)
+{
+  if (b->n < sizeof b->v)
+    b->v[b->n++] = v & 0xff;
+}
+
+static void put16(struct bytes *b, unsigned v)
+{
+  put8(b, v);
+  put8(b, v >> 8);
+}
+
+static void put32(struct bytes *b, unsigned long v)
+{
+  put16(b, v & 0xffff);
+  put16(b, v >> 16);
+}
+
+static void set32(struct bytes *b, size_t at, unsigned long v)
+{
+  size_t n = b->n;
+
+  b->n = at;
+  put32(b, v);
+  b->n = n;
+}
+
+/* A pair of 12-bit coordinates */
+static void put_pair(struct bytes *b, int x, int y)
+{
+  put8(b, x);
+  put8(b, (x >> 8 & 0x0f) | (y & 0x0f) << 4);
+  put8(b, y >> 4);
+}
+
+/* A character with one box as its outline, and no scaffold lines */
+static void put_box(struct bytes *b, int x0, int y0, int x1, int y1)
+{
+  put8(b, 0x09);
+  for (int i = 0; i < 5; i++)
+    put8(b, 0);
+  put8(b, 1), put_pair(b, x0, y0);
+  put8(b, 2), put_pair(b, x1, y0);
+  put8(b, 2), put_pair(b, x1, y1);
+  put8(b, 2), put_pair(b, x0, y1);
+  put8(b, 0);
+}
+
+static int save(const char *dir, const char *leaf, const struct bytes *b)
+{
+  char path[256];
+  FILE *fp;
+  int ok;
+
+  snprintf(path, sizeof path, "%s/%s", dir, leaf);
+  if (!(fp = fopen(path, "wb")))
+    return -1;
+  ok = fwrite(b->v, 1, b->n, fp) == b->n;
+  return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+/* Write a font of 1000 design units to the em: 'A' is a box 500
+   units square, 'V' a narrower one, the apostrophe a thin box above
+   them, and e acute an 'A' with the apostrophe moved right.  The
+   space paints nothing.  'A' is followed by 'V' more closely if
+   kerned, and advances 'adv_a'. */
+static int write_font(const char *dir, int adv_a)
+{
+  static const unsigned chars[] = { 39, 'A', 'V', 0xe9 };
+  struct bytes *b = calloc(1, sizeof *b);
+  size_t table, idx;
+  int rc;
+
+  if (!b)
+    return -1;
+
+  /* Outlines: a header, a table of 8 chunks, and the chunk holding
+     all the characters */
+  memcpy(b->v, "FONT", 4);
+  b->v[5] = 8;
+  b->n = 6;
+  put16(b, 1000);
+  b->n = 16;
+  put32(b, 64);
+  put32(b, 8);
+  b->n = table = 64;
+  for (int i = 0; i < 8; i++)
+    put32(b, 0);
+  for (int c = 0; c < 8; c++) {
+    set32(b, table + 4 * c, b->n);
+    put32(b, 0);
+    idx = b->n;
+    for (int k = 0; k < 32; k++)
+      put32(b, 0);
+    for (size_t i = 0; i < sizeof chars / sizeof chars[0]; i++) {
+      if (chars[i] / 32 != (unsigned) c)
+        continue;
+      set32(b, idx + 4 * (chars[i] % 32), b->n - idx);
+      switch (chars[i]) {
+      case 39:
+        put_box(b, 0, 400, 50, 600);
+        break;
+      case 'A':
+        put_box(b, 0, 0, 500, 500);
+        break;
+      case 'V':
+        put_box(b, 0, 0, 400, 500);
+        break;
+      case 0xe9:
+        put8(b, 0x30);
+        put8(b, 'A');
+        put8(b, 39);
+        put8(b, 100);
+        put8(b, 0);
+        break;
+      }
+    }
+  }
+  rc = save(dir, "Outlines", b);
+
+  /* IntMetrics: a name, the sizes of the map and of the characters'
+     metrics, the identity map, x advances, and a table locating the
+     kern pairs */
+  memset(b, 0, sizeof *b);
+  memcpy(b->v, "Test", 4);
+  b->n = 40;
+  put32(b, 16);
+  put32(b, 16);
+  put8(b, 0);
+  put8(b, 2);
+  put8(b, 0x0d);
+  put8(b, 1);
+  for (int c = 0; c < 256; c++)
+    put8(b, c);
+  for (int c = 0; c < 256; c++)
+    put16(b, c == ' ' ? 250 : c == 39 ? 200 : c == 'V' ? 450 :
+          c == 'A' || c == 0xe9 ? adv_a : 0);
+  put16(b, 0);
+  put16(b, 4);
+  put8(b, 'A');
+  put8(b, 'V');
+  put16(b, (unsigned) -80);
+  put8(b, 0);
+  put8(b, 0);
+  if (rc == 0)
+    rc = save(dir, "IntMetrics", b);
+
+  free(b);
+  return rc;
+}
+
+/* Does the path object at 'd' have the box (x0, y0, x1, y1)? */
+static int is_box(const int *d, int x0, int y0, int x1, int y1)
+{
+  return d[0] == 2 && d[2] == x0 && d[3] == y0 && d[4] == x1 && d[5] == y1;
+}
+
+static void test_scan(const struct ofont *f)
+{
+  struct ofont_layout lo = { 1000, 1000, NULL, false, false };
+  static const int mat[6] = { 2 << 16, 0, 0, 1 << 16, 25000, 0 };
+  double pen[2];
+
+  ofont_scan(f, &lo, "AV", 2, pen);
+  CHECK(pen[0] == 1050 && pen[1] == 0);
+  ofont_scan(f, &lo, "A\tV", 3, pen);
+  CHECK(pen[0] == 1050);
+  ofont_scan(f, &lo, "AV", 1, pen);
+  CHECK(pen[0] == 600);
+
+  lo.kern = true;
+  ofont_scan(f, &lo, "AV", 2, pen);
+  CHECK(pen[0] == 970);
+  ofont_scan(f, &lo, "VA", 2, pen);
+  CHECK(pen[0] == 1050);
+
+  lo.rtl = true;
+  ofont_scan(f, &lo, "AV", 2, pen);
+  CHECK(pen[0] == -970);
+
+  /* Sizes scale, and matrices transform, the advance. */
+  lo.kern = lo.rtl = false;
+  lo.xsize = 2000;
+  ofont_scan(f, &lo, "AV", 2, pen);
+  CHECK(pen[0] == 2100);
+  lo.xsize = 1000;
+  lo.mat = mat;
+  ofont_scan(f, &lo, "AV", 2, pen);
+  CHECK(pen[0] == 2100 && pen[1] == 0);
+}
+
+static void test_paint(const struct ofont *f)
+{
+  struct ofont_layout lo = { 1000, 1000, NULL, false, false };
+  static const int mat[6] = { 2 << 16, 0, 0, 1 << 16, 25000, 0 };
+  struct ofont_buf out = { NULL, 0, 0 };
+  const int *d;
+
+  /* One object for each character that paints something */
+  ofont_paint(f, &lo, "A V", 3, 10000, 20000, &out);
+  d = out.v;
+  CHECK(is_box(d, 10000, 20000, 10500, 20500));
+  CHECK(d[6] == 0 && d[7] == -1 && d[8] == 0 && d[9] == 0);
+  CHECK(d[10] == 2 && d[11] == 10000 && d[12] == 20000);
+  d += d[1] / sizeof *d;
+  CHECK(is_box(d, 10850, 20000, 11250, 20500));
+  d += d[1] / sizeof *d;
+  CHECK(d[0] == 0 && (size_t) (d - out.v) == out.n - 1);
+
+  /* The accent is moved from its base. */
+  ofont_paint(f, &lo, "\xe9", 1, 0, 0, &out);
+  CHECK(is_box(out.v, 0, 0, 500, 600));
+  CHECK(out.v[out.v[1] / sizeof *out.v] == 0);
+
+  /* Nothing painted */
+  ofont_paint(f, &lo, "  ", 2, 0, 0, &out);
+  CHECK(out.n == 1 && out.v[0] == 0);
+
+  lo.mat = mat;
+  ofont_paint(f, &lo, "A", 1, 0, 0, &out);
+  CHECK(is_box(out.v, 16000, 0, 17000, 500));
+
+  free(out.v);
+}
+
+int main(void)
+{
+  struct ofont *f, *g;
+  unsigned id[2], gid[2];
+
+  mkdir(TEMP_DIR, 0777);
+  mkdir(TEMP_DIR "/Test", 0777);
+  mkdir(TEMP_DIR "/Test/Medium", 0777);
+  mkdir(TEMP_DIR "/Test/Bold", 0777);
+  CHECK(write_font(TEMP_DIR "/Test/Medium", 600) == 0);
+  CHECK(write_font(TEMP_DIR "/Test/Bold", 650) == 0);
+
+  CHECK(ofont_open(TEMP_DIR, "Test.Light") == NULL);
+  f = ofont_open(TEMP_DIR, "Test.Medium");
+  CHECK(f != NULL);
+  if (f) {
+    test_scan(f);
+    test_paint(f);
+
+    /* Fonts are told apart by their contents. */
+    ofont_id(f, id);
+    g = ofont_open(TEMP_DIR, "Test.Medium");
+    CHECK(g != NULL);
+    if (g) {
+      ofont_id(g, gid);
+      CHECK(id[0] == gid[0] && id[1] == gid[1]);
+      ofont_close(g);
+    }
+    g = ofont_open(TEMP_DIR, "Test.Bold");
+    CHECK(g != NULL);
+    if (g) {
+      ofont_id(g, gid);
+      CHECK(id[0] != gid[0] || id[1] != gid[1]);
+      ofont_close(g);
+    }
+    ofont_close(f);
+  }
+
+  remove(TEMP_DIR "/Test/Medium/Outlines");
+  remove(TEMP_DIR "/Test/Medium/IntMetrics");
+  remove(TEMP_DIR "/Test/Bold/Outlines");
+  remove(TEMP_DIR "/Test/Bold/IntMetrics");
+  rmdir(TEMP_DIR "/Test/Medium");
+  rmdir(TEMP_DIR "/Test/Bold");
+  rmdir(TEMP_DIR "/Test");
+  rmdir(TEMP_DIR);
+
+  return test_result("ofont");
+}
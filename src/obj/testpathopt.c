@@ -0,0 +1,201 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <string.h>
+
+#include "context.h"
+#include "pathopt.h"
+#include "test.h"
+
+/* What has been written, without layout */
+static char text[1024];
+static size_t len;
+
+int output_str(struct ws *ws, int pretty, const char *s, size_t n)
+{
+  (void) ws;
+  (void) pretty;
+  if (n > sizeof text - 1 - len)
+    n = sizeof text - 1 - len;
+  memcpy(text + len, s, n);
+  len += n;
+  text[len] = '\0';
+  return 0;
+}
+
+static struct context ct;
+static struct ws ws;
+static struct pathopt po;
+
+static void start(int compact)
+{
+  ct.compact = compact;
+  ct.stats = true;
+  ws.ct = &ct;
+  ws.path_bytes = ws.path_legacy = 0;
+  len = 0;
+  text[0] = '\0';
+  pathopt_init(&po, &ws);
+}
+
+/* Was this written, and counted? */
+static int wrote(const char *s)
+{
+  pathopt_end(&po);
+  if (strcmp(text, s) != 0) {
+    fprintf(stderr, "wrote \"%s\"\n", text);
+    return false;
+  }
+  return ws.path_bytes == len;
+}
+
+static void test_lines(void)
+{
+  /* Horizontal and vertical lines are shortened, and relative forms
+     are preferred when no longer. */
+  start(false);
+  pathopt_move(&po, 1000, 2000);
+  pathopt_line(&po, 3000, 2000);
+  pathopt_line(&po, 3000, 5000);
+  pathopt_line(&po, 4000, 6000);
+  pathopt_close(&po);
+  CHECK(wrote("m1000 2000h2000v3000l1000 1000z"));
+
+  /* A repeated command loses its letter, and in compact output, a
+     minus sign separates operands. */
+  start(false);
+  pathopt_move(&po, 10000, 10000);
+  pathopt_line(&po, 10100, 10050);
+  pathopt_line(&po, 10050, 10150);
+  CHECK(wrote("m10000 10000l100 50 -50 100"));
+  start(true);
+  pathopt_move(&po, 10000, 10000);
+  pathopt_line(&po, 10100, 10050);
+  pathopt_line(&po, 10050, 10150);
+  CHECK(wrote("m10000 10000l100 50-50 100"));
+
+  /* An absolute form is used where it is shorter. */
+  start(false);
+  pathopt_move(&po, 100000, 100000);
+  pathopt_line(&po, 5, 100000);
+  CHECK(wrote("m100000 100000H5"));
+
+  /* The closing line is left to the close. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_line(&po, 100, 0);
+  pathopt_line(&po, 100, 100);
+  pathopt_line(&po, 0, 0);
+  pathopt_close(&po);
+  CHECK(wrote("m0 0h100v100z"));
+}
+
+static void test_merging(void)
+{
+  /* Lines carrying on in the same direction become one. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_line(&po, 100, 100);
+  pathopt_line(&po, 300, 300);
+  pathopt_line(&po, 400, 400);
+  pathopt_line(&po, 400, 500);
+  pathopt_line(&po, 400, 900);
+  CHECK(wrote("m0 0l400 400v500"));
+
+  /* Those turning back, or only nearly in line, don't. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_line(&po, 1000, 0);
+  pathopt_line(&po, 950, 0);
+  pathopt_line(&po, 1000, 1);
+  CHECK(wrote("m0 0h1000 -50l50 1"));
+
+  /* A move ends a run of lines. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_line(&po, 100, 0);
+  pathopt_move(&po, 100, 0);
+  pathopt_line(&po, 200, 0);
+  CHECK(wrote("m0 0h100m0 0h100"));
+}
+
+static void test_curves(void)
+{
+  /* A curve along its chord is a line, and merges with others. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_line(&po, 100, 0);
+  pathopt_curve(&po, 200, 0, 300, 0, 400, 0);
+  pathopt_curve(&po, 500, 0, 500, 0, 500, 0);
+  CHECK(wrote("m0 0h500"));
+
+  /* Control points off the chord, or beyond its ends, keep it a
+     curve. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_curve(&po, 100, 1, 200, 0, 300, 0);
+  CHECK(wrote("m0 0c100 1 200 0 300 0"));
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_curve(&po, -100, 0, 200, 0, 300, 0);
+  CHECK(wrote("m0 0c-100 0 200 0 300 0"));
+
+  /* A curve carrying on smoothly from the last uses the shorthand. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_curve(&po, 0, 100, 100, 200, 200, 200);
+  pathopt_curve(&po, 300, 200, 400, 100, 400, 0);
+  pathopt_curve(&po, 400, -100, 300, -300, 0, 0);
+  CHECK(wrote("m0 0c0 100 100 200 200 200S400 100 400 0 300 -300 0 0"));
+
+  /* But not after a line */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_curve(&po, 0, 100, 100, 200, 200, 200);
+  pathopt_line(&po, 300, 300);
+  pathopt_curve(&po, 300, 400, 400, 500, 500, 500);
+  CHECK(wrote("m0 0c0 100 100 200 200 200l100 100c0 100 100 200 200 200"));
+}
+
+static void test_counts(void)
+{
+  /* The unoptimized form is counted as relative commands, without
+     merging. */
+  start(false);
+  pathopt_move(&po, 0, 0);
+  pathopt_line(&po, 100, 0);
+  pathopt_line(&po, 200, 0);
+  pathopt_close(&po);
+  CHECK(wrote("m0 0h200z"));
+  CHECK(ws.path_legacy == strlen("M0 0h100h100z"));
+}
+
+int main(void)
+{
+  test_lines();
+  test_merging();
+  test_curves();
+  test_counts();
+  return test_result("pathopt");
+}
@@ -0,0 +1,128 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rtree.h"
+#include "test.h"
+
+#define NBOXES 2000
+
+/* Where saved trees are written */
+#define TEMP_NAME "testrtree.tmp"
+
+static int boxes[NBOXES][4];
+
+/* Produce the same boxes on every run. */
+static unsigned long next(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245ul + 12345ul) & 0x7ffffffful;
+  return *seed;
+}
+
+static void random_box(unsigned long *seed, int *box, int size)
+{
+  box[0] = (int) (next(seed) % 100000) - 50000;
+  box[1] = (int) (next(seed) % 100000) - 50000;
+  box[2] = box[0] + (int) (next(seed) % size);
+  box[3] = box[1] + (int) (next(seed) % size);
+}
+
+static int meets(const int *a, const int *b)
+{
+  return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+/* Compare queries against checking every box. */
+static void check_queries(const struct rtree *rt, size_t n)
+{
+  unsigned long seed = 7, *res = NULL;
+  size_t cap = 0;
+
+  for (int q = 0; q < 200; q++) {
+    int box[4];
+    size_t got, want = 0, same = 0;
+
+    random_box(&seed, box, q % 2 ? 1000 : 20000);
+    got = rtree_query(rt, box, &res, &cap);
+    for (size_t i = 0; i < n; i++) {
+      if (!meets(boxes[i], box))
+        continue;
+      if (want < got && res[want] == i)
+        same++;
+      want++;
+    }
+    CHECK(got == want);
+    CHECK(same == want);
+  }
+  free(res);
+}
+
+int main(void)
+{
+  static const unsigned key[] = { 0x1234, 0x5678 }, other[] = { 0x1234, 0 };
+  unsigned long seed = 1, *res = NULL;
+  size_t cap = 0;
+  struct rtree rt, lt;
+
+  for (size_t i = 0; i < NBOXES; i++)
+    random_box(&seed, boxes[i], 5000);
+
+  /* Nothing to find */
+  rtree_init(&rt);
+  rtree_pack(&rt);
+  CHECK(rtree_query(&rt, boxes[0], &res, &cap) == 0);
+  rtree_free(&rt);
+  free(res);
+
+  /* Fewer boxes than a node holds, then several levels of them */
+  rtree_init(&rt);
+  for (size_t i = 0; i < RTREE_FANOUT / 2; i++)
+    rtree_add(&rt, boxes[i], i);
+  rtree_pack(&rt);
+  check_queries(&rt, RTREE_FANOUT / 2);
+  rtree_free(&rt);
+
+  rtree_init(&rt);
+  for (size_t i = 0; i < NBOXES; i++)
+    rtree_add(&rt, boxes[i], i);
+  rtree_pack(&rt);
+  check_queries(&rt, NBOXES);
+
+  /* A saved tree loads only under its own key. */
+  CHECK(rtree_save(&rt, TEMP_NAME, key, 2) == 0);
+  rtree_init(&lt);
+  CHECK(rtree_load(&lt, TEMP_NAME, other, 2) != 0);
+  CHECK(rtree_load(&lt, TEMP_NAME, key, 1) != 0);
+  CHECK(lt.n == 0);
+  CHECK(rtree_load(&lt, TEMP_NAME, key, 2) == 0);
+  CHECK(lt.n == NBOXES);
+  check_queries(&lt, NBOXES);
+  rtree_free(&lt);
+  rtree_free(&rt);
+  remove(TEMP_NAME);
+
+  return test_result("rtree");
+}
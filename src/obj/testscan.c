@@ -0,0 +1,97 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <string.h>
+
+#include "scan.h"
+#include "test.h"
+
+#define BUF_MAX 200
+
+/* Produce the same strings on every run. */
+static unsigned long next(unsigned long *seed)
+{
+  *seed = (*seed * 1103515245ul + 12345ul) & 0x7ffffffful;
+  return *seed;
+}
+
+static size_t plain_span(const char *s, size_t n, const char *set)
+{
+  for (size_t i = 0; i < n; i++)
+    if (strchr(set, s[i]) && s[i] != '\0')
+      return i;
+  return n;
+}
+
+static size_t plain_ctl(const char *s, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    if ((unsigned char) s[i] <= ' ')
+      return i;
+  return n;
+}
+
+/* Fill a buffer with characters that stop neither scan, then put in
+   a few that stop one or the other, so that each is found in every
+   position relative to the blocks the scans work through. */
+static void fill(unsigned long *seed, char *buf, size_t n, const char *stops)
+{
+  size_t ns = strlen(stops);
+
+  for (size_t i = 0; i < n; i++)
+    buf[i] = 'a' + next(seed) % 26 + (next(seed) % 2 ? 0 : 'A' - 'a');
+  for (int k = next(seed) % 3; k > 0; k--)
+    buf[next(seed) % n] = stops[next(seed) % ns];
+  for (size_t i = 0; i < n; i++)
+    if (next(seed) % 8 == 0)
+      buf[i] = "\x80\xa0\xff~!" [next(seed) % 5];
+}
+
+int main(void)
+{
+  static const char *const sets[] = {
+    "<", "<&", "<&'", "<&'\"", "<&>]\n\t", "<&'\"\r\n\t]",
+  };
+  static const char stops[] = "<&'\"]>\n\t\r \x01\x1f";
+  unsigned long seed = 5;
+  char buf[BUF_MAX];
+
+  for (int round = 0; round < 20000; round++) {
+    size_t off = next(&seed) % 32;
+    size_t n = next(&seed) % (BUF_MAX - off);
+    const char *set = sets[next(&seed) % (sizeof sets / sizeof sets[0])];
+
+    if (n == 0)
+      continue;
+    fill(&seed, buf + off, n, stops);
+    CHECK(scan_span(buf + off, n, set) == plain_span(buf + off, n, set));
+    CHECK(scan_ctl(buf + off, n) == plain_ctl(buf + off, n));
+  }
+
+  /* Nothing to scan */
+  CHECK(scan_span(buf, 0, "<") == 0);
+  CHECK(scan_ctl(buf, 0) == 0);
+
+  return test_result("scan");
+}
@@ -0,0 +1,136 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stddef.h>
+
+#include "shape.h"
+#include "test.h"
+
+#define KAPPA 0.5522847498
+
+/* The number of words in an array of path elements */
+#define LEN(a) (sizeof (a) / sizeof (a)[0])
+
+static int classify(const int *d, size_t n, int stroked, struct shape *sh)
+{
+  return shape_classify(d, d + n, stroked, sh);
+}
+
+static void test_rect(void)
+{
+  static const int closed[] = {
+    2, 10, 20, 8, 110, 20, 8, 110, 70, 8, 10, 70, 5, 0
+  };
+  static const int repeated[] = {
+    2, 10, 20, 8, 10, 70, 8, 110, 70, 8, 110, 20, 8, 10, 20, 5, 0
+  };
+  static const int open[] = {
+    2, 10, 20, 8, 110, 20, 8, 110, 70, 8, 10, 70, 0
+  };
+  struct shape sh;
+
+  CHECK(classify(closed, LEN(closed), true, &sh) == SHAPE_RECT);
+  CHECK(sh.x0 == 10 && sh.y0 == 20 && sh.x1 == 110 && sh.y1 == 70);
+  CHECK(classify(repeated, LEN(repeated), true, &sh) == SHAPE_RECT);
+  CHECK(sh.x0 == 10 && sh.y0 == 20 && sh.x1 == 110 && sh.y1 == 70);
+
+  /* Stroked but not closed, the ends would be capped. */
+  CHECK(classify(open, LEN(open), true, &sh) == SHAPE_POLYLINE);
+  CHECK(sh.el == open && sh.n == 4);
+  CHECK(classify(open, LEN(open), false, &sh) == SHAPE_RECT);
+}
+
+static void test_lines(void)
+{
+  static const int line[] = { 2, 0, 0, 8, 300, 400, 0 };
+  static const int tri[] = { 2, 0, 0, 8, 300, 0, 8, 0, 400, 5, 0 };
+  static const int skew[] = {
+    2, 0, 0, 8, 100, 10, 8, 100, 100, 8, 0, 100, 5, 0
+  };
+  static const int two[] = { 2, 0, 0, 8, 10, 0, 2, 20, 20, 8, 30, 30, 0 };
+  struct shape sh;
+
+  CHECK(classify(line, LEN(line), true, &sh) == SHAPE_LINE);
+  CHECK(sh.x0 == 0 && sh.y0 == 0 && sh.x1 == 300 && sh.y1 == 400);
+  CHECK(classify(tri, LEN(tri), true, &sh) == SHAPE_POLYGON);
+  CHECK(sh.n == 3);
+  CHECK(classify(skew, LEN(skew), true, &sh) == SHAPE_POLYGON);
+  CHECK(sh.n == 4);
+
+  /* Only a single subpath is a shape. */
+  CHECK(classify(two, LEN(two), true, &sh) == SHAPE_NONE);
+}
+
+/* Write the four curves of an ellipse in a box, starting at the
+   middle of its right side and going anticlockwise. */
+static size_t make_ellipse(int *d, int x0, int y0, int x1, int y1)
+{
+  int cx = (x0 + x1) / 2, cy = (y0 + y1) / 2;
+  int kx = (int) (KAPPA * (x1 - x0) / 2.0 + 0.5);
+  int ky = (int) (KAPPA * (y1 - y0) / 2.0 + 0.5);
+  int pts[5][2] = { { x1, cy }, { cx, y1 }, { x0, cy }, { cx, y0 },
+                    { x1, cy } };
+  size_t n = 0;
+
+  d[n++] = 2, d[n++] = pts[0][0], d[n++] = pts[0][1];
+  for (int i = 0; i < 4; i++) {
+    const int *a = pts[i], *b = pts[i + 1];
+    int side = a[0] == x0 || a[0] == x1;
+
+    d[n++] = 6;
+    if (side) {
+      d[n++] = a[0], d[n++] = a[1] + (b[1] > a[1] ? ky : -ky);
+      d[n++] = b[0] + (a[0] > b[0] ? kx : -kx), d[n++] = b[1];
+    } else {
+      d[n++] = a[0] + (b[0] > a[0] ? kx : -kx), d[n++] = a[1];
+      d[n++] = b[0], d[n++] = b[1] + (a[1] > b[1] ? ky : -ky);
+    }
+    d[n++] = b[0], d[n++] = b[1];
+  }
+  d[n++] = 5;
+  d[n++] = 0;
+  return n;
+}
+
+static void test_ellipse(void)
+{
+  int d[40];
+  size_t n = make_ellipse(d, 0, 0, 2000, 1000);
+  struct shape sh;
+
+  CHECK(classify(d, n, true, &sh) == SHAPE_ELLIPSE);
+  CHECK(sh.x0 == 0 && sh.y0 == 0 && sh.x1 == 2000 && sh.y1 == 1000);
+
+  /* A control point off the tangent makes it some other curve. */
+  d[4] += 50;
+  CHECK(classify(d, n, true, &sh) == SHAPE_NONE);
+}
+
+int main(void)
+{
+  test_rect();
+  test_lines();
+  test_ellipse();
+  return test_result("shape");
+}
@@ -0,0 +1,213 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "stroke.h"
+#include "test.h"
+
+#define LEN(a) (sizeof (a) / sizeof (a)[0])
+
+/* The caps found */
+struct caps {
+  int n;
+  int cap[20];
+  double x[20], y[20], dx[20], dy[20];
+};
+
+static void got_cap(void *ctx, const struct stroke *s, int cap,
+                    double x, double y, double dx, double dy)
+{
+  struct caps *c = ctx;
+
+  (void) s;
+  if (c->n < (int) LEN(c->cap)) {
+    c->cap[c->n] = cap;
+    c->x[c->n] = x, c->y[c->n] = y;
+    c->dx[c->n] = dx, c->dy[c->n] = dy;
+  }
+  c->n++;
+}
+
+static int near(double a, double b)
+{
+  return fabs(a - b) <= 0.5;
+}
+
+/* Is cap 'i' of kind 'cap' at (x, y), facing (dx, dy)? */
+static int is_cap(const struct caps *c, int i, int cap,
+                  double x, double y, double dx, double dy)
+{
+  return c->cap[i] == cap && near(c->x[i], x) && near(c->y[i], y) &&
+    fabs(c->dx[i] - dx) < 1e-6 && fabs(c->dy[i] - dy) < 1e-6;
+}
+
+static struct stroke line_stroke(double width, int start_cap, int end_cap)
+{
+  struct stroke s;
+
+  memset(&s, 0, sizeof s);
+  s.width = width;
+  s.start_cap = start_cap;
+  s.end_cap = end_cap;
+  return s;
+}
+
+static void test_init(void)
+{
+  int d[14] = { 2, sizeof d, 0, 0, 0, 0, 0, 0, 0,
+                1 | 2 << 2 | 3 << 4 | 1 << 7 | 32 << 16 | 16 << 24,
+                50, 2, 100, 200 };
+  struct stroke s;
+
+  stroke_init(&s, d, 20.0);
+  CHECK(s.width == 20.0);
+  CHECK(s.join == 1);
+  CHECK(s.end_cap == 2);
+  CHECK(s.start_cap == 3);
+  CHECK(s.tri_width == 40.0);
+  CHECK(s.tri_length == 20.0);
+  CHECK(s.dash == d + 12 && s.ndash == 2 && s.dash_offset == 50);
+
+  d[8] = 300;
+  d[9] = 0;
+  stroke_init(&s, d, 20.0);
+  CHECK(s.width == 300.0);
+  CHECK(s.dash == NULL);
+}
+
+static void test_caps(void)
+{
+  static const int line[] = { 2, 0, 0, 8, 1000, 0, 0 };
+  static const int bend[] = { 2, 0, 0, 8, 0, 1000, 8, 1000, 1000, 0 };
+  static const int square[] = {
+    2, 0, 0, 8, 1000, 0, 8, 1000, 1000, 8, 0, 1000, 5, 0
+  };
+  static const int dashes[] = { 100, 100 };
+  struct stroke s = line_stroke(100, 1, 2);
+  struct caps c;
+
+  /* Each end of an open subpath, facing away from it */
+  memset(&c, 0, sizeof c);
+  stroke_caps(&s, line, line + LEN(line), 1.0, got_cap, &c);
+  CHECK(c.n == 2);
+  CHECK(is_cap(&c, 0, 1, 0, 0, -1, 0));
+  CHECK(is_cap(&c, 1, 2, 1000, 0, 1, 0));
+
+  memset(&c, 0, sizeof c);
+  stroke_caps(&s, bend, bend + LEN(bend), 1.0, got_cap, &c);
+  CHECK(c.n == 2);
+  CHECK(is_cap(&c, 0, 1, 0, 0, 0, -1));
+  CHECK(is_cap(&c, 1, 2, 1000, 1000, 1, 0));
+
+  /* A closed subpath has none. */
+  memset(&c, 0, sizeof c);
+  stroke_caps(&s, square, square + LEN(square), 1.0, got_cap, &c);
+  CHECK(c.n == 0);
+
+  /* Each dash has two. */
+  s.dash = dashes;
+  s.ndash = LEN(dashes);
+  memset(&c, 0, sizeof c);
+  stroke_caps(&s, line, line + LEN(line), 1.0, got_cap, &c);
+  CHECK(c.n == 10);
+  CHECK(is_cap(&c, 0, 1, 0, 0, -1, 0));
+  CHECK(is_cap(&c, 1, 2, 100, 0, 1, 0));
+  CHECK(is_cap(&c, 9, 2, 900, 0, 1, 0));
+}
+
+/* Find the box of the points of some path elements. */
+static void path_box(const int *v, double *box)
+{
+  box[0] = box[1] = 1e9;
+  box[2] = box[3] = -1e9;
+  while (*v != 0) {
+    int n = *v == 2 || *v == 8 ? 1 : *v == 6 ? 3 : 0;
+    if (n == 0 && *v != 5) {
+      box[0] = box[2] = 0;
+      return;
+    }
+    for (int k = 0; k < n; k++) {
+      double x = v[1 + 2 * k], y = v[2 + 2 * k];
+      if (x < box[0]) box[0] = x;
+      if (y < box[1]) box[1] = y;
+      if (x > box[2]) box[2] = x;
+      if (y > box[3]) box[3] = y;
+    }
+    v += 1 + 2 * n;
+  }
+}
+
+static int is_box(const double *box, double x0, double y0,
+                  double x1, double y1)
+{
+  return near(box[0], x0) && near(box[1], y0) &&
+    near(box[2], x1) && near(box[3], y1);
+}
+
+static void test_outline(void)
+{
+  static const int line[] = { 2, 0, 0, 8, 1000, 0, 0 };
+  struct stroke_space sp;
+  struct stroke s;
+  double box[4];
+
+  stroke_space_init(&sp);
+
+  /* Butt caps stop at the ends, and square ones go beyond. */
+  s = line_stroke(100, 0, 0);
+  stroke_outline(&s, line, line + LEN(line), 1.0, &sp);
+  CHECK(sp.n > 0 && sp.v[sp.n - 1] == 0);
+  path_box(sp.v, box);
+  CHECK(is_box(box, 0, -50, 1000, 50));
+
+  s = line_stroke(100, 2, 2);
+  stroke_outline(&s, line, line + LEN(line), 1.0, &sp);
+  path_box(sp.v, box);
+  CHECK(is_box(box, -50, -50, 1050, 50));
+
+  /* Starting 200 into 100 on and 300 off, only 200 to 300 and 600 to
+     700 are drawn. */
+  {
+    static const int dashes[] = { 100, 300 };
+    s = line_stroke(100, 0, 0);
+    s.dash = dashes;
+    s.ndash = LEN(dashes);
+    s.dash_offset = 200;
+    stroke_outline(&s, line, line + LEN(line), 1.0, &sp);
+    path_box(sp.v, box);
+    CHECK(is_box(box, 200, -50, 700, 50));
+  }
+
+  stroke_space_free(&sp);
+}
+
+int main(void)
+{
+  test_init();
+  test_caps();
+  test_outline();
+  return test_result("stroke");
+}
@@ -0,0 +1,244 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+   draw2svg: converts RISC OS drawfiles to SVG
+   Copyright (C) 2000-1,2005-6,2012,2019  Steven Simpson
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+   Author contact: <https://github.com/simpsonst>
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "context.h"
+#include "fmt.h"
+#include "style.h"
+#include "test.h"
+
+/* What the styles wrote, with each line after the first indented as
+   it would be */
+static char text[1024];
+static size_t len;
+
+static void put(const struct ws *ws, const char *s, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    if (len > 0 && text[len - 1] == '\n' && s[i] != '\n')
+      for (int j = 0; j < ws->indent && len < sizeof text - 1; j++)
+        text[len++] = ' ';
+    if (len < sizeof text - 1)
+      text[len++] = s[i];
+  }
+  text[len] = '\0';
+}
+
+int output(struct ws *ws, int pretty, const char *fmt, ...)
+{
+  char buf[256];
+  va_list ap;
+  int n;
+
+  (void) pretty;
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof buf, fmt, ap);
+  va_end(ap);
+  put(ws, buf, n);
+  return 0;
+}
+
+int output_str(struct ws *ws, int pretty, const char *s, size_t n)
+{
+  (void) pretty;
+  put(ws, s, n);
+  return 0;
+}
+
+void output_nums(struct ws *ws, const char *pre, int n, const double *v,
+                 const char *sep, const char *post)
+{
+  put(ws, pre, strlen(pre));
+  for (int i = 0; i < n; i++) {
+    char buf[FMT_DBL_MAX];
+    if (i > 0)
+      put(ws, sep, strlen(sep));
+    put(ws, buf, fmt_double(buf, v[i]) - buf);
+  }
+  put(ws, post, strlen(post));
+}
+
+void output_colour(struct ws *ws, const char *pre, unsigned long c,
+                   const char *post)
+{
+  char buf[FMT_COL_MAX];
+  put(ws, pre, strlen(pre));
+  put(ws, buf, fmt_colour(buf, c) - buf);
+  put(ws, post, strlen(post));
+}
+
+double map_size(const struct ws *ws, double l)
+{
+  return l * ws->uscale;
+}
+
+static struct ws ws;
+
+static void start(void)
+{
+  len = 0;
+  text[0] = '\0';
+}
+
+static int wrote(const char *s)
+{
+  if (strcmp(text, s)) {
+    fprintf(stderr, "wrote \"%s\"\n", text);
+    return false;
+  }
+  return true;
+}
+
+static struct style red_fill(void)
+{
+  struct style st;
+  memset(&st, 0xaa, sizeof st);
+  st.set = ST_FILL;
+  st.fill = 0x0000ff00ul;
+  return st;
+}
+
+static struct style blue_line(double width)
+{
+  struct style st;
+  memset(&st, 0x55, sizeof st);
+  st.set = ST_STROKE | ST_STROKE_WIDTH | ST_FILL;
+  st.stroke = 0xff000000ul;
+  st.width = width;
+  st.fill = STYLE_NONE;
+  return st;
+}
+
+static void test_intern(void)
+{
+  struct styles ss;
+  struct style a = red_fill(), b = red_fill();
+
+  /* Properties not set don't tell styles apart. */
+  memset(&b.stroke, 0, sizeof b.stroke);
+  b.width = 3.0;
+
+  styles_init(&ss);
+  style_intern(&ss, &a);
+  style_intern(&ss, &b);
+  for (int i = 0; i < 200; i++) {
+    struct style c = blue_line(i % 100);
+    style_intern(&ss, &c);
+  }
+  CHECK(ss.n == 101);
+  CHECK(ss.ents[0].uses == 2);
+  CHECK(ss.ents[1].uses == 2);
+  CHECK(ss.ents[1].st.width == 0.0);
+  CHECK(ss.ents[100].uses == 2);
+  styles_free(&ss);
+}
+
+static void test_common(void)
+{
+  struct style acc = blue_line(640), st = blue_line(640);
+
+  style_common(&acc, &st);
+  CHECK(acc.set == (ST_STROKE | ST_STROKE_WIDTH | ST_FILL));
+  st.width = 320;
+  st.fill = 0;
+  style_common(&acc, &st);
+  CHECK(acc.set == ST_STROKE);
+  st = red_fill();
+  style_common(&acc, &st);
+  CHECK(acc.set == 0);
+}
+
+static void test_sheet(void)
+{
+  struct styles ss;
+  struct style once = blue_line(1280), twice = blue_line(640),
+    fill = red_fill();
+
+  styles_init(&ss);
+  style_intern(&ss, &once);
+  style_intern(&ss, &twice);
+  style_intern(&ss, &fill);
+  style_intern(&ss, &twice);
+  style_intern(&ss, &fill);
+
+  /* Only styles used more than once get classes. */
+  start();
+  style_sheet(&ws, &ss);
+  CHECK(wrote("<style type='text/css'>\n"
+              "  .s1 { stroke: #0000FF;\n"
+              "        stroke-width: 1;\n"
+              "        fill: none; }\n"
+              "  .s2 { fill: #FF0000; }\n"
+              "</style>\n"));
+  CHECK(ws.indent == 0);
+  CHECK(ss.classes == 2);
+  CHECK(ss.ents[0].id == 0);
+
+  /* Elements with classes name them, and others are styled inline,
+     with continued declarations lined up as asked. */
+  ws.styles = &ss;
+  start();
+  style_attr(&ws, &twice, " ", "/>");
+  CHECK(wrote(" class='s1'/>"));
+  start();
+  style_attr(&ws, &once, "<path ", "/>");
+  CHECK(wrote("<path style='stroke: #0000FF;\n"
+              "       stroke-width: 2;\n"
+              "       fill: none;'/>"));
+  start();
+  style_attr_flush(&ws, &once, "<text ", ">");
+  CHECK(wrote("<text style='stroke: #0000FF;\n"
+              "stroke-width: 2;\n"
+              "fill: none;'>"));
+
+  /* What the enclosing group sets is left out, unless it's all
+     there is. */
+  ws.hoist = ST_STROKE | ST_FILL;
+  start();
+  style_attr(&ws, &once, " ", "/>");
+  CHECK(wrote(" style='stroke-width: 2;'/>"));
+  ws.hoist = ST_FILL;
+  start();
+  style_attr(&ws, &fill, " ", "/>");
+  CHECK(wrote(" class='s2'/>"));
+  ws.styles = NULL;
+  start();
+  style_attr(&ws, &fill, " ", "/>");
+  CHECK(wrote("/>"));
+  ws.hoist = 0;
+
+  styles_free(&ss);
+}
+
+int main(void)
+{
+  ws.uscale = 1.0 / 640.0;
+  test_intern();
+  test_common();
+  test_sheet();
+  return test_result("style");
+}
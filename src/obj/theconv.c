@@ -29,12 +29,16 @@
 #include <stdarg.h>
 #include <math.h>
 #include <string.h>
+#include <ctype.h>
+#include <assert.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <kernel.h>
 #include <swis.h>
 
 #include <riscos/swi/OS.h>
-#include <riscos/swi/Draw.h>
 #include <riscos/swi/Font.h>
 #include <riscos/swi/ColourTrans.h>
 
@@ -42,32 +46,369 @@
 #include "context.h"
 #include "files.h"
 #include "units.h"
-
-const char *join_str[] = { "miter", "round", "bevel", "inherit" };
-const char *cap_str[] = { "butt", "round", "square", "inherit" };
-const char *wind_str[] = { "nonzero", "evenodd" };
+#include "fmt.h"
+#include "sink.h"
+#include "pathopt.h"
+#include "style.h"
+#include "defs.h"
+#include "shape.h"
+#include "occlude.h"
+#include "extent.h"
+#include "rtree.h"
+#include "stroke.h"
+#include "marker.h"
+#include "glyph.h"
+#include "ofont.h"
+#include "nomem.h"
 
 void convert(struct ws *, const int *);
 
+static char *put_str(char *p, const char *s)
+{
+  size_t n = strlen(s);
+  memcpy(p, s, n);
+  return p + n;
+}
+
+/* Emit a path command and its real operands as one token.  In
+   compact output, fractions lose their leading zeroes, and no
+   separator is written before a minus sign, or before a point that
+   can't belong to the previous number. */
+void path_num(struct ws *ws, const char *cmd, int n, ...)
+{
+  char buf[8 + 7 * (FMT_DBL_MAX + 1)], *p;
+  int compact = ws->ct->compact;
+  int dot = false;
+  va_list ap;
+
+  assert(n <= 7);
+  p = put_str(buf, cmd);
+  va_start(ap, n);
+  for (int i = 0; i < n; i++) {
+    char num[FMT_DBL_MAX], *np = num, *ne;
+
+    ne = fmt_double(num, va_arg(ap, double));
+    if (!compact) {
+      if (i > 0) *p++ = ' ';
+    } else {
+      if (ne - np > 2 && np[0] == '0' && np[1] == '.') {
+        np++;
+      } else if (ne - np > 3 && np[0] == '-' && np[1] == '0' &&
+                 np[2] == '.') {
+        *++np = '-';
+      }
+      if (i > 0 && np[0] != '-' && (np[0] != '.' || !dot))
+        *p++ = ' ';
+      dot = memchr(np, '.', ne - np) != NULL;
+    }
+    memcpy(p, np, ne - np);
+    p += ne - np;
+  }
+  va_end(ap);
+  output_str(ws, true, buf, p - buf);
+}
+
+/* Emit text, a list of numbers, and more text. */
+void output_nums(struct ws *ws, const char *pre, int n, const double *v,
+                 const char *sep, const char *post)
+{
+  char buf[80 + 6 * (FMT_DBL_MAX + 8)], *p;
+
+  assert(n <= 6);
+  assert(strlen(pre) + strlen(post) < 80 && strlen(sep) < 8);
+  p = put_str(buf, pre);
+  for (int i = 0; i < n; i++) {
+    if (i > 0) p = put_str(p, sep);
+    p = fmt_double(p, v[i]);
+  }
+  p = put_str(p, post);
+  output_str(ws, false, buf, p - buf);
+}
+
+/* Emit text, a drawfile colour as #RRGGBB, and more text. */
+void output_colour(struct ws *ws, const char *pre, unsigned long c,
+                   const char *post)
+{
+  char buf[80 + FMT_COL_MAX], *p;
+
+  assert(strlen(pre) + strlen(post) < 80);
+  p = put_str(buf, pre);
+  p = fmt_colour(p, c);
+  p = put_str(p, post);
+  output_str(ws, false, buf, p - buf);
+}
+
+/* Map a drawfile x or y coordinate to user space.  The y axis is
+   inverted. */
+static double map_x(const struct ws *ws, double x)
+{
+  x *= ws->uscale;
+  return (ws->grid ? floor(x + 0.5) : x) - ws->ox;
+}
+
+static double map_y(const struct ws *ws, double y)
+{
+  y *= -ws->uscale;
+  return (ws->grid ? floor(y + 0.5) : y) - ws->oy;
+}
+
+/* Convert a user-space coordinate to an integer, clamped to the range
+   of one, as a fine grid can take far-flung objects out of it. */
+static int clamp_int(double v)
+{
+  if (v <= INT_MIN)
+    return INT_MIN;
+  if (v >= INT_MAX)
+    return INT_MAX;
+  return (int) v;
+}
+
+static int map_ix(const struct ws *ws, int x)
+{
+  double v = x;
+
+  return clamp_int((ws->grid ? floor(v * ws->uscale + 0.5) : v) - ws->ox);
+}
+
+static int map_iy(const struct ws *ws, int y)
+{
+  double v = -(double) y;
+
+  return clamp_int((ws->grid ? floor(v * ws->uscale + 0.5) : v) - ws->oy);
+}
+
+/* Map a distance along a path to user space. */
+static double map_len(const struct ws *ws, double l)
+{
+  l *= ws->uscale;
+  return ws->grid ? floor(l + 0.5) : l;
+}
+
+/* Map a line width, dash length or font size to user space.  These
+   are kept to a finer grid than coordinates, so thin lines don't
+   vanish. */
+double map_size(const struct ws *ws, double l)
+{
+  l *= ws->uscale;
+  return ws->grid ? floor(l * 100.0 + 0.5) / 100.0 : l;
+}
+
+/* Set a style's fill from a drawfile colour word, whose low byte
+   gives its transparency. */
+static void set_fill(struct style *st, unsigned long c)
+{
+  unsigned ftr = ~c & 0xff;
+
+  st->set |= ST_FILL;
+  if (ftr == 0) {
+    st->fill = STYLE_NONE;
+    return;
+  }
+  st->fill = c & ~0xfful;
+  if (ftr != 255) {
+    st->set |= ST_FILL_OPACITY;
+    st->fill_opacity = ftr;
+  }
+}
+
+static void text_style(struct ws *ws, const int *d, struct style *st)
+{
+  int off = d[0] == 12 ? 7 : 0;
+
+  st->set = ST_FONT_FAMILY | ST_FONT_SIZE;
+  st->font = ws->font[d[8 + off] & 0xff];
+  st->font_size = d[9 + off];
+  set_fill(st, d[6 + off]);
+}
+
+/* Get the opacity of a path's outline.  At a level of detail, a
+   filled path loses an outline too thin to see. */
+static unsigned outline_opacity(const struct ws *ws, const int *d)
+{
+  if (ws->lod > 0 && (~d[6] & 0xff) != 0 && d[8] < ws->lod)
+    return 0;
+  return ~d[7] & 0xff;
+}
+
+/* Does a path need its caps drawn separately, or its whole outline
+   written as an area? */
+static int path_divided(const struct ws *ws, const int *d)
+{
+  int scap = (d[9]>>4)&3;
+  int ecap = (d[9]>>2)&3;
+  unsigned otr = outline_opacity(ws, d);
+
+  /*
+    Decide whether the path can be represented by a single SVG <path>:
+
+      * the start and end caps must be the same
+      * they must not use triangles
+
+    but it doesn't matter if the outline is transparent or thin.
+  */
+  return otr != 0 && (ws->ct->stroke_fill ||
+                      (d[8] != 0 &&
+                       (scap != ecap || scap == 3 || ecap == 3)));
+}
+
+static int element_words(int code);
+
+/* Can a path's caps be drawn by markers?  They go only at the ends of
+   the whole path, so it must be a single open subpath without dashes,
+   and leave its start and reach its end in a definite direction. */
+static int path_marked(const struct ws *ws, const int *d)
+{
+  const int *p = d + 10, *e = d + (d[1] >> 2);
+  int x, y, w, n = 0, moved = true;
+
+  if (!ws->markers || (d[9]>>7)&1 || p >= e || p[0] != 2)
+    return false;
+  x = p[1];
+  y = p[2];
+  for (p += 3; p < e && (w = element_words(p[0])) > 0; p += w) {
+    if (p[0] != 6 && p[0] != 8)
+      return false;
+    if (n++ == 0 && p[1] == x && p[2] == y)
+      return false;
+
+    /* Note whether the element arrives from somewhere else. */
+    if (p[0] == 6)
+      moved = p[3] != p[5] || p[4] != p[6];
+    else
+      moved = p[1] != x || p[2] != y;
+    x = p[w - 2];
+    y = p[w - 1];
+  }
+  return n > 0 && moved;
+}
+
+/* Set the markers that draw a path's caps, numbering any new ones. */
+static void path_markers(struct ws *ws, const int *d, struct style *st)
+{
+  int scap = (d[9]>>4)&3;
+  int ecap = (d[9]>>2)&3;
+  struct marker m;
+
+  m.colour = d[7];
+  if (scap != 0) {
+    m.cap = scap;
+    m.end = false;
+    m.tri_width = scap == 3 ? (d[9] >> 16) & 0xff : 0;
+    m.tri_length = scap == 3 ? (d[9] >> 24) & 0xff : 0;
+    st->set |= ST_MARKER_START;
+    st->marker_start = marker_intern(ws->markers, &m);
+  }
+  if (ecap != 0) {
+    m.cap = ecap;
+    m.end = true;
+    m.tri_width = ecap == 3 ? (d[9] >> 16) & 0xff : 0;
+    m.tri_length = ecap == 3 ? (d[9] >> 24) & 0xff : 0;
+    st->set |= ST_MARKER_END;
+    st->marker_end = marker_intern(ws->markers, &m);
+  }
+}
+
+static void path_style(struct ws *ws, const int *d, int divide,
+                       struct style *st)
+{
+  int join = d[9]&3;
+  int scap = divide ? 0 : (d[9]>>4)&3;
+  int wind = (d[9]>>6)&1;
+  int dash = (d[9]>>7)&1;
+  unsigned otr = outline_opacity(ws, d);
+
+  st->set = ST_STROKE;
+  if (otr == 0 || (divide && ws->ct->stroke_fill)) {
+    st->stroke = STYLE_NONE;
+  } else {
+    st->stroke = d[7] & ~0xfful;
+    if (otr != 255) {
+      st->set |= ST_STROKE_OPACITY;
+      st->stroke_opacity = otr;
+    }
+    if (scap != 0) {
+      st->set |= ST_LINECAP;
+      st->cap = scap;
+    }
+    if (join != 0) {
+      st->set |= ST_LINEJOIN;
+      st->join = join;
+    }
+    if (dash) {
+      st->set |= ST_DASH;
+      st->dash_offset = d[10];
+      st->ndash = d[11];
+      st->dash = d + 12;
+    }
+    st->set |= ST_STROKE_WIDTH;
+    st->width = d[8] ? d[8] : ws->ct->thin;
+    if (divide && path_marked(ws, d))
+      path_markers(ws, d, st);
+  }
+
+  set_fill(st, d[6]);
+  if (st->fill != STYLE_NONE && wind != 1) {
+    st->set |= ST_FILL_RULE;
+    st->rule = wind;
+  }
+}
+
+/* Caps drawn separately are filled with the outline colour. */
+static void caps_style(const int *d, struct style *st)
+{
+  st->set = ST_STROKE | ST_FILL_RULE;
+  st->stroke = STYLE_NONE;
+  st->rule = 0;
+  set_fill(st, d[7]);
+}
+
 void convert_tagged(struct ws *ws, const int *d)
 {
   convert(ws, d + 6);
 }
 
 void plot_path(struct ws *ws, const int *d, const int *e);
+static void plot_elements(struct pathopt *po, const int *d, const int *e);
 
-void convert_text_path(struct ws *ws, const int *d)
+/* Identify a font found by the font manager by the length and date
+   stamp of its outlines, as another font may be installed under the
+   same name between conversions.  Return 0 on success. */
+static int font_file_id(const char *name, unsigned *id)
+{
+  static const char *const leaves[] = { "Outlines", "Outlines0" };
+  char path[256];
+  unsigned stamp[2];
+  size_t len;
+  int ft;
+
+  for (size_t i = 0; i < sizeof leaves / sizeof leaves[0]; i++) {
+    if (snprintf(path, sizeof path, "Font:%s.%s", name, leaves[i]) >=
+        (int) sizeof path)
+      return -1;
+    if (get_file_type_and_length(path, &ft, &len) == 1 &&
+        get_file_stamp(path, stamp) == 1) {
+      /* The stamp is the low byte of the load address and all of the
+         execution address. */
+      id[0] = len;
+      id[1] = stamp[1] ^ (stamp[0] & 0xff) << 24;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Find the font for a text object, trying stand-ins if it can't be
+   found.  Each font is looked up once per conversion, and kept until
+   the end of it.  Fonts are identified by the files they were read
+   from, and their glyphs aren't cached if those can't be found. */
+static int text_font(struct ws *ws, const int *d)
 {
   _kernel_oserror *err = NULL;
+  struct ofont *outline = NULL;
   int off = d[0] == 12 ? 7 : 0;
-  int fh;
-  size_t len;
-  unsigned flags = 1 << 8;
-  int ftr;
-  int *pos, *end;
-  int or0, or1;
-  int rule;
-  int fn;
+  struct font_entry *fe;
+  int fh = -1;
+  size_t fn;
   struct {
     const char *name;
     double xscale, yscale;
@@ -77,57 +418,352 @@ void convert_text_path(struct ws *ws, const int *d)
     { "Corpus.Medium", 1.6, 1.5 }
   };
 
-  if (d[0] == 12) {
-    off = 7;
-    flags |= (1 << 6) | ((d[12] & 3) << 9);
-  } else {
-    off = 0;
-  }
-
   altfont[0].name = ws->font[d[8 + off] & 0xff];
+  fe = glyph_font_find(ws->glyphs, altfont[0].name,
+                       d[9 + off], d[10 + off]);
+  if (fe)
+    return fe->handle;
+
   for (fn = !strcmp(altfont[0].name, altfont[1].name);
-       fn >= 0 && (size_t) fn < sizeof altfont / sizeof altfont[0] &&
-       (err = _swix(Font_FindFont, _INR(1,5)|_OUT(0), altfont[fn].name,
-                    (int) (d[9 + off] * altfont[fn].xscale / 40),
-                    (int) (d[10 + off] * altfont[fn].yscale / 40),
-                    0, 0, &fh)) != NULL;
-       fn++) {
-    fprintf(stderr, "Font \"%s\" conversion: %s\n",
-            (char *) (d + 13 + off), err->errmess);
-  }
-  if (err)
-    return;
+       fn < sizeof altfont / sizeof altfont[0]; fn++) {
+    if (ws->ct->font_dir) {
+      outline = ofont_open(ws->ct->font_dir, altfont[fn].name);
+      if (outline) {
+        fh = ws->glyphs->nfonts;
+        break;
+      }
+      fprintf(stderr, "Font \"%s\" conversion: %s not in %s\n",
+              (char *) (d + 13 + off), altfont[fn].name, ws->ct->font_dir);
+    } else {
+      err = _swix(Font_FindFont, _INR(1,5)|_OUT(0), altfont[fn].name,
+                  (int) (d[9 + off] * altfont[fn].xscale / 40),
+                  (int) (d[10 + off] * altfont[fn].yscale / 40),
+                  0, 0, &fh);
+      if (!err)
+        break;
+      fprintf(stderr, "Font \"%s\" conversion: %s\n",
+              (char *) (d + 13 + off), err->errmess);
+      fh = -1;
+    }
+  }
+  fe = glyph_font_add(ws->glyphs, altfont[0].name,
+                      d[9 + off], d[10 + off], fh);
+  if (outline) {
+    fe->outline = outline;
+    fe->xscale = altfont[fn].xscale;
+    fe->yscale = altfont[fn].yscale;
+    ofont_id(outline, fe->id);
+    fe->keyed = true;
+  } else if (fh >= 0) {
+    fe->keyed = font_file_id(altfont[fn].name, fe->id) == 0;
+  }
+  return fh;
+}
+
+/* Release the fonts found for text. */
+static void lose_fonts(struct ws *ws)
+{
+  for (size_t i = 0; i < ws->glyphs->nfonts; i++)
+    if (ws->glyphs->fonts[i].outline)
+      ofont_close(ws->glyphs->fonts[i].outline);
+    else if (ws->glyphs->fonts[i].handle >= 0)
+      _swi(Font_LoseFont, _IN(0), ws->glyphs->fonts[i].handle);
+}
+
+/* Add the characters painted by this conversion to the cache file, if
+   there is one. */
+static void save_glyphs(struct ws *ws)
+{
+  const char *name = ws->ct->glyph_cache;
 
+  if (ws->ct->share_glyphs && name &&
+      glyph_cache_save(ws->glyphs, name) < 0)
+    fprintf(stderr, "Error writing %s\n", name);
+}
+
+/* Set out how a font read from a font directory lays out text, as
+   Font_Paint would with the same flags. */
+static void text_layout(const struct font_entry *fe, unsigned flags,
+                        const int *mat, struct ofont_layout *lo)
+{
+  lo->xsize = fe->xsize * fe->xscale;
+  lo->ysize = fe->ysize * fe->yscale;
+  lo->mat = flags & (1 << 6) ? mat : NULL;
+  lo->kern = flags >> 9 & 1;
+  lo->rtl = flags >> 10 & 1;
+}
+
+/* Paint a string at (x, y) in draw units into 'ws->buf' as Draw path
+   objects, sizing the buffer first. */
+static _kernel_oserror *paint_text(struct ws *ws, int fh, const char *s,
+                                   unsigned flags, int x, int y,
+                                   const int *mat, size_t *lenp)
+{
+  _kernel_oserror *err;
+  size_t len;
+  int or0, or1;
+
+  if (ws->ct->font_dir) {
+    const struct font_entry *fe = &ws->glyphs->fonts[fh];
+    struct ofont_layout lo;
+    struct ofont_buf ob = { NULL, 0, 0 };
+
+    text_layout(fe, flags, mat, &lo);
+    ofont_paint(fe->outline, &lo, s, strlen(s), x, y, &ob);
+    free(ws->buf);
+    ws->buf = ob.v;
+    *lenp = ob.n * sizeof *ob.v;
+    return NULL;
+  }
+
+  x = x * 25 / 16;
+  y = y * 25 / 16;
   _swi(ColourTrans_SetFontColours, _INR(0,3),
        fh, 0xffffff00, 0x00000000, 14);
   _swi(Font_SwitchOutputToBuffer, _INR(0,1)|_OUTR(0,1), 1, 8, &or0, &or1);
-  err = _swix(Font_Paint, _INR(0,4)|_IN(6), fh, (d + 13 + off), flags,
-              d[11 + off] * 25 / 16, d[12 + off] * 25 / 16, d + 6);
+  err = _swix(Font_Paint, _INR(0,4)|_IN(6), fh, s, flags, x, y, mat);
   _swi(Font_SwitchOutputToBuffer, _INR(0,1)|_OUT(1), 0, -1, &len);
   if (err) {
     _swi(Font_SwitchOutputToBuffer, _INR(0,1), 0, 0);
-    _swi(Font_LoseFont, _IN(0), fh);
-    fprintf(stderr, "Font \"%s\" conversion: %s\n",
-            (char *) (d + 13 + off), err->errmess);
-    return;
+    return err;
   }
 
   ws->buf = realloc(ws->buf, len);
   if (!ws->buf) {
     printf("Out of memory.\n");
     _swi(Font_SwitchOutputToBuffer, _INR(0,1), 0, 0);
-    _swi(Font_LoseFont, _IN(0), fh);
     exit(EXIT_FAILURE);
   }
   ((int *) ws->buf)[0] = 0;
   ((int *) ws->buf)[1] = len - 8;
   _swi(Font_SwitchOutputToBuffer, _INR(0,1), 0, ws->buf);
-  err = _swix(Font_Paint, _INR(0,4)|_IN(6), fh, (d + 13 + off), flags,
-              d[11 + off] * 25 / 16, d[12 + off] * 25 / 16, d + 6);
+  err = _swix(Font_Paint, _INR(0,4)|_IN(6), fh, s, flags, x, y, mat);
   _swi(Font_SwitchOutputToBuffer, _INR(0,1), 0, 0);
-  _swi(Font_LoseFont, _IN(0), fh);
+  *lenp = len;
+  return err && err->errnum != 0x1e4 ? err : NULL;
+}
+
+/* Find where the first 'n' characters of a string leave the pen, in
+   millipoints. */
+static _kernel_oserror *scan_text(struct ws *ws, int fh, const char *s,
+                                  size_t n, unsigned flags, const int *mat,
+                                  double *pen)
+{
+  _kernel_oserror *err;
+  int mp[2];
+
+  if (ws->ct->font_dir) {
+    struct ofont_layout lo;
+
+    text_layout(&ws->glyphs->fonts[fh], flags, mat, &lo);
+    ofont_scan(ws->glyphs->fonts[fh].outline, &lo, s, n, pen);
+    pen[0] = pen[0] * 25.0 / 16.0;
+    pen[1] = pen[1] * 25.0 / 16.0;
+    return NULL;
+  }
+
+  err = _swix(Font_ScanString, _INR(0,4)|_IN(6)|_IN(7)|_OUTR(3,4),
+              fh, s, flags | (1 << 7), INT_MAX, INT_MAX, mat, (int) n,
+              &mp[0], &mp[1]);
+  pen[0] = mp[0];
+  pen[1] = mp[1];
+  return err;
+}
+
+static const int identity[6] = { 1 << 16, 0, 0, 1 << 16, 0, 0 };
+
+/* Can a text object be written as copies of its characters?  Control
+   characters would change the font, and right-to-left text is laid
+   out differently. */
+static int text_shared(const struct ws *ws, const int *d)
+{
+  const unsigned char *s = (const unsigned char *) (d + 13);
+
+  if (!ws->ct->share_glyphs)
+    return false;
+  if (d[0] == 12) {
+    if (d[12] & 2)
+      return false;
+    s += 7 * sizeof *d;
+  }
+  for (; *s; s++)
+    if (*s < 32 || *s == 127)
+      return false;
+  return true;
+}
+
+/* Get the matrix of a text object without its translation, which is
+   applied where each character is used, so that one outline serves
+   wherever the text is. */
+static void glyph_matrix(const int *d, int *mat)
+{
+  memcpy(mat, d[0] == 12 ? d + 6 : identity, 4 * sizeof *mat);
+  mat[4] = mat[5] = 0;
+}
+
+/* Get the outline of a character of a text object's font, painting
+   it at the origin if it hasn't been seen before.  The object's
+   matrix, if it has one, is part of the outline. */
+static const struct glyph *text_glyph(struct ws *ws, const int *d,
+                                      int fh, int ch)
+{
+  int mat[6];
+  unsigned flags = d[0] == 12 ? (1 << 8) | (1 << 6) : 1 << 8;
+  const struct glyph *g;
+  _kernel_oserror *err;
+  double adv[2] = { 0.0, 0.0 };
+  int *obj = NULL;
+  char s[2];
+  size_t len;
+
+  glyph_matrix(d, mat);
+  g = glyph_find(ws->glyphs, fh, ch, mat);
+  if (g)
+    return g;
+  if (ws->ct->glyph_cache &&
+      (g = glyph_cache_find(ws->glyphs, fh, ch, mat)) != NULL)
+    return g;
+  s[0] = ch;
+  s[1] = '\0';
+  err = paint_text(ws, fh, s, flags, 0, 0, mat, &len);
+  if (!err)
+    err = scan_text(ws, fh, s, 1, flags, mat, adv);
+  if (err) {
+    fprintf(stderr, "Font character %d conversion: %s\n", ch, err->errmess);
+  } else {
+    const int *p = ws->buf, *e = p + (len >> 2);
+    size_t n;
+
+    while (p < e && p[0])
+      p += p[1] >> 2;
+    n = p - (const int *) ws->buf;
+    if (n > 0) {
+      obj = malloc((n + 1) * sizeof *obj);
+      if (!obj) nomem();
+      memcpy(obj, ws->buf, n * sizeof *obj);
+      obj[n] = 0;
+    }
+  }
+  return glyph_add(ws->glyphs, fh, ch, mat, obj, adv);
+}
+
+/* Find the outlines of the characters of a text object. */
+static void index_text(struct ws *ws, const int *d)
+{
+  const char *s = (const char *) (d + 13 + (d[0] == 12 ? 7 : 0));
+  int fh = text_font(ws, d);
+
+  if (fh < 0)
+    return;
+  for (; *s; s++)
+    text_glyph(ws, d, fh, *s & 0xff);
+}
+
+/* Were all the characters of a text object found before the outlines
+   were written?  Any that weren't can't be used. */
+static int text_indexed(struct ws *ws, const int *d, int fh)
+{
+  const char *s = (const char *) (d + 13 + (d[0] == 12 ? 7 : 0));
+  int mat[6];
+
+  glyph_matrix(d, mat);
+  for (; *s; s++)
+    if (!glyph_find(ws->glyphs, fh, *s & 0xff, mat))
+      return false;
+  return true;
+}
+
+/* Write text as copies of the outlines of its characters, each moved
+   to where the pen reaches it.  The pen moves on by each character's
+   advance, and, if the text is kerned, by the kerning between it and
+   the next, found by scanning the pair and taking off the next
+   character's advance. */
+static void convert_text_glyphs(struct ws *ws, const int *d, int fh)
+{
+  int off = d[0] == 12 ? 7 : 0;
+  const char *s = (const char *) (d + 13 + off);
+  const int *mat = d[0] == 12 ? d + 6 : identity;
+  unsigned flags = 1 << 8;
+  double pen[2] = { 0.0, 0.0 }, adv[2] = { 0.0, 0.0 };
+  struct style st;
+
+  /* The translation of the matrix is left out of the outlines. */
+  if (d[0] == 12) {
+    flags |= (1 << 6) | ((d[12] & 1) << 9);
+    pen[0] = mat[4];
+    pen[1] = mat[5];
+  }
+
+  st.set = ST_STROKE;
+  st.stroke = STYLE_NONE;
+  set_fill(&st, d[6 + off]);
+  output(ws, false, "<g");
+  ws->indent += 3;
+  style_attr(ws, &st, " ", ">\n");
+  ws->indent -= 1;
+
+  for (size_t i = 0; s[i]; i++) {
+    const struct glyph *g = text_glyph(ws, d, fh, s[i] & 0xff);
+    double xy[2];
+
+    if (i > 0 && (flags & (1 << 9))) {
+      double pair[2];
+      _kernel_oserror *err = scan_text(ws, fh, s + i - 1, 2, flags, mat,
+                                       pair);
+      if (err) {
+        fprintf(stderr, "Font \"%s\" conversion: %s\n", s, err->errmess);
+        break;
+      }
+      pen[0] += pair[0] - g->adv[0];
+      pen[1] += pair[1] - g->adv[1];
+    } else {
+      pen[0] += adv[0];
+      pen[1] += adv[1];
+    }
+    adv[0] = g->adv[0];
+    adv[1] = g->adv[1];
+    if (!g->id)
+      continue;
+    xy[0] = map_x(ws, d[11 + off] + pen[0] * 16.0 / 25.0);
+    xy[1] = map_y(ws, d[12 + off] + pen[1] * 16.0 / 25.0);
+    output(ws, false, "<use xlink:href='#c%u'", g->id);
+    output_nums(ws, " x='", 1, &xy[0], "", "'");
+    output_nums(ws, " y='", 1, &xy[1], "", "' />\n");
+    ws->glyph_uses++;
+  }
 
-  if (err && err->errnum != 0x1e4) {
+  ws->indent -= 2;
+  output(ws, false, "</g>\n");
+}
+
+void convert_text_path(struct ws *ws, const int *d)
+{
+  _kernel_oserror *err = NULL;
+  int off = d[0] == 12 ? 7 : 0;
+  int fh;
+  size_t len;
+  unsigned flags = 1 << 8;
+  int *pos, *end;
+  int rule;
+
+  if (d[0] == 12) {
+    off = 7;
+    flags |= (1 << 6) | ((d[12] & 3) << 9);
+  } else {
+    off = 0;
+  }
+
+  fh = text_font(ws, d);
+  if (fh < 0)
+    return;
+  if (text_shared(ws, d) && text_indexed(ws, d, fh)) {
+    convert_text_glyphs(ws, d, fh);
+    return;
+  }
+
+  err = paint_text(ws, fh, (const char *) (d + 13 + off), flags,
+                   d[11 + off], d[12 + off], d + 6, &len);
+  if (err) {
     fprintf(stderr, "Font \"%s\" conversion: %x %s\n",
             (char *) (d + 13 + off), err->errnum, err->errmess);
     return;
@@ -146,30 +782,21 @@ void convert_text_path(struct ws *ws, const int *d)
 #if false
   output(ws, false, "<!-- this is text-sourced -->\n");
 #endif
-  output(ws, false, "<g style='");
-  ws->indent += 10;
-
-  output(ws, false, "stroke: none;\n");
-
-  ftr = ~d[6 + off] & 0xff;
-
-  if (ftr == 0) {
-    output(ws, false, "fill: none;\n");
-  } else {
-    if (ftr != 255) {
-      output(ws, false, "fill-opacity: %g;\n", ftr/255.0);
-    }
-    if (rule != 1) {
-      output(ws, false, "fill-rule: %s;\n", wind_str[rule]);
+  {
+    struct style st;
+    st.set = ST_STROKE;
+    st.stroke = STYLE_NONE;
+    set_fill(&st, d[6 + off]);
+    if (st.fill != STYLE_NONE && rule != 1) {
+      st.set |= ST_FILL_RULE;
+      st.rule = rule;
     }
-    output(ws, false, "fill: #%02X%02X%02X;'>\n",
-            (d[6 + off]>>8)&0xff,
-            (d[6 + off]>>16)&0xff,
-            (d[6 + off]>>24)&0xff);
+    output(ws, false, "<g");
+    ws->indent += 3;
+    style_attr(ws, &st, " ", ">\n");
+    ws->indent -= 1;
   }
 
-  ws->indent -= 8;
-
   pos = ws->buf;
 #if false
   end = (int *) ws->buf + (len >> 2);
@@ -210,7 +837,8 @@ void convert_text_path(struct ws *ws, const int *d)
 void convert_text(struct ws *ws, const int *d)
 {
   int off = d[0] == 12 ? 7 : 0;
-  int ftr;
+  struct style st;
+  double pos[2];
 
   if (d[0] == 12) {
     off = 7;
@@ -218,7 +846,9 @@ void convert_text(struct ws *ws, const int *d)
     off = 0;
   }
 
-  output(ws, false, "<text x='%i' y='%i'\n", d[11 + off], -d[12 + off]);
+  pos[0] = map_ix(ws, d[11 + off]);
+  pos[1] = map_iy(ws, d[12 + off]);
+  output_nums(ws, "<text x='", 2, pos, "' y='", "'\n");
   ws->indent += 10;
 
   if (d[0] == 12) {
@@ -227,60 +857,472 @@ void convert_text(struct ws *ws, const int *d)
     double mc = d[8] / 65536.0;
     double md = d[9] / 65536.0;
     double det = ma * md - mb * mc;
-    output(ws, false, "transform='translate(%i %i) "
-            "matrix(%g %g %g %g %g %g) "
-            "translate(%i %i)'\n",
-            d[11 + off],
-            -d[12 + off],
-            md / det,
-            -mb / det,
-            -mc / det,
-            ma / det,
-            -d[10] / 65536.0,
-            -d[11] / 65536.0,
-            -d[11 + off],
-            d[12 + off]);
-  }
-
-  output(ws, false, "style='");
-  output(ws, false, "font-family: \"%s\";\n", ws->font[d[8 + off] & 0xff]);
-  output(ws, false, "font-size: %i;\n", d[9 + off]);
-
-  ftr = ~d[6 + off] & 0xff;
-  if (ftr == 0) {
-    output(ws, false, "fill: none;\n");
-  } else {
-    if (ftr != 255) {
-      output(ws, false, "fill-opacity: %g;\n", ftr/255.0);
-    }
-    output(ws, false, "fill: #%02X%02X%02X;'>",
-            (d[6 + off]>>8)&0xff,
-            (d[6 + off]>>16)&0xff,
-            (d[6 + off]>>24)&0xff);
+    double mat[6], back[2];
+
+    /* The matrix's translation is the difference between two mapped
+       points, so it is scaled and offset as the position is. */
+    mat[0] = md / det;
+    mat[1] = -mb / det;
+    mat[2] = -mc / det;
+    mat[3] = ma / det;
+    mat[4] = map_x(ws, 0) - map_x(ws, d[10] / 65536.0);
+    mat[5] = map_y(ws, d[11] / 65536.0) - map_y(ws, 0);
+    back[0] = -pos[0];
+    back[1] = -pos[1];
+    output_nums(ws, "transform='translate(", 2, pos, " ", ") ");
+    output_nums(ws, "matrix(", 6, mat, " ", ") ");
+    output_nums(ws, "translate(", 2, back, " ", ")'\n");
   }
 
-  output_esc(ws, OUT_ESCCDATA, "%s", d + 13 + off);
+  text_style(ws, d, &st);
+  style_attr_flush(ws, &st, "", ">");
+
+  {
+    const char *text = (const char *) (d + 13 + off);
+    output_esc_str(ws, OUT_ESCCDATA, text, strlen(text));
+  }
 
   ws->indent -= 10;
   output(ws, false, "</text>\n");
 }
 
+enum { CULL_NONE, CULL_CROP, CULL_LOD, CULL_HIDDEN };
+
+/* Should an object be left out, because it lies wholly outside the
+   region being cropped to, is smaller than the level of detail, or is
+   painted over?  Font tables and options have no bounding box. */
+static int object_culled(const struct ws *ws, const int *d)
+{
+  if (d[0] == 0 || d[0] == 11)
+    return CULL_NONE;
+  if (ws->cropping &&
+      (d[4] < ws->crop[0] || d[2] > ws->crop[2] ||
+       d[5] < ws->crop[1] || d[3] > ws->crop[3]))
+    return CULL_CROP;
+  if (ws->lod > 0 && d[4] - d[2] < ws->lod && d[5] - d[3] < ws->lod)
+    return CULL_LOD;
+  if (ws->occlusion && occlusion_hidden(ws->occlusion, d))
+    return CULL_HIDDEN;
+  return CULL_NONE;
+}
+
+/* Get the box of a path that hides whatever is painted under it: an
+   opaque, unoutlined rectangle. */
+static int path_occluder(const struct ws *ws, const int *d,
+                         struct occluder *o)
+{
+  struct shape sh;
+
+  if (d[0] != 2 || (~d[6] & 0xff) != 0xff || outline_opacity(ws, d) != 0)
+    return false;
+  if (shape_classify(def_path_elements(d), d + (d[1] >> 2), false,
+                     &sh) != SHAPE_RECT)
+    return false;
+  o->kind = OCCLUDER_RECT;
+  o->box[0] = sh.x0;
+  o->box[1] = sh.y0;
+  o->box[2] = sh.x1;
+  o->box[3] = sh.y1;
+  return true;
+}
+
+/* Find the objects in a list that are hidden by occluders painted
+   after them, working back from the end.  A group is checked whole
+   against what follows it before its contents are examined. */
+static void find_hidden(struct ws *ws, struct occlusion *oc,
+                        const int *p, const int *e)
+{
+  const int **list = NULL;
+  size_t n = 0, cap = 0;
+  struct occluder o;
+
+  for (; p < e; p += (p[1] >> 2)) {
+    if (n == cap) {
+      size_t nc = cap ? cap * 2 : 64;
+      void *nb = realloc(list, nc * sizeof *list);
+      if (!nb) nomem();
+      list = nb;
+      cap = nc;
+    }
+    list[n++] = p;
+  }
+  while (n-- > 0) {
+    const int *d = list[n];
+
+    if (d[0] == 0 || d[0] == 11 || object_culled(ws, d))
+      continue;
+    if (occlusion_covers(oc, d + 2))
+      occlusion_hide(oc, d);
+    else if (d[0] == 6)
+      find_hidden(ws, oc, d + 9, d + (d[1] >> 2));
+    else if (path_occluder(ws, d, &o))
+      occlusion_add(oc, &o);
+  }
+  free(list);
+}
+
+/* The words taken by each kind of path element, or 0 if it can't be
+   followed */
+static int element_words(int code)
+{
+  switch (code) {
+  case 2:
+  case 8:
+    return 3;
+  case 5:
+    return 1;
+  case 6:
+    return 7;
+  }
+  return 0;
+}
+
+/* Count the elements of a path, up to its end. */
+static size_t count_elements(const int *p, const int *e)
+{
+  size_t n = 0;
+  int w;
+
+  while (p < e && (w = element_words(p[0])) > 0) {
+    p += w;
+    n++;
+  }
+  return n;
+}
+
+/* Should a path be written in pieces? */
+static int path_oversized(const struct ws *ws, const int *d)
+{
+  return ws->ct->max_path > 0 &&
+    count_elements(def_path_elements(d), d + (d[1] >> 2)) >
+    ws->ct->max_path;
+}
+
+/* The most paths merged into one element, limiting the cost of
+   checking each against the others */
+#define MERGE_MAX 256
+
+/* Can a path be merged with its neighbours?  Dashes would restart at
+   each object boundary, and separate caps and definitions are
+   written differently. */
+static int path_mergeable(struct ws *ws, const int *d)
+{
+  struct def *df;
+
+  if (d[0] != 2 || (d[9]>>7)&1 || path_divided(ws, d) || d[10] != 2 ||
+      object_culled(ws, d) || path_oversized(ws, d))
+    return false;
+  if (outline_opacity(ws, d) == 0 && (~d[6] & 0xff) == 0)
+    return false;
+  if (ws->defs && (df = def_find(ws->defs, DEF_PATH, d)) && df->id)
+    return false;
+  return true;
+}
+
+/* Find the end of a run of paths starting at 'p' that can be written
+   as one element.  They must share a style, and no two may overlap,
+   so that painting them together gives the same result, whatever the
+   fill rule.  A mitred outline can reach twice its width beyond the
+   path, and thin outlines are taken to have no width.  Together, they
+   may have no more elements than one path may. */
+static const int *path_run(struct ws *ws, const int *p, const int *e)
+{
+  int box[MERGE_MAX][4];
+  int reach, n = 0;
+  size_t total = 0;
+  const int *q;
+
+  if (!path_mergeable(ws, p))
+    return p + (p[1] >> 2);
+  reach = outline_opacity(ws, p) == 0 ? 0 : (p[9]&3) == 0 ? 2 * p[8] : p[8];
+
+  for (q = p; q < e && n < MERGE_MAX; q += (q[1] >> 2), n++) {
+    if (q != p && (memcmp(q + 6, p + 6, 4 * sizeof *p) ||
+                   !path_mergeable(ws, q)))
+      break;
+    total += count_elements(q + 10, q + (q[1] >> 2));
+    if (q != p && ws->ct->max_path > 0 && total > ws->ct->max_path)
+      break;
+    box[n][0] = q[2] - reach;
+    box[n][1] = q[3] - reach;
+    box[n][2] = q[4] + reach;
+    box[n][3] = q[5] + reach;
+    for (int i = 0; i < n; i++)
+      if (box[i][0] <= box[n][2] && box[n][0] <= box[i][2] &&
+          box[i][1] <= box[n][3] && box[n][1] <= box[i][3])
+        return q;
+  }
+  return q;
+}
+
+/* Write a run of paths as one element, in the style of the first. */
+static void convert_merged(struct ws *ws, const int *p, const int *e)
+{
+  struct style st;
+  struct pathopt po;
+  unsigned long n = 0;
+
+  path_style(ws, p, false, &st);
+  output(ws, false, "<path");
+  ws->indent += 6;
+  style_attr(ws, &st, " ", "\n");
+
+  output(ws, false, "d='");
+  ws->indent += 3;
+  pathopt_init(&po, ws);
+  for (; p < e; p += (p[1] >> 2)) {
+    plot_elements(&po, p + 10, p + (p[1] >> 2));
+    n++;
+  }
+  pathopt_end(&po);
+  ws->merged += n;
+  ws->merges++;
+  ws->indent -= 9;
+  output(ws, false, "' />\n");
+}
+
 void convert_list(struct ws *ws, const int *p, const int *e)
 {
-  for (; p < e; p += (p[1] >> 2))
-    convert(ws, p);
+  while (p < e) {
+    const int *q = p + (p[1] >> 2);
+
+    /* Skip anything culled, without looking inside. */
+    switch (object_culled(ws, p)) {
+    case CULL_CROP:
+      ws->culled++;
+      p = q;
+      continue;
+    case CULL_LOD:
+      ws->small++;
+      p = q;
+      continue;
+    case CULL_HIDDEN:
+      ws->hidden++;
+      ws->hidden_bytes += p[1];
+      p = q;
+      continue;
+    }
+    if (ws->ct->merge && (q = path_run(ws, p, e)) > p + (p[1] >> 2))
+      convert_merged(ws, p, q);
+    else
+      convert(ws, p);
+    p = q;
+  }
+}
+
+/* Refer to the definition of an object, placing its anchor at (x, y)
+   in drawfile coordinates.  Return false if it has no definition. */
+static int use_def(struct ws *ws, int kind, const int *d, int x, int y,
+                   const struct style *st)
+{
+  struct def *df;
+  char buf[32 + FMT_INT_MAX], *p;
+  double at[2];
+
+  if (!ws->defs || !(df = def_find(ws->defs, kind, d)) || !df->id)
+    return false;
+  p = put_str(buf, "<use xlink:href='#");
+  *p++ = kind == DEF_PATH ? 'p' : 'g';
+  p = fmt_int(p, df->id);
+  output_str(ws, false, buf, p - buf);
+  at[0] = map_ix(ws, x);
+  at[1] = map_iy(ws, y);
+  output_nums(ws, "' x='", 2, at, "' y='", "'");
+  if (st) {
+    ws->indent += 5;
+    style_attr(ws, st, "\n", " />\n");
+    ws->indent -= 5;
+  } else {
+    output(ws, false, " />\n");
+  }
+  return true;
+}
+
+/* What an object writes, as far as its group is concerned */
+enum { OBJ_NONE, OBJ_STYLED, OBJ_OTHER };
+
+/* The properties shared by the children of a group, and how many of
+   them write anything */
+struct group_share {
+  const int *d;
+  size_t n;
+  struct style st;
+};
+
+static size_t group_style(struct ws *ws, const int *d, struct style *st);
+
+/* Get the style of the single element an object is written as. */
+static int object_style(struct ws *ws, const int *d, struct style *st)
+{
+  struct def *df;
+
+  switch (d[0]) {
+  case 1:
+  case 12:
+    if (ws->ct->text_to_path)
+      return OBJ_OTHER;
+    text_style(ws, d, st);
+    return OBJ_STYLED;
+  case 2:
+    if (outline_opacity(ws, d) == 0 && (~d[6] & 0xff) == 0)
+      return OBJ_NONE;
+    if (!path_divided(ws, d)) {
+      path_style(ws, d, false, st);
+      return OBJ_STYLED;
+    }
+    if (!path_marked(ws, d))
+      return OBJ_OTHER;
+    path_style(ws, d, true, st);
+    return OBJ_STYLED;
+  case 5:
+  case 13:
+    return OBJ_OTHER;
+  case 6:
+    if (ws->defs && (df = def_find(ws->defs, DEF_GROUP, d)) && df->id)
+      return OBJ_OTHER;
+    switch (group_style(ws, d, st)) {
+    case 0:
+      return OBJ_NONE;
+    case 1:
+      /* The group will be left out, leaving its only child. */
+      return st->set ? OBJ_STYLED : OBJ_OTHER;
+    default:
+      return OBJ_STYLED;
+    }
+  default:
+    return OBJ_NONE;
+  }
+}
+
+/* Find the properties all the children of a group share, and return
+   how many of them write anything.  Properties can't be shared with
+   the stylesheet in use, as elements are matched to classes on their
+   full style. */
+static size_t group_style(struct ws *ws, const int *d, struct style *st)
+{
+  const int *p, *e = d + (d[1] >> 2);
+  struct style cst;
+  size_t n = 0, k = 0;
+
+  /* Groups are reached in order of position, so a slot taken on the
+     way down keeps the list sorted. */
+  if (ws->sharing) {
+    if (ws->nshares == ws->shcap) {
+      size_t nc = ws->shcap ? ws->shcap * 2 : 16;
+      void *nb = realloc(ws->shares, nc * sizeof *ws->shares);
+      if (!nb) nomem();
+      ws->shares = nb;
+      ws->shcap = nc;
+    }
+    k = ws->nshares++;
+    ws->shares[k].d = d;
+  }
+
+  st->set = 0;
+  for (p = d + 9; p < e; p += (p[1] >> 2)) {
+    if (object_culled(ws, p))
+      continue;
+    switch (object_style(ws, p, &cst)) {
+    case OBJ_NONE:
+      continue;
+    case OBJ_OTHER:
+      cst.set = 0;
+      break;
+    }
+    if (n++ == 0)
+      *st = cst;
+    else
+      style_common(st, &cst);
+  }
+  if (ws->styles)
+    st->set = 0;
+  if (ws->sharing) {
+    ws->shares[k].n = n;
+    ws->shares[k].st = *st;
+  }
+  return n;
+}
+
+/* Find what was shared by a group within the outermost group being
+   written, or return NULL. */
+static const struct group_share *group_shared(const struct ws *ws,
+                                              const int *d)
+{
+  size_t lo = 0, hi = ws->nshares;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (ws->shares[mid].d == d)
+      return &ws->shares[mid];
+    if (ws->shares[mid].d < d)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return NULL;
+}
+
+/* Count the properties in a mask. */
+static unsigned prop_count(unsigned set)
+{
+  unsigned n = 0;
+
+  for (; set; set &= set - 1)
+    n++;
+  return n;
 }
 
 void convert_group(struct ws *ws, const int *d)
 {
   const int *e;
   int preserve = ws->ct->groups;
+  unsigned hoist = ws->hoist;
+  int outer = false;
+  struct style st;
+
+  if (use_def(ws, DEF_GROUP, d, d[2], d[3], NULL))
+    return;
 
   e = (const int *) (d + (d[1] >> 2));
 
+  /* An empty group, or one with only one child, is left out, and
+     properties shared by all the children are set on the group. */
+  st.set = 0;
+  if (preserve && ws->ct->flatten) {
+    const struct group_share *gs = group_shared(ws, d);
+    size_t n;
+
+    /* The groups within are found on the way, and looked up when
+       they are written. */
+    if (gs) {
+      n = gs->n;
+      st = gs->st;
+    } else {
+      outer = ws->nshares == 0;
+      ws->sharing = outer;
+      n = group_style(ws, d, &st);
+      ws->sharing = false;
+    }
+
+    if (n < 2) {
+      preserve = false;
+      ws->flattened++;
+    } else {
+      ws->hoisted += prop_count(st.set) * n;
+    }
+  }
+
   if (preserve) {
-    output(ws, false, "<g>\n");
-    ws->indent += 2;
+    if (st.set) {
+      output(ws, false, "<g");
+      ws->indent += 3;
+      style_attr(ws, &st, " ", ">\n");
+      ws->indent -= 1;
+      ws->hoist = st.set;
+    } else {
+      output(ws, false, "<g>\n");
+      ws->indent += 2;
+    }
   }
 #if false
   output(ws, false, "<desc>%12.12s</desc>\n", (char *) (d + 6));
@@ -290,72 +1332,71 @@ void convert_group(struct ws *ws, const int *d)
     ws->indent -= 2;
     output(ws, false, "</g>\n");
   }
+  ws->hoist = hoist;
+  if (outer)
+    ws->nshares = 0;
 }
 
-void plot_circ(struct ws *ws, int *spp, int fx, int fy,
-               int tx, int ty, int h)
-{
-  int dx = tx - fx, dy = ty - fy;
-  double r = h / 2.0 / sqrt((double) dx * dx + (double) dy * dy);
+/* How closely dashes and outlines follow curves, in draw units */
+#define FLATNESS 120.0
 
-  spp = spp;
+/* Caps drawn separately are plotted at (x, y), facing along the unit
+   vector (dx, dy). */
+static void plot_circ(struct ws *ws, double x, double y,
+                      double dx, double dy, double h)
+{
+  double r = h / 2.0;
 
-  output(ws, true, "M%g %g", tx - r * dy, -(ty + r * dx));
-  output(ws, true, "A%g %g", h / 2.0, h / 2.0);
-  output(ws, true, " 0 0 1 %g %gz", tx + r * dy, -(ty - r * dx));
+  path_num(ws, "M", 2, map_x(ws, x - r * dy), map_y(ws, y + r * dx));
+  path_num(ws, "A", 7, map_len(ws, r), map_len(ws, r),
+           0.0, 0.0, 1.0, map_x(ws, x + r * dy), map_y(ws, y - r * dx));
+  output_str(ws, true, "z", 1);
 }
 
-void plot_square(struct ws *ws, int *spp, int fx, int fy,
-                 int tx, int ty, int h)
+static void plot_square(struct ws *ws, double x, double y,
+                        double dx, double dy, double h)
 {
-  int dx = tx - fx, dy = ty - fy;
-  double r = h / 2.0 / sqrt((double) dx * dx + (double) dy * dy);
-
-  spp = spp;
+  double r = h / 2.0;
 
-  output(ws, true, "M%g %g", tx - r * dy, -(ty + r * dx));
-  output(ws, true, "l%g %g", r * dx, -r * dy);
-  output(ws, true, "l%g %g", 2 * r * dy, 2 * r * dx);
-  output(ws, true, "l%g %gz", -r * dx, -r * dy);
+  path_num(ws, "M", 2, map_x(ws, x - r * dy), map_y(ws, y + r * dx));
+  path_num(ws, "l", 2, map_len(ws, r * dx), map_len(ws, -r * dy));
+  path_num(ws, "l", 2, map_len(ws, 2 * r * dy), map_len(ws, 2 * r * dx));
+  path_num(ws, "l", 2, map_len(ws, -r * dx), map_len(ws, r * dy));
+  output_str(ws, true, "z", 1);
 }
 
-void plot_tri(struct ws *ws, int *spp, int fx, int fy,
-              int tx, int ty, double w, double h)
+static void plot_tri(struct ws *ws, double x, double y,
+                     double dx, double dy, double w, double h)
 {
-  int dx = tx - fx, dy = ty - fy;
-  double r = sqrt((double) dx * dx + (double) dy * dy);
-
-  spp = spp;
-
-  w /= r;
-  h /= r;
-
-  output(ws, true, "M%g %g", tx - w * dy, -(ty + w * dx));
-  output(ws, true, "l%g %g", w * dy + h * dx, w * dx - h * dy);
-  output(ws, true, "l%g %gz", w * dy - h * dx, h * dy + w * dx);
+  path_num(ws, "M", 2, map_x(ws, x - w * dy), map_y(ws, y + w * dx));
+  path_num(ws, "l", 2,
+           map_len(ws, w * dy + h * dx), map_len(ws, w * dx - h * dy));
+  path_num(ws, "l", 2,
+           map_len(ws, w * dy - h * dx), map_len(ws, h * dy + w * dx));
+  output_str(ws, true, "z", 1);
 }
 
-void record(const int *p[], int n, const int *nw)
+static void plot_cap(void *ctx, const struct stroke *s, int cap,
+                     double x, double y, double dx, double dy)
 {
-  int i;
+  struct ws *ws = ctx;
 
-  for (i = 0; i < n - 1; i++)
-    p[i] = p[i + 1];
-  p[i] = nw;
+  switch (cap) {
+  case 1:
+    plot_circ(ws, x, y, dx, dy, s->width);
+    break;
+  case 2:
+    plot_square(ws, x, y, dx, dy, s->width);
+    break;
+  case 3:
+    plot_tri(ws, x, y, dx, dy, s->tri_width, s->tri_length);
+    break;
+  }
 }
 
-void plot_caps(struct ws *ws, const int *d, const int *e,
-               int scap, int ecap, int wid, int triwf, int trihf)
+static void plot_elements(struct pathopt *po, const int *d, const int *e)
 {
-  double triw = 0.0, trih = 0.0;
-  const int *p[2] = { NULL };
-  int start = 1;
-  int sp = LINE_WIDTH - ws->indent;
-
-  if (scap == 3 || ecap == 3) {
-    triw = (double) wid * triwf / 16.0;
-    trih = (double) wid * trihf / 16.0;
-  }
+  struct ws *ws = po->ws;
 
   while (d < e) {
 #if false
@@ -363,57 +1404,28 @@ void plot_caps(struct ws *ws, const int *d, const int *e,
 #endif
     switch (d[0]) {
     case 0:
+      return;
     case 2:
-    case 3:
-    case 7:
-      if (!start) {
-        switch (ecap) {
-        case 1:
-          plot_circ(ws, &sp, p[0][0], p[0][1], p[1][0], p[1][1], wid);
-          break;
-        case 2:
-          plot_square(ws, &sp, p[0][0], p[0][1], p[1][0], p[1][1], wid);
-          break;
-        case 3:
-          plot_tri(ws, &sp, p[0][0], p[0][1], p[1][0], p[1][1], triw, trih);
-          break;
-        }
-        start = 1;
-      }
-      if (d[0] == 0)
-        return;
-      record(p, 2, d + 1);
+      pathopt_move(po, map_ix(ws, d[1]), map_iy(ws, d[2]));
       d += 3;
       break;
-    case 4:
-      start = 1;
     case 5:
+      pathopt_close(po);
       d += 1;
       break;
     case 6:
-      fprintf(stderr, "Bezier in thickened path?\n");
+      pathopt_curve(po,
+                    map_ix(ws, d[1]), map_iy(ws, d[2]),
+                    map_ix(ws, d[3]), map_iy(ws, d[4]),
+                    map_ix(ws, d[5]), map_iy(ws, d[6]));
       d += 7;
       break;
     case 8:
-      if (start) {
-        switch (scap) {
-        case 1:
-          plot_circ(ws, &sp, d[1], d[2], p[1][0], p[1][1], wid);
-          break;
-        case 2:
-          plot_square(ws, &sp, d[1], d[2], p[1][0], p[1][1], wid);
-          break;
-        case 3:
-          plot_tri(ws, &sp, d[1], d[2], p[1][0], p[1][1], triw, trih);
-          break;
-        }
-        start = 0;
-      }
-      record(p, 2, d + 1);
+      pathopt_line(po, map_ix(ws, d[1]), map_iy(ws, d[2]));
       d += 3;
       break;
     default:
-      fprintf(stderr, "Cap path aborted: element is %d\n", d[0]);
+      fprintf(stderr, "Path aborted: element is %d\n", d[0]);
       return;
     }
   }
@@ -421,65 +1433,11 @@ void plot_caps(struct ws *ws, const int *d, const int *e,
 
 void plot_path(struct ws *ws, const int *d, const int *e)
 {
-#if false
-  struct context *ctp = ws->ct;
-#endif
-
-#ifdef RELCOORDS
-  int lx = 0, ly = 0;
-#endif
+  struct pathopt po;
 
-  while (d < e) {
-#if false
-    printf("Code: %d\n", (int) d[0]);
-#endif
-    switch (d[0]) {
-    case 0:
-      return;
-    case 2:
-      output(ws, true, "M%d %d", d[1], -d[2]);
-#ifdef RELCOORDS
-      lx = d[1], ly = d[2];
-#endif
-      d += 3;
-      break;
-    case 5:
-      output(ws, true, "z");
-      d += 1;
-      break;
-    case 6:
-#ifdef RELCOORDS
-      output(ws, true, "c%d %d %d %d %d %d",
-                    d[1] - lx, -(d[2] - ly),
-                    d[3] - lx, -(d[4] - ly),
-                    d[5] - lx, -(d[6] - ly));
-      lx = d[5], ly = d[6];
-#else
-      output(ws, true, "C%d %d %d %d %d %d",
-                    d[1], -d[2], d[3], -d[4], d[5], -d[6]);
-#endif
-      d += 7;
-      break;
-    case 8:
-#ifdef RELCOORDS
-      if (d[1] == lx) {
-        output(ws, true, "v%d", -(d[2] - ly));
-      } else if (d[2] == ly) {
-        output(ws, true, "h%d", d[1] - lx);
-      } else {
-        output(ws, true, "l%d %d", d[1] - lx, -(d[2] - ly));
-      }
-      lx = d[1], ly = d[2];
-#else
-      output(ws, true, "L%d %d", d[1], -d[2]);
-#endif
-      d += 3;
-      break;
-    default:
-      fprintf(stderr, "Path aborted: element is %d\n", d[0]);
-      return;
-    }
-  }
+  pathopt_init(&po, ws);
+  plot_elements(&po, d, e);
+  pathopt_end(&po);
 }
 
 void xappend(double *var, const double *arg)
@@ -587,10 +1545,14 @@ void convert_sprite(struct ws *ws, const int *d)
   /* Get the width and height of the sprite in draw units. */
   drx = osx * (256.0 / 180.0);
   dry = osy * (256.0 / 180.0);
-  output(ws, false, "width='%g' height='%g'\n", drx, dry);
+  output_nums(ws, "width='", 1, &drx, "", "' ");
+  output_nums(ws, "height='", 1, &dry, "", "'\n");
 
   /* Specify the top-left corner before transformation. */
-  output(ws, false, "x='0' y='%g'\n", -dry);
+  {
+    double y = -dry;
+    output_nums(ws, "x='0' y='", 1, &y, "", "'\n");
+  }
 
   /* Set the initial bounding box. */
   bl[0] = bl[1] = br[1] = tl[0] = 0.0;
@@ -630,8 +1592,13 @@ void convert_sprite(struct ws *ws, const int *d)
   xf[3] = -xf[3];
   xf[5] = -xf[5];
 
-  output(ws, false, "transform='matrix(%g,%g,%g,%g,%g,%g)' />\n",
-          xf[0], xf[1], xf[2], xf[3], xf[4], xf[5]);
+  /* Map the result to user space. */
+  for (int i = 0; i < 6; i++)
+    xf[i] *= ws->uscale;
+  xf[4] -= ws->ox;
+  xf[5] -= ws->oy;
+
+  output_nums(ws, "transform='matrix(", 6, xf, ",", ")' />\n");
   ws->indent -= 6;
 
 #if false
@@ -647,182 +1614,372 @@ void convert_sprite(struct ws *ws, const int *d)
 #endif
 }
 
-void convert_path(struct ws *ws, const int *d)
+/* Write a path recognised as a simpler element.  Return false if it
+   has become too small in user space to be drawn as one. */
+static int convert_shape(struct ws *ws, const struct shape *sh,
+                         const struct style *st)
 {
-#if false
-  struct context *ctp = ws->ct;
-#endif
-
-  int join = d[9]&3;
-  int scap = (d[9]>>4)&3;
-  int ecap = (d[9]>>2)&3;
-  int wind = (d[9]>>6)&1;
-  int dash = (d[9]>>7)&1;
-  unsigned otr = ~d[7] & 0xff;
-  unsigned ftr = ~d[6] & 0xff;
-
-  const int *path = (const int *) (d + 10 + (dash ? 2 + d[11] : 0));
-
-  int divide = 0;
-
-  /*
-    Decide whether the path can be represented by a single SVG <path>:
+  static const char *const names[] = {
+    [SHAPE_RECT] = "rect",
+    [SHAPE_ELLIPSE] = "ellipse",
+    [SHAPE_LINE] = "line",
+    [SHAPE_POLYLINE] = "polyline",
+    [SHAPE_POLYGON] = "polygon",
+  };
+  int x0 = map_ix(ws, sh->x0), y0 = map_iy(ws, sh->y0);
+  int x1 = map_ix(ws, sh->x1), y1 = map_iy(ws, sh->y1);
+  const char *name = names[sh->kind];
+
+  /* A rectangle or ellipse of no width or height is not drawn. */
+  if ((sh->kind == SHAPE_RECT || sh->kind == SHAPE_ELLIPSE) &&
+      (x0 == x1 || y0 == y1))
+    return false;
+  if (sh->kind == SHAPE_ELLIPSE && abs(x1 - x0) == abs(y1 - y0))
+    name = "circle";
+  output(ws, false, "<%s", name);
+  ws->indent += strlen(name) + 2;
+  style_attr(ws, st, " ", "\n");
+
+  switch (sh->kind) {
+  case SHAPE_RECT: {
+    double xy[2] = { x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1 };
+    double wh[2] = { abs(x1 - x0), abs(y1 - y0) };
+
+    output_nums(ws, "x='", 2, xy, "' y='", "'");
+    output_nums(ws, " width='", 1, &wh[0], "", "'");
+    output_nums(ws, " height='", 1, &wh[1], "", "' />\n");
+  } break;
+  case SHAPE_ELLIPSE: {
+    double c[2] = { (x0 + x1) / 2.0, (y0 + y1) / 2.0 };
+    double r[2] = { abs(x1 - x0) / 2.0, abs(y1 - y0) / 2.0 };
+
+    output_nums(ws, "cx='", 2, c, "' cy='", "'");
+    if (r[0] == r[1])
+      output_nums(ws, " r='", 1, r, "", "' />\n");
+    else
+      output_nums(ws, " rx='", 2, r, "' ry='", "' />\n");
+  } break;
+  case SHAPE_LINE: {
+    double a[2] = { x0, y0 }, b[2] = { x1, y1 };
 
-      * the start and end caps must be the same
-      * they must not use triangles
+    output_nums(ws, "x1='", 2, a, "' y1='", "'");
+    output_nums(ws, " x2='", 2, b, "' y2='", "' />\n");
+  } break;
+  default:
+    output(ws, false, "points='");
+    ws->indent += 8;
+    for (size_t i = 0; i < sh->n; i++) {
+      const int *p = sh->el + 3 * i;
+      char buf[2 + 2 * FMT_INT_MAX], *q = buf;
+
+      if (i) *q++ = ' ';
+      q = fmt_int(q, map_ix(ws, p[1]));
+      *q++ = ',';
+      q = fmt_int(q, map_iy(ws, p[2]));
+      output_str(ws, true, buf, q - buf);
+    }
+    ws->indent -= 8;
+    output(ws, false, "' />\n");
+    break;
+  }
+  ws->indent -= strlen(name) + 2;
+  ws->shapes++;
+  return true;
+}
 
-    but it doesn't matter if the outline is transparent or thin.
-  */
-  divide = otr != 0 && d[8] != 0 &&
-    (scap != ecap || scap == 3 || ecap == 3);
+/* A piece of a path, with the box of its elements, and of those of
+   the pieces after it */
+struct piece {
+  const int *p, *e;
+  int box[4];
 
-  if (otr != 0 || ftr != 0) {
-    if (divide) {
-      output(ws, false, "<g>\n");
-      ws->indent += 2;
+  /* The piece this one is joined to, and the next piece written in
+     the same element, or the number of pieces if none */
+  size_t up, next;
+  int head;
+};
 
-#if false
-      output(ws, false, "<!-- RISC OS Drawfile path without caps -->\n");
-#endif
-    }
+/* A piece's box, to be sorted by its left edge */
+struct piece_edge {
+  int box[4];
+  size_t i;
+};
 
-    output(ws, false, "<path style='");
-    ws->indent += 13;
+static int boxes_meet(const int *a, const int *b)
+{
+  return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
 
+static void box_unite(int *acc, const int *b)
+{
+  if (b[0] < acc[0]) acc[0] = b[0];
+  if (b[1] < acc[1]) acc[1] = b[1];
+  if (b[2] > acc[2]) acc[2] = b[2];
+  if (b[3] > acc[3]) acc[3] = b[3];
+}
 
-    if (otr == 0) {
-      output(ws, false, "stroke: none;\n");
-    } else {
-      output(ws, false, "stroke: #%02X%02X%02X;\n",
-              (d[7]>>8)&0xff,
-              (d[7]>>16)&0xff,
-              (d[7]>>24)&0xff);
-      if (otr != 255) {
-        output(ws, false, "stroke-opacity: %g;\n", otr/255.0);
-      }
-      if ((divide ? 0 : scap) != 0) {
-        output(ws, false, "stroke-linecap: %s;\n",
-                cap_str[divide ? 0 : scap]);
-      }
-      if (join != 0) {
-        output(ws, false, "stroke-linejoin: %s;\n", join_str[join]);
-      }
+static int by_left(const void *av, const void *bv)
+{
+  const struct piece_edge *a = av, *b = bv;
+  return (a->box[0] > b->box[0]) - (a->box[0] < b->box[0]);
+}
 
-      if (dash) {
-        int i;
-        output(ws, false, "stroke-dasharray:");
-        for (i = 0; i < d[11]; i++)
-          fprintf(ws->out, "%s %d", i ? "," : "", d[12 + i]);
-        output(ws, false, ";\n");
-        output(ws, false, "stroke-dashoffset: %d;\n", d[10]);
-      } else {
-#if false
-        output(ws, false, "stroke-dasharray: none;\n");
-#endif
-      }
+static size_t piece_root(struct piece *pc, size_t i)
+{
+  while (pc[i].up != i)
+    i = pc[i].up = pc[pc[i].up].up;
+  return i;
+}
 
-      output(ws, false, "stroke-width: ");
-      if (d[8])
-        output(ws, false, "%d;\n", d[8]);
-      else
-        output(ws, false, "%g;\n", ws->ct->thin);
+/* Join pieces whose boxes meet, directly or through others, so that
+   subpaths that might cross are written in the same element, where
+   the fill rule treats them together.  Pieces that cannot overlap may
+   be painted in any order.  Boxes are grown by 'grow' to take in the
+   outline. */
+static void join_pieces(struct piece *pc, size_t n, int grow)
+{
+  struct piece_edge *pe = malloc(n * sizeof *pe);
+  if (!pe) nomem();
+  for (size_t i = 0; i < n; i++) {
+    pe[i].box[0] = pc[i].box[0] - grow;
+    pe[i].box[1] = pc[i].box[1] - grow;
+    pe[i].box[2] = pc[i].box[2] + grow;
+    pe[i].box[3] = pc[i].box[3] + grow;
+    pe[i].i = i;
+  }
+  qsort(pe, n, sizeof *pe, by_left);
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = i + 1; j < n && pe[j].box[0] <= pe[i].box[2]; j++) {
+      size_t a, b;
+      if (!boxes_meet(pe[i].box, pe[j].box)) continue;
+      a = piece_root(pc, pe[i].i);
+      b = piece_root(pc, pe[j].i);
+      if (a != b) pc[a > b ? a : b].up = a < b ? a : b;
     }
+  free(pe);
+}
 
-    if (ftr == 0) {
-      output(ws, false, "fill: none;'\n");
-    } else {
-      if (wind != 1) {
-        output(ws, false, "fill-rule: %s;\n", wind_str[wind]);
-      }
-
-      if (ftr != 255) {
-        output(ws, false, "fill-opacity: %g;\n", ftr/255.0);
+/* Cut a path's elements from 'p' into pieces of whole subpaths, each
+   of no more than the maximum number of elements, unless a subpath is
+   longer.  If the path is filled, pieces that might overlap, with
+   outlines 'grow' wide around them, are chained together to be
+   written as one element.  Return the number
+   of elements to write, setting '*res' to the pieces and '*np' to how
+   many there are. */
+static size_t path_pieces(struct ws *ws, const int *p, const int *e,
+                          int filled, int grow, struct piece **res,
+                          size_t *np)
+{
+  struct piece *pc = NULL;
+  size_t n = 0, cap = 0, count = 0, sub = 0, out = 0;
+  const int *start = p;
+  int box[4], sbox[4] = { 0, 0, 0, 0 }, w;
+
+  for (;;) {
+    /* Finish a subpath at each move, and at the end. */
+    int code = p < e ? p[0] : 0;
+
+    if ((w = element_words(code)) == 0 || code == 2) {
+      if (sub > 0) {
+        if (n == 0 || count + sub > ws->ct->max_path) {
+          if (n == cap) {
+            size_t nc = cap ? cap * 2 : 16;
+            void *nb = realloc(pc, nc * sizeof *pc);
+            if (!nb) nomem();
+            pc = nb;
+            cap = nc;
+          }
+          if (n > 0)
+            pc[n - 1].e = start;
+          pc[n].p = start;
+          pc[n].up = n;
+          memcpy(pc[n++].box, sbox, sizeof sbox);
+          count = 0;
+        } else {
+          box_unite(pc[n - 1].box, sbox);
+        }
+        count += sub;
       }
-
-      output(ws, false, "fill: #%02X%02X%02X;'\n",
-              (d[6]>>8)&0xff,
-              (d[6]>>16)&0xff,
-              (d[6]>>24)&0xff);
+      if (w == 0)
+        break;
+      start = p;
+      sub = 0;
+      sbox[0] = sbox[2] = p[1];
+      sbox[1] = sbox[3] = p[2];
     }
 
-    ws->indent -= 7;
+    /* Control points bound a curve. */
+    for (int i = 1; i < w; i += 2) {
+      box[0] = box[2] = p[i];
+      box[1] = box[3] = p[i + 1];
+      box_unite(sbox, box);
+    }
+    sub++;
+    p += w;
+  }
+  if (n > 0)
+    pc[n - 1].e = e;
+
+  if (filled && n > 1)
+    join_pieces(pc, n, grow);
+
+  /* Each root is the first of its pieces.  Once every piece points
+     at its root, roots point at the last piece chained to them. */
+  for (size_t i = 0; i < n; i++) {
+    pc[i].up = piece_root(pc, i);
+    pc[i].head = pc[i].up == i;
+    pc[i].next = n;
+  }
+  for (size_t i = 0; i < n; i++) {
+    size_t r = pc[i].up;
+    if (pc[i].head) {
+      out++;
+    } else {
+      pc[pc[r].up].next = i;
+      pc[r].up = i;
+    }
+  }
+  *res = pc;
+  *np = n;
+  return out;
+}
 
-    output(ws, false, "d='");
-    ws->indent += 3;
-    plot_path(ws, path, d + (d[1] >> 2));
+/* Write a path too long for one element as several in a group, if it
+   can be cut up.  Each piece is laid out and written before the next
+   is plotted. */
+static int convert_split(struct ws *ws, const int *path, const int *e,
+                         int filled, int outlined, const struct style *st)
+{
+  struct piece *pc;
+  size_t n, count;
+
+  /* Translucent outlines would be darker where the pieces meet. */
+  if (outlined && (st->set & ST_STROKE_OPACITY))
+    return false;
+
+  /* A mitred corner reaches out to twice the line's width, and
+     another piece's fill mustn't cover it. */
+  count = path_pieces(ws, path, e, filled,
+                      outlined ? (int) (2.0 * st->width + 1.0) : 0,
+                      &pc, &n);
+
+  if (count < 2) {
+    free(pc);
+    return false;
+  }
+  output(ws, false, "<g");
+  ws->indent += 3;
+  style_attr(ws, st, " ", ">\n");
+  ws->indent -= 1;
+  for (size_t i = 0; i < n; i++) {
+    struct pathopt po;
+    if (!pc[i].head) continue;
+    output(ws, false, "<path d='");
+    ws->indent += 9;
+    pathopt_init(&po, ws);
+    for (size_t j = i; j < n; j = pc[j].next)
+      plot_elements(&po, pc[j].p, pc[j].e);
+    pathopt_end(&po);
     ws->indent -= 9;
     output(ws, false, "' />\n");
   }
+  ws->indent -= 2;
+  output(ws, false, "</g>\n");
+  ws->split++;
+  ws->pieces += count;
+  free(pc);
+  return true;
+}
 
-  if (divide) {
-    /* Draw the caps manually. */
-
-    size_t wssize = 8;
-    int *thick;
-    unsigned int ctw = (d[9]>>16)&0xff;
-    unsigned int ctl = (d[9]>>24)&0xff;
-    unsigned char caj[16] = { 0 };
-
-    caj[0] = join;
-    caj[1] = 0;
-    caj[2] = 0;
+void convert_path(struct ws *ws, const int *d)
+{
+#if false
+  struct context *ctp = ws->ct;
+#endif
 
-    caj[6] = 2;
+  int dash = (d[9]>>7)&1;
+  unsigned otr = outline_opacity(ws, d);
+  unsigned ftr = ~d[6] & 0xff;
 
-    caj[12] = caj[8] = ctw<<4;
-    caj[13] = caj[9] = ctw>>4;
-    caj[14] = caj[10] = ctl<<4;
-    caj[15] = caj[11] = ctl>>4;
+  const int *path = (const int *) (d + 10 + (dash ? 2 + d[11] : 0));
+  const int *end = d + (d[1] >> 2);
+
+  /* An outline written as an area leaves only the fill to be drawn
+     as a path. */
+  int divide = path_divided(ws, d);
+  int body = (otr != 0 && !(divide && ws->stroke)) || ftr != 0;
+  int marked = divide && path_marked(ws, d);
+  struct style st;
+  struct shape sh;
+
+  /* Copies of a path need only be styled. */
+  if ((otr != 0 || ftr != 0) && (!divide || marked) && path[0] == 2) {
+    path_style(ws, d, divide, &st);
+    if (use_def(ws, DEF_PATH, d, path[1], path[2], &st))
+      return;
+  }
 
-    /* Calculate workspace required for path thickening. */
-    _swi(Draw_StrokePath, _INR(0,6) | _OUT(0), (int) path, 0,
-         0, 120, 0, (int) caj,
-         (int) (dash ? d + 10 : 0), (int *) &wssize);
+  /* Simple shapes have their own elements, unless dashes or caps
+     would be drawn differently. */
+  if ((otr != 0 || ftr != 0) && !divide && !dash && ws->ct->shapes &&
+      shape_classify(path, d + (d[1] >> 2), otr != 0, &sh)) {
+    path_style(ws, d, divide, &st);
+    if (convert_shape(ws, &sh, &st))
+      return;
+  }
 
-    /* Allocate workspace. */
-    thick = ws->buf = realloc(ws->buf, wssize);
-    if (!ws->buf) {
-      printf("Out of memory\n");
-      abort();
-    }
-    thick[0] = 0;
-    thick[1] = wssize;
+  /* Caps drawn by markers need no second path. */
+  if (marked)
+    ws->marked++;
 
-    /* Thicken the path into the workspace. */
-    _swi(Draw_StrokePath, _INR(0,6), (int) path, (int) ws->buf,
-         0, 120, 0, (int) caj,
-         (int) (dash ? d + 10 : 0));
+  if (body) {
+    if (divide && !marked) {
+      output(ws, false, "<g>\n");
+      ws->indent += 2;
 
-    /* Plot the thickened outline. */
 #if false
-    output(ws, false, "<!-- RISC OS Drawfile caps -->\n");
+      output(ws, false, "<!-- RISC OS Drawfile path without caps -->\n");
 #endif
-    output(ws, false, "<path style='");
-    ws->indent += 13;
-
-    output(ws, false, "stroke: none;\n");
-
-    output(ws, false, "fill: #%02X%02X%02X;\n",
-            (d[7]>>8)&0xff,
-            (d[7]>>16)&0xff,
-            (d[7]>>24)&0xff);
+    }
 
-    if (otr != 255) {
-      output(ws, false, "fill-opacity: %g;\n", otr/255.0);
+    path_style(ws, d, divide, &st);
+    if (!path_oversized(ws, d) ||
+        !convert_split(ws, path, end, ftr != 0, st.stroke != STYLE_NONE,
+                       &st)) {
+      output(ws, false, "<path");
+      ws->indent += 6;
+      style_attr(ws, &st, " ", "\n");
+
+      output(ws, false, "d='");
+      ws->indent += 3;
+      plot_path(ws, path, end);
+      ws->indent -= 9;
+      output(ws, false, "' />\n");
     }
+  }
 
-    output(ws, false, "fill-rule: nonzero;'\n");
+  if (divide && !marked) {
+    /* Draw the caps manually, or the whole outline as an area. */
+    struct stroke sk;
 
-    ws->indent -= 7;
+    stroke_init(&sk, d, ws->ct->thin);
+    caps_style(d, &st);
+    output(ws, false, "<path");
+    ws->indent += 6;
+    style_attr(ws, &st, " ", "\n");
 
     output(ws, false, "d='");
     ws->indent += 3;
-    plot_caps(ws, thick, thick + (wssize >> 2),
-              scap, ecap, d[8], ctw, ctl);
+    if (ws->stroke) {
+      stroke_outline(&sk, path, end, FLATNESS, ws->stroke);
+      plot_path(ws, ws->stroke->v, ws->stroke->v + ws->stroke->n);
+    } else {
+      stroke_caps(&sk, path, end, FLATNESS, plot_cap, ws);
+    }
     ws->indent -= 9;
     output(ws, false, "' />\n");
 
-    if (otr != 0 || ftr != 0) {
+    if (body) {
       ws->indent -= 2;
       output(ws, false, "</g>\n");
     }
@@ -886,6 +2043,270 @@ void convert(struct ws *ws, const int *d)
   }
 }
 
+/* Count the styles of everything in a list, so that those used more
+   than once can be put in the stylesheet, and count copies of paths
+   and groups, so that those used more than once can be defined. */
+static void index_list(struct ws *ws, const int *p, const int *e)
+{
+  for (; p < e; p += (p[1] >> 2)) {
+    struct style st;
+
+    if (object_culled(ws, p))
+      continue;
+    switch (p[0]) {
+    case 0:
+      /* Text styles need the font names. */
+      convert(ws, p);
+      break;
+    case 1:
+    case 12:
+      if (ws->styles && !ws->ct->text_to_path) {
+        text_style(ws, p, &st);
+        style_intern(ws->styles, &st);
+      } else if (ws->ct->text_to_path && text_shared(ws, p)) {
+        index_text(ws, p);
+      }
+      break;
+    case 2: {
+      int divide = path_divided(ws, p);
+      int marked = divide && path_marked(ws, p);
+      if (marked)
+        path_markers(ws, p, &st);
+      if (outline_opacity(ws, p) != 0 || (~p[6] & 0xff) != 0) {
+        if (ws->styles &&
+            (!divide || !ws->ct->stroke_fill || (~p[6] & 0xff) != 0)) {
+          path_style(ws, p, divide, &st);
+          style_intern(ws->styles, &st);
+        }
+        if (ws->defs && (!divide || marked) && !path_oversized(ws, p))
+          def_intern(ws->defs, DEF_PATH, p);
+      }
+      if (divide && !marked && ws->styles) {
+        caps_style(p, &st);
+        style_intern(ws->styles, &st);
+      }
+    } break;
+    case 6:
+      /* The contents of a copy will not be written again. */
+      if (ws->defs && def_intern(ws->defs, DEF_GROUP, p))
+        break;
+      if (ws->defs) {
+        /* The group may be written as a definition, which is neither
+           cropped nor painted over, so nor is its index. */
+        int cropping = ws->cropping;
+        struct occlusion *oc = ws->occlusion;
+
+        ws->cropping = false;
+        ws->occlusion = NULL;
+        index_list(ws, p + 9, p + (p[1] >> 2));
+        ws->cropping = cropping;
+        ws->occlusion = oc;
+      } else {
+        index_list(ws, p + 9, p + (p[1] >> 2));
+      }
+      break;
+    }
+  }
+}
+
+/* Find the extent of what a list of objects paints.  Text and sprites
+   are taken to fill their boxes, as Draw fits them to their
+   transformed corners. */
+static void measure_list(struct extent *x, double thin,
+                         const int *p, const int *e)
+{
+  for (; p < e; p += (p[1] >> 2)) {
+    switch (p[0]) {
+    case 1:
+    case 5:
+    case 12:
+    case 13:
+      extent_box(x, p[2], p[3], p[4], p[5]);
+      break;
+    case 2:
+      extent_path(x, p, thin);
+      break;
+    case 6:
+      measure_list(x, thin, p + 9, p + (p[1] >> 2));
+      break;
+    }
+  }
+}
+
+/* Write each cap drawn as a marker in <defs>.  The end of the path is
+   at the origin, and it runs along the x axis, so the viewport is set
+   to just hold the cap, at the scale of the stroke width. */
+static void write_markers(struct ws *ws)
+{
+  const struct markers *ms = ws->markers;
+
+  if (ms->n == 0)
+    return;
+  output(ws, false, "<defs>\n");
+  ws->indent += 2;
+  for (size_t i = 0; i < ms->n; i++) {
+    const struct marker *m = &ms->ents[i];
+    double dir = m->end ? 1.0 : -1.0;
+    double w = m->cap == 3 ? m->tri_width / 16.0 : 0.5;
+    double l = m->cap == 3 ? m->tri_length / 16.0 : 0.5;
+    double box[4] = { m->end ? 0.0 : -l, -w, l, 2 * w };
+    struct style st;
+
+    output(ws, false, "<marker id='m%u' orient='auto' "
+           "markerUnits='strokeWidth'\n", (unsigned) i + 1);
+    ws->indent += 8;
+    output_nums(ws, "viewBox='", 4, box, " ", "'\n");
+    output_nums(ws, "markerWidth='", 1, &box[2], "", "' ");
+    output_nums(ws, "markerHeight='", 1, &box[3], "", "'>\n");
+    ws->indent -= 6;
+
+    st.set = ST_STROKE;
+    st.stroke = STYLE_NONE;
+    set_fill(&st, m->colour);
+    output(ws, false, "<path");
+    ws->indent += 6;
+    style_attr(ws, &st, " ", "\n");
+    output(ws, false, "d='");
+    ws->indent += 3;
+    path_num(ws, "M", 2, 0.0, -w);
+    switch (m->cap) {
+    case 1:
+      path_num(ws, "A", 7, w, w, 0.0, 0.0, m->end ? 1.0 : 0.0, 0.0, w);
+      break;
+    case 2:
+      path_num(ws, "h", 1, dir * l);
+      path_num(ws, "v", 1, 2 * w);
+      path_num(ws, "h", 1, -dir * l);
+      break;
+    case 3:
+      path_num(ws, "L", 2, dir * l, 0.0);
+      path_num(ws, "L", 2, 0.0, w);
+      break;
+    }
+    output_str(ws, true, "z", 1);
+    ws->indent -= 9;
+    output(ws, false, "' />\n");
+    ws->indent -= 2;
+    output(ws, false, "</marker>\n");
+  }
+  ws->indent -= 2;
+  output(ws, false, "</defs>\n");
+}
+
+/* Write the outline of each character of text in <defs>, with the
+   pen's starting point at the origin. */
+static void write_glyphs(struct ws *ws)
+{
+  const struct glyphs *gs = ws->glyphs;
+  int ox = ws->ox, oy = ws->oy;
+
+  if (gs->ids == 0)
+    return;
+  output(ws, false, "<defs>\n");
+  ws->indent += 2;
+  ws->ox = ws->oy = 0;
+  for (size_t i = 0; i < gs->n; i++) {
+    const struct glyph *g = &gs->ents[i];
+    const int *pos;
+    int many;
+
+    if (!g->id)
+      continue;
+    many = g->obj[g->obj[1] >> 2] != 0;
+    if (many) {
+      output(ws, false, "<g id='c%u'>\n", g->id);
+      ws->indent += 2;
+    }
+    for (pos = g->obj; pos[0]; ) {
+      const int *next = pos + (pos[1] >> 2);
+
+      if (many)
+        output(ws, false, "<path ");
+      else
+        output(ws, false, "<path id='c%u' ", g->id);
+      ws->indent += 6;
+      output(ws, false, "style='fill-rule: %s;'\n",
+             wind_str[pos[9] >> 6 & 1]);
+      output(ws, false, "d='");
+      ws->indent += 3;
+      pos += 10;
+      if (pos[-1] & 0x80)
+        pos += pos[1] + 2;
+      plot_path(ws, pos, next - 1);
+      ws->indent -= 9;
+      output(ws, false, "' />\n");
+      pos = next;
+    }
+    if (many) {
+      ws->indent -= 2;
+      output(ws, false, "</g>\n");
+    }
+  }
+  ws->ox = ox;
+  ws->oy = oy;
+  ws->indent -= 2;
+  output(ws, false, "</defs>\n");
+}
+
+/* Write each path and group used more than once in <defs>, relative
+   to its anchor. */
+static void write_defs(struct ws *ws)
+{
+  struct defs *ds = ws->defs;
+  int open = false, cropping;
+  struct occlusion *oc;
+
+  /* Number them first, as definitions may refer to each other. */
+  for (size_t i = 0; i < ds->n; i++)
+    if (ds->ents[i].uses > 1)
+      ds->ents[i].id = ++ds->ids;
+
+  /* Copies are cropped and painted over where they are used, not
+     here. */
+  cropping = ws->cropping;
+  ws->cropping = false;
+  oc = ws->occlusion;
+  ws->occlusion = NULL;
+
+  for (size_t i = 0; i < ds->n; i++) {
+    const struct def *df = &ds->ents[i];
+    const int *d = df->obj, *e = d + (d[1] >> 2);
+    int ox = ws->ox, oy = ws->oy;
+    int ux = map_ix(ws, df->ax), uy = map_iy(ws, df->ay);
+
+    if (!df->id)
+      continue;
+    if (!open) {
+      output(ws, false, "<defs>\n");
+      ws->indent += 2;
+      open = true;
+    }
+    ws->ox += ux;
+    ws->oy += uy;
+    if (df->kind == DEF_PATH) {
+      output(ws, false, "<path id='p%u' d='", df->id);
+      ws->indent += 9;
+      plot_path(ws, def_path_elements(d), e);
+      ws->indent -= 9;
+      output(ws, false, "' />\n");
+    } else {
+      output(ws, false, "<g id='g%u'>\n", df->id);
+      ws->indent += 2;
+      convert_list(ws, d + 9, e);
+      ws->indent -= 2;
+      output(ws, false, "</g>\n");
+    }
+    ws->ox = ox;
+    ws->oy = oy;
+  }
+  ws->cropping = cropping;
+  ws->occlusion = oc;
+  if (open) {
+    ws->indent -= 2;
+    output(ws, false, "</defs>\n");
+  }
+}
+
 struct point {
   double x, y;
 };
@@ -901,53 +2322,142 @@ static double scale(double orig, double mid, double factor)
 
 extern const char *const version;
 
-int process(struct context *ctp)
+/* Check for a .svgz (or RISC OS /svgz) suffix. */
+static int is_svgz(const char *name)
 {
-  struct rect viewbox, natsize;
-  struct ws ws;
-
-  int *drawfile;
-  size_t drawlen;
-  int type;
-
-#if false
-  printf("Draw-to-SVG converter %s %s\n", __DATE__, __TIME__);
-#endif
+  size_t len = strlen(name);
+  const char *ext = "svgz";
+
+  if (len < 5 || (name[len - 5] != '.' && name[len - 5] != '/'))
+    return false;
+  for (size_t i = 0; i < 4; i++)
+    if (tolower((unsigned char) name[len - 4 + i]) != ext[i])
+      return false;
+  return true;
+}
 
-  if (get_file_type_and_length(ctp->iname, &type, &drawlen) != 1) {
-    fprintf(stderr, "Not a file: %s\n", ctp->iname);
-    return -1;
-  }
+/* Name a level of detail by inserting its number before the output
+   file's extension, unless it is the full level. */
+static char *variant_name(const char *name, unsigned level)
+{
+  size_t len = strlen(name), at = len;
+  char *res = malloc(len + 2 + FMT_INT_MAX);
 
-  if (ctp->itype && type != 0xaff) {
-    fprintf(stderr, "Not a drawfile: %s\n", ctp->iname);
-    return -1;
+  if (!res) nomem();
+  if (level == 1) {
+    memcpy(res, name, len + 1);
+    return res;
   }
+  if (is_svgz(name))
+    at = len - 5;
+  else if (len >= 4 && (name[len - 4] == '.' || name[len - 4] == '/') &&
+           tolower((unsigned char) name[len - 3]) == 's' &&
+           tolower((unsigned char) name[len - 2]) == 'v' &&
+           tolower((unsigned char) name[len - 1]) == 'g')
+    at = len - 4;
+  memcpy(res, name, at);
+  res[at] = '-';
+  memcpy(fmt_int(res + at + 1, level), name + at, len - at + 1);
+  return res;
+}
 
-  drawfile = malloc((drawlen + 3) & ~3);
-  if (!drawfile) {
-    fprintf(stderr, "Out of memory\n");
-    return -1;
-  }
+/* A stretch of consecutive objects */
+struct run {
+  const int *p, *e;
+};
 
-  if (load_file(ctp->iname, drawfile) < 0) {
-    free(drawfile);
-    fprintf(stderr, "Error loading %s\n", ctp->iname);
-    return -1;
-  }
+/* Get the region being cropped to, rounded outwards to draw units. */
+static void region_box(const struct context *ctp, int *box)
+{
+  box[0] = (int) floor(fmin(ctp->region.x0, ctp->region.x1));
+  box[1] = (int) floor(fmin(ctp->region.y0, ctp->region.y1));
+  box[2] = (int) ceil(fmax(ctp->region.x0, ctp->region.x1));
+  box[3] = (int) ceil(fmax(ctp->region.y0, ctp->region.y1));
+}
 
-  ws.out = fopen(ctp->oname, "w");
-  if (!ws.out) {
-    free(drawfile);
-    fprintf(stderr, "Error opening %s\n", ctp->oname);
-    return -1;
+/* Write the objects of a drawfile in 'runs' as SVG to 'oname',
+   leaving out detail smaller than a pixel at 'lod' pixels per unit,
+   if it is positive. */
+static int write_svg(struct context *ctp, int *drawfile,
+                     const struct run *runs, size_t nruns,
+                     const char *oname, double lod)
+{
+  struct rect viewbox, natsize, userbox;
+  struct ws ws;
+  struct sink *out;
+  struct styles styles;
+  struct defs defs;
+  struct occlusion occlusion;
+  struct stroke_space stroke;
+  struct markers markers;
+  struct glyphs glyphs;
+  struct extent extent;
+  int gzip;
+
+  gzip = ctp->gzip == GZIP_AUTO ? is_svgz(oname) : ctp->gzip;
+  {
+    struct sink *file;
+    if (ctp->async) {
+      /* SVG text usually takes a little more space than the drawfile,
+         and compresses to much less. */
+      unsigned long long estimate = 0;
+      for (size_t i = 0; i < nruns; i++)
+        estimate += (runs[i].e - runs[i].p) * sizeof *runs[i].p;
+      if (gzip)
+        estimate /= 2;
+      else
+        estimate += estimate / 2;
+      file = sink_async(oname, estimate);
+    } else {
+      file = sink_file(oname);
+    }
+    if (!file) {
+      fprintf(stderr, "Error opening %s\n", oname);
+      return -1;
+    }
+    if (gzip) {
+      out = sink_gzip(file, ctp->gzip_level);
+      if (!out) {
+        sink_free(file);
+        fprintf(stderr, "Error starting compression\n");
+        return -1;
+      }
+    } else {
+      out = file;
+    }
   }
 
+  out_init(&ws, out, ctp->compact);
   ws.ct = ctp;
   ws.buf = NULL;
   ws.indent = 0;
-  ws.cpos = -1;
   ws.bbox = drawfile + 6;
+  ws.uscale = 1.0;
+  ws.grid = false;
+  ws.ox = ws.oy = 0;
+  ws.path_bytes = ws.path_legacy = 0;
+  ws.merged = ws.merges = 0;
+  ws.shapes = 0;
+  ws.hoist = 0;
+  ws.flattened = ws.hoisted = 0;
+  ws.shares = NULL;
+  ws.nshares = ws.shcap = 0;
+  ws.sharing = false;
+  ws.cropping = ctp->crop;
+  ws.culled = 0;
+  ws.lod = 0;
+  ws.small = 0;
+  ws.occlusion = NULL;
+  ws.stroke = NULL;
+  ws.markers = NULL;
+  ws.marked = 0;
+  ws.glyphs = NULL;
+  ws.glyph_uses = 0;
+  ws.split = ws.pieces = 0;
+  ws.hidden = 0;
+  ws.hidden_bytes = 0;
+  ws.styles = NULL;
+  ws.defs = NULL;
   for (size_t i = 0; i < sizeof ws.font / sizeof ws.font[0]; i++)
     ws.font[i] = "System.Fixed";
 
@@ -955,16 +2465,38 @@ int process(struct context *ctp)
          "standalone='no' ?>\n");
   output(&ws, false, "<!-- Generated from by Draw2SVG %s (%s) -->\n",
          linkversion, linkdate);
-  output(&ws, false, "<!DOCTYPE svg PUBLIC\n");
-  output(&ws, false, " '-//W3C//DTD SVG 20000303 Stylable//EN'\n");
-  output(&ws, false, " 'http://www.w3.org/TR/2000/03/WD-SVG-20000303/"
-                  "DTD/svg-20000303-stylable.dtd'>\n");
+  if (!ctp->compact) {
+    output(&ws, false, "<!DOCTYPE svg PUBLIC\n");
+    output(&ws, false, " '-//W3C//DTD SVG 20000303 Stylable//EN'\n");
+    output(&ws, false, " 'http://www.w3.org/TR/2000/03/WD-SVG-20000303/"
+           "DTD/svg-20000303-stylable.dtd'>\n");
+  }
 
-  /* Get the natural size of the file in draw-units. */
-  viewbox.min.x = (double) drawfile[6];
-  viewbox.min.y = (double) -drawfile[9];
-  viewbox.max.x = (double) drawfile[8];
-  viewbox.max.y = (double) -drawfile[7];
+  /* Get the natural size of the file in draw-units, or of the region
+     it is cropped to, or of what it paints, if measuring. */
+  extent_init(&extent);
+  if (ctp->tight && !ctp->crop) {
+    for (size_t i = 0; i < nruns; i++)
+      measure_list(&extent, ctp->thin, runs[i].p, runs[i].e);
+    extent_flush(&extent);
+  }
+  if (ctp->crop) {
+    region_box(ctp, ws.crop);
+    viewbox.min.x = (double) ws.crop[0];
+    viewbox.min.y = (double) -ws.crop[3];
+    viewbox.max.x = (double) ws.crop[2];
+    viewbox.max.y = (double) -ws.crop[1];
+  } else if (!extent.empty) {
+    viewbox.min.x = floor(extent.x0);
+    viewbox.min.y = -ceil(extent.y1);
+    viewbox.max.x = ceil(extent.x1);
+    viewbox.max.y = -floor(extent.y0);
+  } else {
+    viewbox.min.x = (double) drawfile[6];
+    viewbox.min.y = (double) -drawfile[9];
+    viewbox.max.x = (double) drawfile[8];
+    viewbox.max.y = (double) -drawfile[7];
+  }
 
   /* Normalise scaling to SCALE_FACTOR. */
   switch (ctp->scaletype) {
@@ -985,6 +2517,13 @@ int process(struct context *ctp)
       ctp->scale.fit.height / (viewbox.max.y - viewbox.min.y);
     break;
   }
+  /* Further variants use the same factors. */
+  ctp->scaletype = SCALE_FACTOR;
+
+  /* Find the size of a pixel in draw units. */
+  if (lod > 0)
+    ws.lod = ctp->u->u2d(1.0 / lod) /
+      fmin(ctp->scale.factor.x, ctp->scale.factor.y);
 
   /* Now add the margin (which isn't scaled). */
   viewbox.min.x -= ctp->margin.width / ctp->scale.factor.x;
@@ -992,6 +2531,31 @@ int process(struct context *ctp)
   viewbox.max.x += ctp->margin.width / ctp->scale.factor.x;
   viewbox.max.y += ctp->margin.height / ctp->scale.factor.y;
 
+  /* Choose the user-space grid, and express the viewbox in it.  The
+     grid rounds outwards, so nothing is clipped. */
+  if (ctp->precision >= 0) {
+    ws.uscale = pow(10.0, ctp->precision) / ctp->u->u2d(1.0);
+    ws.grid = true;
+  }
+  userbox.min.x = viewbox.min.x * ws.uscale;
+  userbox.min.y = viewbox.min.y * ws.uscale;
+  userbox.max.x = viewbox.max.x * ws.uscale;
+  userbox.max.y = viewbox.max.y * ws.uscale;
+  if (ws.grid) {
+    userbox.min.x = floor(userbox.min.x);
+    userbox.min.y = floor(userbox.min.y);
+    userbox.max.x = ceil(userbox.max.x);
+    userbox.max.y = ceil(userbox.max.y);
+  }
+  if (ctp->rebase) {
+    ws.ox = clamp_int(floor(userbox.min.x));
+    ws.oy = clamp_int(floor(userbox.min.y));
+    userbox.min.x -= ws.ox;
+    userbox.min.y -= ws.oy;
+    userbox.max.x -= ws.ox;
+    userbox.max.y -= ws.oy;
+  }
+
   /* Work out the new natural size in proper units. */
   natsize.min.x = ctp->u->d2u(viewbox.min.x);
   natsize.min.y = ctp->u->d2u(viewbox.min.y);
@@ -1022,12 +2586,17 @@ int process(struct context *ctp)
     }
   }
 
-  if (ctp->abssized != SIZE_ABS)
-    output(&ws, false, "<!-- width='%g%s' height='%g%s' -->\n",
-           natsize.max.x - natsize.min.x, ctp->u->t,
-           natsize.max.y - natsize.min.y, ctp->u->t);
-  if (ctp->abssized != SIZE_PERCENT)
-    output(&ws, false, "<!-- width='%g%%' height='%g%%' -->\n", wpc, hpc);
+  if (ctp->compact) {
+    /* Leave out the alternative sizes. */
+  } else {
+    if (ctp->abssized != SIZE_ABS)
+      output(&ws, false, "<!-- width='%g%s' height='%g%s' -->\n",
+             natsize.max.x - natsize.min.x, ctp->u->t,
+             natsize.max.y - natsize.min.y, ctp->u->t);
+    if (ctp->abssized != SIZE_PERCENT)
+      output(&ws, false, "<!-- width='%g%%' height='%g%%' -->\n",
+             wpc, hpc);
+  }
 
   output(&ws, false, "<svg "); 
   output(&ws, false, "xmlns='http://www.w3.org/2000/svg'\n     ");
@@ -1068,20 +2637,71 @@ int process(struct context *ctp)
   output(&ws, false, "stroke-opacity: 1;'\n");
   ws.indent -= 12;
 #endif
-  output(&ws, false, "     viewBox='%g %g %g %g'>\n",
-         viewbox.min.x, viewbox.min.y,
-         viewbox.max.x - viewbox.min.x,
-         viewbox.max.y - viewbox.min.y);
+  {
+    double vb[4] = {
+      userbox.min.x, userbox.min.y,
+      userbox.max.x - userbox.min.x,
+      userbox.max.y - userbox.min.y
+    };
+    output_nums(&ws, "     viewBox='", 4, vb, " ", "'>\n");
+  }
 
   ws.indent += 2;
+  if (ctp->occlude) {
+    occlusion_init(&occlusion);
+    for (size_t i = nruns; i-- > 0; )
+      find_hidden(&ws, &occlusion, runs[i].p, runs[i].e);
+    occlusion_done(&occlusion);
+    ws.occlusion = &occlusion;
+  }
+  if (ctp->stroke_fill) {
+    stroke_space_init(&stroke);
+    ws.stroke = &stroke;
+  }
+  if (ctp->stylesheet) {
+    styles_init(&styles);
+    ws.styles = &styles;
+  }
+  if (ctp->dedup) {
+    defs_init(&defs, ctp->dedup_min);
+    ws.defs = &defs;
+  }
+  if (ctp->cap_markers && !ctp->stroke_fill) {
+    markers_init(&markers);
+    ws.markers = &markers;
+  }
+  if (ctp->text_to_path) {
+    glyphs_init(&glyphs);
+    ws.glyphs = &glyphs;
+    if (ctp->share_glyphs && ctp->glyph_cache)
+      glyph_cache_load(&glyphs, ctp->glyph_cache);
+  }
+  if (ws.styles || ws.defs || ws.markers || (ws.glyphs && ctp->share_glyphs))
+    for (size_t i = 0; i < nruns; i++)
+      index_list(&ws, runs[i].p, runs[i].e);
+  if (ws.styles)
+    style_sheet(&ws, ws.styles);
+  if (ws.markers)
+    write_markers(&ws);
+  if (ws.glyphs)
+    write_glyphs(&ws);
+  if (ws.defs)
+    write_defs(&ws);
+
   if (ctp->bgcol) {
     output(&ws, false,
            "<rect style='fill: %s; stroke: none;'\n", ctp->bgcol);
     ws.indent += 6;
-    output(&ws, false, "x='%g' y='%g' width='%g' height='%g' />\n",
-           viewbox.min.x, viewbox.min.y,
-           viewbox.max.x - viewbox.min.x,
-           viewbox.max.y - viewbox.min.y);
+    output_nums(&ws, "x='", 1, &userbox.min.x, "", "' ");
+    output_nums(&ws, "y='", 1, &userbox.min.y, "", "' ");
+    {
+      double wh[2] = {
+        userbox.max.x - userbox.min.x,
+        userbox.max.y - userbox.min.y
+      };
+      output_nums(&ws, "width='", 1, &wh[0], "", "' ");
+      output_nums(&ws, "height='", 1, &wh[1], "", "' />\n");
+    }
     ws.indent -= 6;
   }
 
@@ -1097,7 +2717,8 @@ int process(struct context *ctp)
   ws.indent += 2;
 #endif
 
-  convert_list(&ws, drawfile + 10, drawfile + (drawlen >> 2));
+  for (size_t i = 0; i < nruns; i++)
+    convert_list(&ws, runs[i].p, runs[i].e);
 #ifdef STYLE_IN_GROUP
   ws.indent -= 2;
   output(&ws, false, "</g>\n");
@@ -1106,11 +2727,337 @@ int process(struct context *ctp)
   ws.indent -= 2;
   output(&ws, false, "</svg>\n");
 
-  fclose(ws.out);
+  if ((out_flush(&ws) < 0) | (sink_finish(out) < 0)) {
+    if (ws.styles)
+      styles_free(ws.styles);
+    if (ws.defs)
+      defs_free(ws.defs);
+    if (ws.occlusion)
+      occlusion_free(ws.occlusion);
+    if (ws.stroke)
+      stroke_space_free(ws.stroke);
+    if (ws.markers)
+      markers_free(ws.markers);
+    free(ws.shares);
+    if (ws.glyphs) {
+      save_glyphs(&ws);
+      lose_fonts(&ws);
+      glyphs_free(ws.glyphs);
+    }
+    sink_free(out);
+    out_free(&ws);
+    free(ws.buf);
+    fprintf(stderr, "Error writing %s\n", oname);
+    return -1;
+  }
+  if (ctp->stats) {
+    if (ctp->lod > 0 && ctp->nlevels > 1)
+      fprintf(stderr, "%s:\n", oname);
+    if (gzip)
+      fprintf(stderr, "Output: %llu bytes, compressed to %llu\n",
+              out->bytes, out->down->bytes);
+    else
+      fprintf(stderr, "Output: %llu bytes\n", out->bytes);
+    fprintf(stderr, "Path data: %llu bytes (%lld saved by optimization)\n",
+            ws.path_bytes, (long long) (ws.path_legacy - ws.path_bytes));
+    if (ws.styles)
+      fprintf(stderr, "Styles: %lu, %u in stylesheet\n",
+              (unsigned long) ws.styles->n, ws.styles->classes);
+    if (ws.defs) {
+      unsigned long uses = 0;
+      for (size_t i = 0; i < ws.defs->n; i++)
+        if (ws.defs->ents[i].id)
+          uses += ws.defs->ents[i].uses;
+      fprintf(stderr, "Definitions: %u, used %lu times\n",
+              ws.defs->ids, uses);
+    }
+    if (ctp->merge)
+      fprintf(stderr, "Merged paths: %lu, into %lu elements\n",
+              ws.merged, ws.merges);
+    if (ctp->shapes)
+      fprintf(stderr, "Paths written as shapes: %lu\n", ws.shapes);
+    if (ctp->groups && ctp->flatten)
+      fprintf(stderr, "Groups left out: %lu, properties shared: %lu\n",
+              ws.flattened, ws.hoisted);
+    if (ctp->crop)
+      fprintf(stderr, "Objects outside crop: %lu\n", ws.culled);
+    if (ws.lod > 0)
+      fprintf(stderr, "Objects below detail: %lu\n", ws.small);
+    if (ctp->max_path > 0)
+      fprintf(stderr, "Paths split: %lu, into %lu elements\n",
+              ws.split, ws.pieces);
+    if (ws.markers)
+      fprintf(stderr, "Paths with caps as markers: %lu, markers: %lu\n",
+              ws.marked, (unsigned long) ws.markers->n);
+    if (ws.glyphs)
+      fprintf(stderr, "Fonts: %lu, characters: %u, copied: %lu times\n",
+              (unsigned long) ws.glyphs->nfonts, ws.glyphs->ids,
+              ws.glyph_uses);
+    if (ws.glyphs && ctp->share_glyphs && ctp->glyph_cache)
+      fprintf(stderr, "Characters from cache: %lu of %lu\n",
+              ws.glyphs->loaded, (unsigned long) ws.glyphs->n);
+    if (!extent.empty)
+      fprintf(stderr, "Box: %g,%g,%g,%g (header: %d,%d,%d,%d)\n",
+              floor(extent.x0), floor(extent.y0),
+              ceil(extent.x1), ceil(extent.y1),
+              drawfile[6], drawfile[7], drawfile[8], drawfile[9]);
+    if (ctp->occlude)
+      fprintf(stderr, "Objects painted over: %lu, %lu bytes of drawfile\n",
+              ws.hidden, ws.hidden_bytes);
+  }
+  if (ws.styles)
+    styles_free(ws.styles);
+  if (ws.defs)
+    defs_free(ws.defs);
+  if (ws.occlusion)
+    occlusion_free(ws.occlusion);
+  if (ws.stroke)
+    stroke_space_free(ws.stroke);
+  if (ws.markers)
+    markers_free(ws.markers);
+  free(ws.shares);
+  if (ws.glyphs) {
+    save_glyphs(&ws);
+    lose_fonts(&ws);
+    glyphs_free(ws.glyphs);
+  }
+  sink_free(out);
+  out_free(&ws);
   free(ws.buf);
 
   if (ctp->otype)
-    set_file_type(ctp->oname, 0xaad);
+    set_file_type(oname, 0xaad);
 
   return 0;
 }
+
+/* Tiles are named dir.z.x.y/svg on RISC OS, and dir/z/x/y.svg
+   elsewhere. */
+#ifdef __riscos
+#define DIR_SEP "."
+#define EXT_SEP "/"
+#else
+#define DIR_SEP "/"
+#define EXT_SEP "."
+#endif
+
+/* Index the objects at the top level of a drawfile by their boxes.
+   Font tables and options have none, and are included everywhere. */
+static void index_objects(struct rtree *rt, const int *drawfile,
+                          size_t drawlen)
+{
+  static const int all[4] = { INT_MIN, INT_MIN, INT_MAX, INT_MAX };
+  const int *p = drawfile + 10, *e = drawfile + (drawlen >> 2);
+
+  for (; p < e; p += (p[1] >> 2))
+    rtree_add(rt, p[0] == 0 || p[0] == 11 ? all : p + 2, p - drawfile);
+  rtree_pack(rt);
+}
+
+/* Check that each object in a saved index starts an object at the top
+   level of the drawfile, in case the index is stale or damaged. */
+static int index_fits(const struct rtree *rt, const int *drawfile,
+                      size_t drawlen)
+{
+  size_t words = drawlen >> 2, p;
+  unsigned char *start = calloc(words / CHAR_BIT + 1, 1);
+  int ok = true;
+
+  if (!start) nomem();
+  for (p = 10; p + 1 < words && drawfile[p + 1] >= 8;
+       p += drawfile[p + 1] >> 2)
+    start[p / CHAR_BIT] |= 1u << p % CHAR_BIT;
+  for (size_t i = 0; i < rt->n && ok; i++) {
+    unsigned long ref = rt->ents[i].ref;
+    ok = ref < words && (start[ref / CHAR_BIT] >> ref % CHAR_BIT & 1);
+  }
+  free(start);
+  return ok;
+}
+
+/* Write a pyramid of tiles, each level cutting the drawing into
+   twice as many rows and columns as the one above.  Each tile is
+   cropped from the drawing, and converts only the objects that the
+   index finds touching it.  The index is kept beside the tiles, and
+   reused while the drawfile is unchanged. */
+static int write_tiles(struct context *ctp, int *drawfile, size_t drawlen)
+{
+  struct context saved = *ctp;
+  struct rtree rt;
+  unsigned key[3];
+  unsigned long *refs = NULL, tiles = 0, objects = 0;
+  size_t rcap = 0, ncap = 0;
+  struct run *runs = NULL;
+  size_t len = strlen(ctp->tiles) + 3 * FMT_INT_MAX + 16;
+  char *name = malloc(len);
+  double box[4], side;
+  int loaded, rc = 0;
+
+  if (!name) {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+
+  /* Get the box to cut up, made square from its top-left corner. */
+  if (ctp->crop) {
+    box[0] = fmin(ctp->region.x0, ctp->region.x1);
+    box[1] = fmin(ctp->region.y0, ctp->region.y1);
+    box[2] = fmax(ctp->region.x0, ctp->region.x1);
+    box[3] = fmax(ctp->region.y0, ctp->region.y1);
+  } else {
+    struct extent extent;
+
+    extent_init(&extent);
+    if (ctp->tight) {
+      measure_list(&extent, ctp->thin, drawfile + 10,
+                   drawfile + (drawlen >> 2));
+      extent_flush(&extent);
+    }
+    if (extent.empty)
+      extent_box(&extent, drawfile[6], drawfile[7],
+                 drawfile[8], drawfile[9]);
+    box[0] = extent.x0, box[1] = extent.y0;
+    box[2] = extent.x1, box[3] = extent.y1;
+  }
+  side = fmax(box[2] - box[0], box[3] - box[1]);
+
+  /* The index is identified by the drawfile's size and date. */
+  mkdir(ctp->tiles, 0777);
+  snprintf(name, len, "%s" DIR_SEP "index", ctp->tiles);
+  key[0] = drawlen;
+  if (get_file_stamp(ctp->iname, key + 1) != 1)
+    key[1] = key[2] = 0;
+  rtree_init(&rt);
+  loaded = rtree_load(&rt, name, key, 3) == 0 &&
+    index_fits(&rt, drawfile, drawlen);
+  if (!loaded) {
+    rtree_free(&rt);
+    rtree_init(&rt);
+    index_objects(&rt, drawfile, drawlen);
+    if (rtree_save(&rt, name, key, 3) < 0)
+      fprintf(stderr, "Error writing %s\n", name);
+  }
+  if (ctp->stats)
+    fprintf(stderr, "Index: %lu objects, %s %s\n", (unsigned long) rt.n,
+            loaded ? "read from" : "written to", name);
+
+  ctp->crop = true;
+  ctp->stats = false;
+  for (int z = 0; z <= ctp->tile_zoom && rc == 0; z++) {
+    unsigned long n = 1ul << z;
+    double step = side / n;
+
+    snprintf(name, len, "%s" DIR_SEP "%d", ctp->tiles, z);
+    mkdir(name, 0777);
+    for (unsigned long x = 0; x < n && rc == 0; x++) {
+      snprintf(name, len, "%s" DIR_SEP "%d" DIR_SEP "%lu",
+               ctp->tiles, z, x);
+      mkdir(name, 0777);
+      for (unsigned long y = 0; y < n && rc == 0; y++) {
+        int tbox[4];
+        size_t nrefs, nruns = 0;
+
+        /* Rows are counted down from the top. */
+        ctp->region.x0 = box[0] + x * step;
+        ctp->region.x1 = box[0] + (x + 1) * step;
+        ctp->region.y1 = box[3] - y * step;
+        ctp->region.y0 = box[3] - (y + 1) * step;
+        region_box(ctp, tbox);
+
+        /* Join objects next to each other into runs, so neighbouring
+           paths can still be merged. */
+        nrefs = rtree_query(&rt, tbox, &refs, &rcap);
+        if (ncap < nrefs) {
+          void *nb = realloc(runs, nrefs * sizeof *runs);
+          if (!nb) nomem();
+          runs = nb;
+          ncap = nrefs;
+        }
+        for (size_t i = 0; i < nrefs; i++) {
+          const int *p = drawfile + refs[i];
+          if (nruns > 0 && runs[nruns - 1].e == p) {
+            runs[nruns - 1].e = p + (p[1] >> 2);
+          } else {
+            runs[nruns].p = p;
+            runs[nruns++].e = p + (p[1] >> 2);
+          }
+        }
+        objects += nrefs;
+        tiles++;
+
+        snprintf(name, len, "%s" DIR_SEP "%d" DIR_SEP "%lu" DIR_SEP "%lu"
+                 EXT_SEP "%s", ctp->tiles, z, x, y,
+                 ctp->gzip == GZIP_YES ? "svgz" : "svg");
+        rc = write_svg(ctp, drawfile, runs, nruns, name, ctp->lod);
+
+        /* Each tile is scaled afresh. */
+        ctp->scale = saved.scale;
+        ctp->scaletype = saved.scaletype;
+      }
+    }
+  }
+  ctp->crop = saved.crop;
+  ctp->region = saved.region;
+  ctp->stats = saved.stats;
+
+  if (ctp->stats)
+    fprintf(stderr, "Tiles: %lu, objects converted: %lu\n",
+            tiles, objects);
+  rtree_free(&rt);
+  free(refs);
+  free(runs);
+  free(name);
+  return rc;
+}
+
+int process(struct context *ctp)
+{
+  int *drawfile;
+  size_t drawlen;
+  int type, rc = 0;
+  struct run all;
+
+#if false
+  printf("Draw-to-SVG converter %s %s\n", __DATE__, __TIME__);
+#endif
+
+  if (get_file_type_and_length(ctp->iname, &type, &drawlen) != 1) {
+    fprintf(stderr, "Not a file: %s\n", ctp->iname);
+    return -1;
+  }
+
+  if (ctp->itype && type != 0xaff) {
+    fprintf(stderr, "Not a drawfile: %s\n", ctp->iname);
+    return -1;
+  }
+
+  drawfile = malloc((drawlen + 3) & ~3);
+  if (!drawfile) {
+    fprintf(stderr, "Out of memory\n");
+    return -1;
+  }
+
+  if (load_file(ctp->iname, drawfile) < 0) {
+    free(drawfile);
+    fprintf(stderr, "Error loading %s\n", ctp->iname);
+    return -1;
+  }
+
+  /* Write each level of detail from the one copy of the file. */
+  all.p = drawfile + 10;
+  all.e = drawfile + (drawlen >> 2);
+  if (ctp->tiles) {
+    rc = write_tiles(ctp, drawfile, drawlen);
+  } else if (ctp->lod > 0 && ctp->nlevels > 0) {
+    for (int i = 0; i < ctp->nlevels && rc == 0; i++) {
+      char *name = variant_name(ctp->oname, ctp->levels[i]);
+      rc = write_svg(ctp, drawfile, &all, 1, name,
+                     ctp->lod / ctp->levels[i]);
+      free(name);
+    }
+  } else {
+    rc = write_svg(ctp, drawfile, &all, 1, ctp->oname, ctp->lod);
+  }
+  free(drawfile);
+  return rc;
+}